@@ -4,9 +4,17 @@
 #include "core/vec3.h"
 
 #include "physics/body.h"
+#include "physics/body_store.h"
+#include "physics/direct_gravity.h"
+#include "physics/spatial_hash.h"
 #include "physics/engine.h"
 #include "physics/forces.h"
 #include "physics/integrators.h"
+#include "physics/ks_regularization.h"
+#include "physics/kepler.h"
+#include "physics/bulirsch_stoer.h"
+#include "physics/ias15.h"
+#include "physics/wisdom_holman.h"
 #include "physics/accretion_disk.h"
 #include "physics/advanced_accretion_disk.h"
 #include "physics/magnetic_field.h"
@@ -25,6 +33,9 @@
 #include "physics/thermodynamics.h"
 #include "physics/electromagnetic_forces.h"
 #include "physics/octree.h"
+#include "physics/linear_octree.h"
+#include "physics/fmm.h"
+#include "physics/particle_mesh.h"
 
 #include "graphics/effects.h"
 #include "graphics/particles.h"
@@ -58,12 +58,17 @@ public:
     void useRK4() { physics->setIntegrator(IntegratorType::RK4); }
     void useVerlet() { physics->setIntegrator(IntegratorType::VERLET); }
     void useEuler() { physics->setIntegrator(IntegratorType::EULER); }
+    void useHermite() { physics->setIntegrator(IntegratorType::HERMITE4); }
+    void useWisdomHolman() { physics->setIntegrator(IntegratorType::WISDOM_HOLMAN); }
+    void useIAS15() { physics->setIntegrator(IntegratorType::IAS15); }
+    void enableCloseEncounters() { physics->enableHybridEncounters(true); }
 
     void enableRelativity() { physics->enableRelativistic(true); }
     void disableRelativity() { physics->enableRelativistic(false); }
 
     void enableCollisions() { physics->enableCollisions(true); }
     void disableCollisions() { physics->enableCollisions(false); }
+    void enableContinuousCollisions() { physics->enableContinuousCollisions(true); }
 
     void enableMHD() { physics->enableMHD(true); }
     void disableMHD() { physics->enableMHD(false); }
@@ -74,8 +79,26 @@ public:
     void enableParticleInteractions() { physics->enableParticleInteractions(true); }
     void disableParticleInteractions() { physics->enableParticleInteractions(false); }
 
+    void enableOctree(double theta = 0.5) {
+        physics->setOctreeTheta(theta);
+        physics->enableOctree(true);
+    }
+    void disableOctree() { physics->enableOctree(false); }
+    void setGravitySolver(GravitySolver solver) { physics->setGravitySolver(solver); }
+    void enableParticleMesh(size_t gridSize = 64, bool treePM = true) {
+        physics->setPmGridSize(gridSize);
+        physics->setGravitySolver(treePM ? GravitySolver::TREEPM : GravitySolver::PM);
+    }
+    void setPeriodicBox(Vec3 boxMin, double boxSize) {
+        physics->setPmBoundary(MeshBoundary::PERIODIC, boxMin, boxSize);
+    }
+
     void enableDeterministicPhysics() { physics->enableDeterministicPhysics(true); }
     void disableDeterministicPhysics() { physics->enableDeterministicPhysics(false); }
+    void enableReproducible(uint64_t seed = 0) {
+        physics->setRandomSeed(seed);
+        physics->enableReproducible(true);
+    }
 
     void setTimeScale(double scale) { physics->setTimeScale(scale); }
     void setTimeStep(double dt) { timeStep = dt; }
@@ -87,26 +110,24 @@ public:
     void toggleOrbits() { renderer->toggleOrbits(); }
     void toggleGrid() { renderer->toggleGrid(); }
 
+    // Indeks jak w getBodies() w chwili wywołania; dla zniszczonego ciała nic się nie dzieje
     void focusOnBody(int index) {
-        auto &bodies = physics->getBodies();
-        if (index >= 0 && index < bodies.size()) {
-            renderer->focusOn(*bodies[index], bodies[index]->radius * 10);
+        if (index < 0) return;
+        if (auto body = physics->findBody(physics->getHandle(index))) {
+            renderer->focusOn(*body, body->radius * 10);
         }
     }
 
     void followBody(int index) {
-        auto &bodies = physics->getBodies();
-        if (index >= 0 && index < bodies.size()) {
-            renderer->setCamera(bodies[index]->pos + Vec3(bodies[index]->radius * 5,
-                                                          bodies[index]->radius * 5,
-                                                          bodies[index]->radius * 3),
-                                bodies[index]->pos);
+        if (index < 0) return;
+        if (auto body = physics->findBody(physics->getHandle(index))) {
+            renderer->setCamera(body->pos + Vec3(body->radius * 5, body->radius * 5, body->radius * 3), body->pos);
         }
     }
 
     void setCamera(Vec3 pos, Vec3 target) { renderer->setCamera(pos, target); }
 
-    int getBodyCount() const { return physics->getBodies().size(); }
+    int getBodyCount() const { return physics->getBodyCount(); }
     double getTotalEnergy() const { return physics->totalEnergy(); }
     Vec3 getCenterOfMass() const { return physics->centerOfMass(); }
 
@@ -117,13 +138,14 @@ public:
     void run() {
         SDL_Event event;
         SDL_SetRelativeMouseMode(SDL_TRUE);
-        int followIndex = -1;
+        // Uchwyt, a nie indeks - kolizje zmieniają indeksy, a śledzone ma być to samo ciało
+        BodyHandle followed;
         bool autoFollow = false;
         int frameCount = 0;
         auto lastPrint = std::chrono::high_resolution_clock::now();
 
         std::cout << "\n=== Simulation Started ===\n";
-        std::cout << "Bodies: " << physics->getBodies().size() << "\n";
+        std::cout << "Bodies: " << physics->getBodyCount() << "\n";
         std::cout << "Time step: " << timeStep << " s\n\n";
 
         while (running) {
@@ -132,7 +154,7 @@ public:
                 if (event.type == SDL_KEYDOWN) {
                     if (event.key.keysym.sym >= SDLK_0 &&
                         event.key.keysym.sym <= SDLK_9) {
-                        followIndex = event.key.keysym.sym - SDLK_0;
+                        followed = physics->getHandle(event.key.keysym.sym - SDLK_0);
                         autoFollow = true;
                     } else if (event.key.keysym.sym == SDLK_f) {
                         autoFollow = !autoFollow;
@@ -162,13 +184,16 @@ public:
                 frameCount++;
             }
 
+            // Diagnostyka liczona raz na krok - konsola, kamera i HUD czytają tę samą
+            const Diagnostics &stats = physics->getDiagnostics();
+
             auto now = std::chrono::high_resolution_clock::now();
             if (std::chrono::duration<double>(now - lastPrint).count() >= 1.0) {
                 std::cout << "\r[Frame " << frameCount << "] ";
-                std::cout << "Bodies: " << physics->getBodies().size() << " | ";
+                std::cout << "Bodies: " << stats.bodies << " | ";
                 std::cout << "Energy: " << std::scientific << std::setprecision(3)
-                        << physics->totalEnergy() << " J | ";
-                Vec3 com = physics->centerOfMass();
+                        << stats.energy << " J | ";
+                Vec3 com = stats.centerOfMass;
                 std::cout << "CoM: (" << std::fixed << std::setprecision(2)
                         << com.x / 1e9 << ", " << com.y / 1e9 << ", " << com.z / 1e9
                         << ") Gm";
@@ -176,20 +201,13 @@ public:
                 lastPrint = now;
             }
 
-            if (autoFollow && !physics->getBodies().empty()) {
-                if (followIndex < 0 || followIndex >= physics->getBodies().size()) {
-                    Vec3 com = physics->centerOfMass();
-                    Vec3 minPos(1e20, 1e20, 1e20);
-                    Vec3 maxPos(-1e20, -1e20, -1e20);
-
-                    for (const auto &body: physics->getBodies()) {
-                        minPos.x = std::min(minPos.x, body->pos.x);
-                        minPos.y = std::min(minPos.y, body->pos.y);
-                        minPos.z = std::min(minPos.z, body->pos.z);
-                        maxPos.x = std::max(maxPos.x, body->pos.x);
-                        maxPos.y = std::max(maxPos.y, body->pos.y);
-                        maxPos.z = std::max(maxPos.z, body->pos.z);
-                    }
+            if (autoFollow && stats.bodies > 0) {
+                // Zniszczone ciało (np. po połączeniu) daje pusty wskaźnik - widok na cały układ
+                auto target = physics->findBody(followed);
+                if (!target) {
+                    Vec3 com = stats.centerOfMass;
+                    Vec3 minPos = stats.bounds.min;
+                    Vec3 maxPos = stats.bounds.max;
 
                     double spanX = maxPos.x - minPos.x;
                     double spanY = maxPos.y - minPos.y;
@@ -202,7 +220,7 @@ public:
                     renderer->setCamera(com + Vec3(camDist * 0.7, camDist * 0.5, camDist * 0.7),
                                         com);
                 } else {
-                    auto &body = physics->getBodies()[followIndex];
+                    auto &body = target;
                     double camDist = body->radius * 50;
                     if (camDist < body->radius * 10)
                         camDist = body->radius * 10;
@@ -216,15 +234,15 @@ public:
             renderer->drawGrid(Physics::AU * 10, 20);
 
             for (const auto &body: physics->getBodies()) {
-                renderer->drawBody(*body);
+                if (!body->destroyed) renderer->drawBody(*body);
             }
 
             char info[256];
             snprintf(info, sizeof(info), "Frame: %d | Bodies: %d | Energy: %.2e J",
-                     frameCount, (int) physics->getBodies().size(), physics->totalEnergy());
+                     frameCount, (int) stats.bodies, stats.energy);
             renderer->drawText(info, 10, 20);
 
-            Vec3 com = physics->centerOfMass();
+            Vec3 com = stats.centerOfMass;
             snprintf(info, sizeof(info), "CoM: (%.2f, %.2f, %.2f) Gm",
                      com.x / 1e9, com.y / 1e9, com.z / 1e9);
             renderer->drawText(info, 10, 40);
@@ -0,0 +1,133 @@
+#pragma once
+#include "parallel.h"
+#include <cmath>
+#include <complex>
+#include <cstddef>
+#include <vector>
+
+namespace Fft {
+
+using Complex = std::complex<double>;
+
+// Radix-2 Cooleya-Tukeya, in-place; n musi być potęgą dwójki
+class Plan {
+    size_t n = 0;
+    // Czynniki obrotu kolejnych etapów ułożone jeden za drugim (etap len zaczyna się od len / 2 - 1)
+    std::vector<Complex> forward, backward;
+    std::vector<size_t> reversed;
+
+public:
+    Plan() = default;
+    explicit Plan(size_t size) { resize(size); }
+
+    size_t size() const { return n; }
+
+    void resize(size_t size) {
+        if (size == n) return;
+        n = size;
+        forward.clear();
+        backward.clear();
+        for (size_t len = 2; len <= n; len <<= 1) {
+            for (size_t k = 0; k < len / 2; ++k) {
+                double a = -2.0 * M_PI * double(k) / double(len);
+                forward.emplace_back(std::cos(a), std::sin(a));
+                backward.emplace_back(std::cos(a), -std::sin(a));
+            }
+        }
+        reversed.resize(n);
+        size_t bits = 0;
+        while ((size_t(1) << bits) < n) ++bits;
+        for (size_t i = 0; i < n; ++i) {
+            size_t r = 0;
+            for (size_t b = 0; b < bits; ++b) r |= ((i >> b) & 1) << (bits - 1 - b);
+            reversed[i] = r;
+        }
+    }
+
+    // Bez normalizacji: transform odwrotna zwraca n * x
+    void transform(Complex *a, bool inverse) const {
+        for (size_t i = 0; i < n; ++i) {
+            if (i < reversed[i]) std::swap(a[i], a[reversed[i]]);
+        }
+        for (size_t i = 0; i + 1 < n; i += 2) {
+            Complex u = a[i], v = a[i + 1];
+            a[i] = u + v;
+            a[i + 1] = u - v;
+        }
+        const Complex *stage = (inverse ? backward.data() : forward.data()) + 1;
+        for (size_t len = 4; len <= n; len <<= 1) {
+            size_t half = len / 2;
+            for (size_t i = 0; i < n; i += len) {
+                Complex *lo = a + i, *hi = a + i + half;
+                for (size_t k = 0; k < half; ++k) {
+                    Complex w = stage[k], v = hi[k];
+                    Complex t(v.real() * w.real() - v.imag() * w.imag(), v.real() * w.imag() + v.imag() * w.real());
+                    hi[k] = lo[k] - t;
+                    lo[k] += t;
+                }
+            }
+            stage += half;
+        }
+    }
+};
+
+inline bool isPowerOfTwo(size_t n) { return n > 0 && (n & (n - 1)) == 0; }
+
+inline size_t nextPowerOfTwo(size_t n) {
+    size_t p = 1;
+    while (p < n) p <<= 1;
+    return p;
+}
+
+// Transformata 3D siatki m^3 (indeks (i * m + j) * m + k). Przy transformacie prostej dane
+// niezerowe są tylko dla i, j, k < active, a przy odwrotnej potrzebujemy wyniku tylko tam -
+// zbędne linie pomijamy (obcięta transformata dla siatek z zerowym wypełnieniem).
+inline void transform3d(std::vector<Complex> &data, size_t m, const Plan &plan, bool inverse,
+                        size_t active, const Parallel::Workers &workers) {
+    size_t plane = m * m;
+
+    auto alongK = [&](size_t rows) {
+        workers.forRange(0, rows * rows, [&](size_t b, size_t e, size_t) {
+            for (size_t line = b; line < e; ++line) {
+                size_t i = line / rows, j = line % rows;
+                plan.transform(&data[i * plane + j * m], inverse);
+            }
+        }, 16);
+    };
+
+    auto alongJ = [&](size_t rows) {
+        workers.forRange(0, rows * m, [&](size_t b, size_t e, size_t) {
+            std::vector<Complex> line(m);
+            for (size_t l = b; l < e; ++l) {
+                size_t i = l / m, k = l % m;
+                Complex *base = &data[i * plane + k];
+                for (size_t j = 0; j < m; ++j) line[j] = base[j * m];
+                plan.transform(line.data(), inverse);
+                for (size_t j = 0; j < m; ++j) base[j * m] = line[j];
+            }
+        }, 16);
+    };
+
+    auto alongI = [&]() {
+        workers.forRange(0, plane, [&](size_t b, size_t e, size_t) {
+            std::vector<Complex> line(m);
+            for (size_t l = b; l < e; ++l) {
+                Complex *base = &data[l];
+                for (size_t i = 0; i < m; ++i) line[i] = base[i * plane];
+                plan.transform(line.data(), inverse);
+                for (size_t i = 0; i < m; ++i) base[i * plane] = line[i];
+            }
+        }, 16);
+    };
+
+    if (!inverse) {
+        alongK(active);
+        alongJ(active);
+        alongI();
+    } else {
+        alongI();
+        alongJ(active);
+        alongK(active);
+    }
+}
+}
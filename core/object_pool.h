@@ -0,0 +1,131 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <vector>
+
+// Pula obiektów wydawanych jako shared_ptr. Gdy znika ostatni wskaźnik, obiekt nie jest niszczony,
+// tylko wraca do puli razem ze swoimi buforami (ślad zachowuje pojemność), a bloki kontrolne
+// shared_ptr biorą się ze slotów z listy wolnych. Po rozgrzaniu utworzenie obiektu nie woła sterty.
+// Pula może zniknąć przed obiektami - jej stan trzymają też wydane wskaźniki. Bezpieczna dla wątków.
+template<typename T>
+class ObjectPool {
+public:
+    struct Stats {
+        size_t created = 0;  // wydane obiekty
+        size_t recycled = 0; // w tym wzięte z puli
+        size_t heap = 0;     // alokacje na stercie: nowe obiekty i sloty bloków kontrolnych
+    };
+
+private:
+    static constexpr size_t SLOT = 128;
+
+    struct State {
+        std::mutex lock;
+        std::vector<T *> objects;
+        std::vector<void *> slots;
+        Stats stats;
+
+        ~State() {
+            for (T *object: objects) delete object;
+            for (void *slot: slots) ::operator delete(slot);
+        }
+    };
+
+    template<typename U>
+    struct SlotAllocator {
+        using value_type = U;
+        std::shared_ptr<State> state;
+
+        explicit SlotAllocator(std::shared_ptr<State> s) : state(std::move(s)) {}
+        template<typename V>
+        SlotAllocator(const SlotAllocator<V> &other) : state(other.state) {}
+
+        static bool fits(size_t n) { return n * sizeof(U) <= SLOT && alignof(U) <= alignof(std::max_align_t); }
+
+        U *allocate(size_t n) {
+            std::lock_guard<std::mutex> guard(state->lock);
+            if (fits(n) && !state->slots.empty()) {
+                void *slot = state->slots.back();
+                state->slots.pop_back();
+                return static_cast<U *>(slot);
+            }
+            ++state->stats.heap;
+            return static_cast<U *>(::operator new(fits(n) ? SLOT : n * sizeof(U)));
+        }
+
+        void deallocate(U *p, size_t n) {
+            if (!fits(n)) {
+                ::operator delete(p);
+                return;
+            }
+            std::lock_guard<std::mutex> guard(state->lock);
+            state->slots.push_back(p);
+        }
+
+        template<typename V>
+        bool operator==(const SlotAllocator<V> &other) const { return state == other.state; }
+        template<typename V>
+        bool operator!=(const SlotAllocator<V> &other) const { return state != other.state; }
+    };
+
+    struct Recycle {
+        std::shared_ptr<State> state;
+
+        void operator()(T *object) const {
+            std::lock_guard<std::mutex> guard(state->lock);
+            state->objects.push_back(object);
+        }
+    };
+
+    std::shared_ptr<State> state = std::make_shared<State>();
+
+    // Świeży stan z fresh, ale bufor śladu zostaje z poprzedniego użycia obiektu
+    static void reuse(T &object, T &&fresh) {
+        if constexpr (requires { object.trail.clear(); }) {
+            auto trail = std::move(object.trail);
+            trail.clear();
+            object = std::move(fresh);
+            object.trail = std::move(trail);
+        } else {
+            object = std::move(fresh);
+        }
+    }
+
+public:
+    template<typename... Args>
+    std::shared_ptr<T> make(Args &&...args) {
+        T *object = nullptr;
+        {
+            std::lock_guard<std::mutex> guard(state->lock);
+            ++state->stats.created;
+            if (!state->objects.empty()) {
+                object = state->objects.back();
+                state->objects.pop_back();
+                ++state->stats.recycled;
+            } else {
+                ++state->stats.heap;
+            }
+        }
+        if (object) {
+            reuse(*object, T(std::forward<Args>(args)...));
+        } else {
+            object = new T(std::forward<Args>(args)...);
+        }
+        return std::shared_ptr<T>(object, Recycle{state}, SlotAllocator<T>(state));
+    }
+
+    // Liczniki od utworzenia puli
+    Stats stats() const {
+        std::lock_guard<std::mutex> guard(state->lock);
+        return state->stats;
+    }
+
+    // Obiekty czekające na ponowne użycie
+    size_t idle() const {
+        std::lock_guard<std::mutex> guard(state->lock);
+        return state->objects.size();
+    }
+};
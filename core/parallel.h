@@ -0,0 +1,304 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Parallel {
+
+inline unsigned defaultThreads() {
+    unsigned n = std::thread::hardware_concurrency();
+    return n > 0 ? n : 1;
+}
+
+// Dzieli [begin, end) na równe kawałki; fn(chunkBegin, chunkEnd, chunkIndex)
+template<typename Fn>
+void forRange(size_t begin, size_t end, unsigned threads, Fn &&fn, size_t minChunk = 1024) {
+    size_t n = end > begin ? end - begin : 0;
+    size_t chunks = std::min<size_t>(threads, (n + minChunk - 1) / minChunk);
+    if (chunks <= 1) {
+        if (n > 0) fn(begin, end, size_t(0));
+        return;
+    }
+
+    std::vector<std::thread> workers;
+    workers.reserve(chunks - 1);
+    size_t chunkSize = (n + chunks - 1) / chunks;
+    for (size_t c = 1; c < chunks; ++c) {
+        size_t b = begin + c * chunkSize;
+        size_t e = std::min(end, b + chunkSize);
+        if (b >= e) break;
+        workers.emplace_back([&fn, b, e, c] { fn(b, e, c); });
+    }
+    fn(begin, std::min(end, begin + chunkSize), size_t(0));
+    for (auto &w: workers) w.join();
+}
+
+// Czas pracy i bezczynności każdego wątku w ostatnim forBalanced [s]
+struct BalanceStats {
+    std::vector<double> busy, idle;
+    size_t steals = 0;
+};
+
+// Stała pula wątków. Wątek wywołujący pracuje jako wątek 0, pozostałe czekają na kolejne
+// zadanie zamiast powstawać od nowa w każdym kroku symulacji.
+class ThreadPool {
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake, finished;
+    const std::function<void(unsigned)> *job = nullptr;
+    unsigned jobThreads = 0;
+    unsigned running = 0;
+    size_t generation = 0;
+    bool stopping = false;
+
+    void loop(unsigned index, size_t seen) {
+        for (;;) {
+            const std::function<void(unsigned)> *task;
+            bool active;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [&] { return stopping || generation != seen; });
+                if (stopping) return;
+                seen = generation;
+                task = job;
+                active = index < jobThreads;
+            }
+            if (active) (*task)(index);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (--running == 0) finished.notify_one();
+            }
+        }
+    }
+
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto &w: workers) w.join();
+        workers.clear();
+        stopping = false;
+    }
+
+public:
+    explicit ThreadPool(unsigned threads = 1) { resize(threads); }
+    ~ThreadPool() { stop(); }
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    unsigned size() const { return unsigned(workers.size()) + 1; }
+
+    void resize(unsigned threads) {
+        threads = std::max(1u, threads);
+        if (threads == size()) return;
+        stop();
+        for (unsigned i = 1; i < threads; ++i) workers.emplace_back([this, i, g = generation] { loop(i, g); });
+    }
+
+    // fn(thread) dla thread = 0..threads-1, każde wywołanie na innym wątku; wraca po wszystkich
+    void run(unsigned threads, const std::function<void(unsigned)> &fn) {
+        threads = std::min(threads, size());
+        if (threads <= 1) {
+            fn(0);
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            job = &fn;
+            jobThreads = threads;
+            running = unsigned(workers.size());
+            ++generation;
+        }
+        wake.notify_all();
+        fn(0);
+        std::unique_lock<std::mutex> lock(mutex);
+        finished.wait(lock, [&] { return running == 0; });
+    }
+
+    // Zadania [0, n) w blokach po block. Wątki startują z ciągłymi zakresami bloków o równym
+    // koszcie (cost[i] - np. praca zadania w poprzednim kroku, nullptr - wszystkie równe), a kto
+    // skończy swój zakres, zabiera połowę niezaczętych bloków z końca zakresu innego wątku.
+    // fn(begin, end, thread).
+    template<typename Fn>
+    void forBalanced(size_t n, const uint32_t *cost, Fn &&fn, size_t block = 32, BalanceStats *stats = nullptr) {
+        using Clock = std::chrono::steady_clock;
+        size_t blocks = (n + block - 1) / block;
+        unsigned threads = unsigned(std::min<size_t>(size(), blocks));
+        if (stats) {
+            stats->busy.assign(std::max(1u, threads), 0.0);
+            stats->idle.assign(std::max(1u, threads), 0.0);
+            stats->steals = 0;
+        }
+        if (threads <= 1) {
+            auto start = Clock::now();
+            if (n > 0) fn(size_t(0), n, 0u);
+            if (stats) stats->busy[0] = std::chrono::duration<double>(Clock::now() - start).count();
+            return;
+        }
+
+        std::vector<double> prefix(blocks + 1, 0.0);
+        for (size_t b = 0; b < blocks; ++b) {
+            double c = 0;
+            for (size_t i = b * block; i < std::min(n, (b + 1) * block); ++i) c += cost ? double(cost[i]) + 1.0 : 1.0;
+            prefix[b + 1] = prefix[b] + c;
+        }
+
+        struct Range {
+            std::mutex mutex;
+            size_t head = 0, tail = 0;
+        };
+        std::unique_ptr<Range[]> ranges(new Range[threads]);
+        size_t next = 0;
+        for (unsigned t = 0; t < threads; ++t) {
+            double target = prefix[blocks] * (t + 1) / threads;
+            ranges[t].head = next;
+            while (next < blocks && (t + 1 == threads || prefix[next] + 0.5 * (prefix[next + 1] - prefix[next]) < target)) {
+                ++next;
+            }
+            ranges[t].tail = next;
+        }
+
+        std::atomic<size_t> steals{0};
+        std::vector<double> busy(threads, 0.0);
+        auto start = Clock::now();
+        run(threads, [&](unsigned t) {
+            Range &own = ranges[t];
+            for (;;) {
+                size_t b = blocks;
+                {
+                    std::lock_guard<std::mutex> lock(own.mutex);
+                    if (own.head < own.tail) b = own.head++;
+                }
+                if (b == blocks) {
+                    size_t first = 0, last = 0;
+                    for (unsigned k = 1; k < threads && first == last; ++k) {
+                        Range &victim = ranges[(t + k) % threads];
+                        std::lock_guard<std::mutex> lock(victim.mutex);
+                        size_t left = victim.tail - victim.head;
+                        if (left == 0) continue;
+                        last = victim.tail;
+                        first = victim.tail - (left + 1) / 2;
+                        victim.tail = first;
+                    }
+                    if (first == last) break;
+                    steals.fetch_add(1, std::memory_order_relaxed);
+                    std::lock_guard<std::mutex> lock(own.mutex);
+                    own.head = first + 1;
+                    own.tail = last;
+                    b = first;
+                }
+
+                auto t0 = Clock::now();
+                fn(b * block, std::min(n, (b + 1) * block), t);
+                busy[t] += std::chrono::duration<double>(Clock::now() - t0).count();
+            }
+        });
+
+        if (stats) {
+            double wall = std::chrono::duration<double>(Clock::now() - start).count();
+            for (unsigned t = 0; t < threads; ++t) {
+                stats->busy[t] = busy[t];
+                stats->idle[t] = std::max(0.0, wall - busy[t]);
+            }
+            stats->steals = steals.load();
+        }
+    }
+
+    // Jak Parallel::forRange, ale na wątkach puli
+    template<typename Fn>
+    void forRange(size_t begin, size_t end, Fn &&fn, size_t minChunk = 1024) {
+        size_t n = end > begin ? end - begin : 0;
+        size_t chunks = std::min<size_t>(size(), (n + minChunk - 1) / minChunk);
+        if (chunks <= 1) {
+            if (n > 0) fn(begin, end, size_t(0));
+            return;
+        }
+
+        size_t chunkSize = (n + chunks - 1) / chunks;
+        run(unsigned(chunks), [&](unsigned c) {
+            size_t b = begin + c * chunkSize;
+            size_t e = std::min(end, b + chunkSize);
+            if (b < e) fn(b, e, size_t(c));
+        });
+    }
+};
+
+// Wątki solvera: trwałe wątki puli, a bez puli (solver używany samodzielnie) nowe przy każdym
+// wywołaniu. threads ogranicza liczbę kawałków także przy puli.
+struct Workers {
+    ThreadPool *pool = nullptr;
+    unsigned threads = defaultThreads();
+
+    unsigned size() const { return pool ? std::min(threads, pool->size()) : threads; }
+
+    // Jak Parallel::forRange: fn(chunkBegin, chunkEnd, chunkIndex)
+    template<typename Fn>
+    void forRange(size_t begin, size_t end, Fn &&fn, size_t minChunk = 1024) const {
+        if (!pool) {
+            Parallel::forRange(begin, end, threads, fn, minChunk);
+            return;
+        }
+        size_t n = end > begin ? end - begin : 0;
+        size_t chunks = std::min<size_t>(size(), (n + minChunk - 1) / minChunk);
+        if (chunks <= 1) {
+            if (n > 0) fn(begin, end, size_t(0));
+            return;
+        }
+
+        size_t chunkSize = (n + chunks - 1) / chunks;
+        pool->run(unsigned(chunks), [&](unsigned c) {
+            size_t b = begin + c * chunkSize;
+            size_t e = std::min(end, b + chunkSize);
+            if (b < e) fn(b, e, size_t(c));
+        });
+    }
+};
+
+template<typename It, typename Compare>
+void sort(It first, It last, const Workers &workers, Compare comp) {
+    size_t n = last - first;
+    size_t chunks = std::min<size_t>(workers.size(), n / 4096);
+    if (chunks <= 1) {
+        std::sort(first, last, comp);
+        return;
+    }
+
+    size_t chunkSize = (n + chunks - 1) / chunks;
+    std::vector<size_t> bounds;
+    for (size_t b = 0; b < n; b += chunkSize) bounds.push_back(b);
+    bounds.push_back(n);
+
+    workers.forRange(0, bounds.size() - 1, [&](size_t b, size_t e, size_t) {
+        for (size_t c = b; c < e; ++c) std::sort(first + bounds[c], first + bounds[c + 1], comp);
+    }, 1);
+
+    while (bounds.size() > 2) {
+        std::vector<size_t> merged;
+        size_t pairs = (bounds.size() - 1) / 2;
+        workers.forRange(0, pairs, [&](size_t b, size_t e, size_t) {
+            for (size_t p = b; p < e; ++p) {
+                std::inplace_merge(first + bounds[2 * p], first + bounds[2 * p + 1],
+                                   first + bounds[2 * p + 2], comp);
+            }
+        }, 1);
+        for (size_t i = 0; i < bounds.size(); i += 2) merged.push_back(bounds[i]);
+        if (merged.back() != n) merged.push_back(n);
+        bounds.swap(merged);
+    }
+}
+
+template<typename It, typename Compare>
+void sort(It first, It last, unsigned threads, Compare comp) {
+    sort(first, last, Workers{nullptr, threads}, comp);
+}
+}
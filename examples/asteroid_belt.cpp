@@ -15,7 +15,8 @@ int main() {
                                      1e18 + rand() % (int) 1e19, 1e5 + rand() % (int) 5e5);
     }
 
-    sim.useRK4();
+    sim.useWisdomHolman();
+    sim.enableCloseEncounters();
     sim.enableCollisions();
     sim.enableGlow();
     sim.setTimeStep(3600 * 24);
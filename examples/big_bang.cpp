@@ -0,0 +1,37 @@
+#include "PhySPP.h"
+#include <iostream>
+
+int main() {
+    std::cout << "Big Bang: structure formation in a periodic box (TreePM)\n";
+
+    Simulation sim(1280, 720, "Big Bang");
+
+    // Prawie jednorodna siatka z małymi zaburzeniami - grawitacja wzmacnia je w strukturę
+    const int perAxis = 16;
+    const double box = 1e14;
+    const double spacing = box / perAxis;
+    const double mass = 1e30;
+
+    for (int i = 0; i < perAxis; i++) {
+        for (int j = 0; j < perAxis; j++) {
+            for (int k = 0; k < perAxis; k++) {
+                Vec3 jitter(((rand() % 1000) - 500) / 1000.0,
+                            ((rand() % 1000) - 500) / 1000.0,
+                            ((rand() % 1000) - 500) / 1000.0);
+                Vec3 pos = Vec3(i + 0.5, j + 0.5, k + 0.5) * spacing + jitter * (spacing * 0.2);
+                sim.addBodyWithVelocityColor(pos, Vec3(0, 0, 0), mass, 1e11);
+            }
+        }
+    }
+
+    sim.enableParticleMesh(32, true);
+    sim.setPeriodicBox(Vec3(0, 0, 0), box);
+    sim.disableCollisions();
+    sim.useVerlet();
+    sim.enableGlow();
+    sim.setCamera(Vec3(box * 0.5, box * 0.5, box * 2.0), Vec3(box * 0.5, box * 0.5, box * 0.5));
+    sim.setTimeStep(1e7);
+    sim.run();
+
+    return 0;
+}
@@ -35,6 +35,7 @@ int main() {
 
     sim.useRK4();
     sim.enableCollisions();
+    sim.enableContinuousCollisions();
     sim.enableGlow();
     sim.enableBloom();
     sim.setTimeStep(3600 * 6);
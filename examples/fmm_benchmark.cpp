@@ -0,0 +1,144 @@
+#include "physics/engine.h"
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <string>
+
+// Warunki początkowe jak w galaxy_collision.cpp, przeskalowane do n ciał
+static std::vector<BodyPtr> galaxyCollision(size_t n, std::mt19937 &rng) {
+    std::uniform_real_distribution<double> u(0.0, 1.0);
+    std::vector<BodyPtr> bodies;
+    double galMass = 1e31;
+    double separation = 5e11;
+    bodies.push_back(std::make_shared<Body>(Vec3(-separation, 0, 0), Vec3(1e4, 0, 0), galMass, 1e9));
+    bodies.push_back(std::make_shared<Body>(Vec3(separation, 0, 0), Vec3(-1e4, 0, 0), galMass, 1e9));
+
+    size_t perGalaxy = (n - 2) / 2;
+    for (size_t i = 0; i < perGalaxy; i++) {
+        double angle = 2 * M_PI * i / perGalaxy;
+        double r = 2e11 * (0.5 + u(rng));
+        double v = 2e4;
+        double h = (u(rng) - 0.5) * 1e10;
+        bodies.push_back(std::make_shared<Body>(Vec3(-separation + r * cos(angle), h, r * sin(angle)),
+                                                Vec3(1e4 - v * sin(angle), 0, v * cos(angle)), 1e28, 5e7));
+        bodies.push_back(std::make_shared<Body>(Vec3(separation + r * cos(angle), h, r * sin(angle)),
+                                                Vec3(-1e4 - v * sin(angle), 0, v * cos(angle)), 1e28, 5e7));
+    }
+    return bodies;
+}
+
+// Warunki początkowe jak w milky_way.cpp, przeskalowane do n ciał
+static std::vector<BodyPtr> milkyWay(size_t n, std::mt19937 &rng) {
+    std::uniform_real_distribution<double> u(0.0, 1.0);
+    std::vector<BodyPtr> bodies;
+    double bhMass = 4.1e6 * Physics::SOLAR_MASS;
+    bodies.push_back(std::make_shared<Body>(Vec3(0, 0, 0), Vec3(0, 0, 0), bhMass, 1e10));
+
+    for (size_t i = 0; i + 1 < n; i++) {
+        double t = double(i) / double(n - 1);
+        double angle = i * 2.0 * M_PI / (n - 1) + t * 5.0 * M_PI;
+        double r = Physics::AU * 1000 * (1 + t * 5.0);
+        double z = (u(rng) - 0.5) * Physics::AU * 50 * 1000;
+        Vec3 pos(r * cos(angle), r * sin(angle), z);
+
+        double v = sqrt(Physics::G * bhMass / r) * (0.8 + u(rng) * 0.4);
+        Vec3 vel(-v * sin(angle), v * cos(angle), 0);
+        bodies.push_back(std::make_shared<Body>(pos, vel, Physics::SOLAR_MASS * (0.5 + u(rng) * 1.5),
+                                                Physics::SOLAR_RADIUS * (0.5 + u(rng))));
+    }
+    return bodies;
+}
+
+struct SolverRun {
+    double seconds = 0;
+    double error = 0;
+};
+
+static SolverRun runSolver(const std::vector<BodyPtr> &bodies, GravitySolver solver,
+                           const std::vector<size_t> &sample, const std::vector<Vec3> &reference,
+                           int fmmOrder = 4) {
+    PhysicsEngine engine;
+    engine.enableCollisions(false);
+    engine.setGravitySolver(solver);
+    engine.setOctreeTheta(0.5);
+    engine.setFmmOrder(fmmOrder);
+    engine.setFmmTheta(0.7);
+    for (auto &b: bodies) engine.add(b);
+
+    auto start = std::chrono::high_resolution_clock::now();
+    engine.computeForces();
+    auto end = std::chrono::high_resolution_clock::now();
+
+    SolverRun run;
+    run.seconds = std::chrono::duration<double>(end - start).count();
+    double err = 0, norm = 0;
+    for (size_t s = 0; s < sample.size(); s++) {
+        Vec3 a = engine.getForces()[sample[s]] / bodies[sample[s]]->mass;
+        err += (a - reference[s]).lengthSq();
+        norm += reference[s].lengthSq();
+    }
+    run.error = norm > 0 ? std::sqrt(err / norm) : 0;
+    return run;
+}
+
+static void benchmark(const std::string &name,
+                      const std::function<std::vector<BodyPtr>(size_t, std::mt19937 &)> &setup) {
+    std::cout << "\n--- " << name << " ---\n";
+    std::printf("%9s %11s %11s %11s %11s %10s %10s %10s\n", "N", "direct [s]", "tree [s]", "fmm4 [s]",
+                "fmm8 [s]", "tree err", "fmm4 err", "fmm8 err");
+
+    size_t crossover = 0, crossoverHigh = 0;
+    for (size_t n: {1000, 2000, 5000, 10000, 20000, 50000, 100000, 200000}) {
+        std::mt19937 rng(42);
+        auto bodies = setup(n, rng);
+
+        // Odniesienie: dokładna suma bezpośrednia dla próbki ciał
+        std::vector<size_t> sample;
+        for (size_t i = 0; i < bodies.size(); i += std::max<size_t>(1, bodies.size() / 256)) sample.push_back(i);
+        std::vector<Vec3> reference(sample.size());
+        for (size_t s = 0; s < sample.size(); s++) {
+            const auto &target = *bodies[sample[s]];
+            for (const auto &other: bodies) {
+                Vec3 r = other->pos - target.pos;
+                double d = r.length();
+                if (d < 1e-10) continue;
+                reference[s] += r * (Physics::G * other->mass / (d * d * d));
+            }
+        }
+
+        double direct = -1;
+        if (n <= 20000) direct = runSolver(bodies, GravitySolver::DIRECT, sample, reference).seconds;
+        SolverRun tree = runSolver(bodies, GravitySolver::LINEAR_OCTREE, sample, reference);
+        SolverRun fmm = runSolver(bodies, GravitySolver::FMM, sample, reference, 4);
+        SolverRun fmmHigh = runSolver(bodies, GravitySolver::FMM, sample, reference, 8);
+        // Próg opłacalności: od tego N FMM jest szybszy dla wszystkich większych N
+        if (fmm.seconds >= tree.seconds) crossover = 0;
+        else if (crossover == 0) crossover = n;
+        if (fmmHigh.seconds >= tree.seconds) crossoverHigh = 0;
+        else if (crossoverHigh == 0) crossoverHigh = n;
+
+        std::printf("%9zu %11s %11.4f %11.4f %11.4f %10.2e %10.2e %10.2e\n", n,
+                    direct < 0 ? "-" : std::to_string(direct).c_str(),
+                    tree.seconds, fmm.seconds, fmmHigh.seconds, tree.error, fmm.error, fmmHigh.error);
+    }
+
+    auto report = [](const char *label, size_t n) {
+        if (n) std::cout << label << " beats the tree from N = " << n << "\n";
+        else std::cout << label << " did not beat the tree in the tested range\n";
+    };
+    report("FMM order 4", crossover);
+    report("FMM order 8", crossoverHigh);
+}
+
+int main() {
+    std::cout << "\n=== FMM vs BARNES-HUT BENCHMARK ===\n";
+    std::cout << "Tree: linear octree, theta = 0.5 | FMM: order 4 and 8, theta = 0.7, leaf 64\n";
+    std::cout << "Errors: RMS relative acceleration error against direct summation\n";
+    std::cout << "Direct: tiled kernel, " << DirectGravity::isaName(DirectGravity::bestIsa()) << "\n";
+
+    benchmark("galaxy_collision", galaxyCollision);
+    benchmark("milky_way", milkyWay);
+    return 0;
+}
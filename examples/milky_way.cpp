@@ -23,6 +23,7 @@ int main() {
     }
 
     sim.useVerlet();
+    sim.enableOctree(0.5);
     sim.enableGlow();
     sim.setTimeStep(3600 * 24 * 365);
 
@@ -26,6 +26,7 @@ int main() {
 
     sim.physics->setIntegrator(IntegratorType::LEAPFROG);
     sim.enableCollisions();
+    sim.enableContinuousCollisions();
     sim.enableGlow();
     sim.enableBloom();
     sim.setTimeStep(3600.0);
@@ -1,6 +1,9 @@
 #include "PhySPP.h"
 #include <iostream>
 #include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <random>
 
 int main() {
     PhysicsEngine engine;
@@ -61,5 +64,832 @@ int main() {
     std::cout << "Expected velocity: " << v << " m/s\n";
     std::cout << "Error: " << std::abs(earth->vel.length() - v) / v * 100 << "%\n";
 
+    // Skalowanie silne: ten sam układ, rosnąca liczba wątków puli silnika
+    const size_t n = 8192;
+    const int steps = 3;
+    unsigned hardware = Parallel::defaultThreads();
+    std::cout << "\n=== STRONG SCALING ===\n";
+    std::cout << "Direct gravity + collision detection, N = " << n << ", " << steps << " steps per run, "
+            << hardware << " hardware threads\n";
+    std::printf("%8s %12s %9s %11s\n", "threads", "ms/step", "speedup", "efficiency");
+
+    double baseline = 0;
+    for (unsigned threads: {1, 2, 4, 8, 16, 32, 64}) {
+        PhysicsEngine cluster;
+        cluster.setThreads(threads);
+        cluster.setIntegrator(IntegratorType::LEAPFROG);
+
+        std::mt19937 rng(7);
+        std::uniform_real_distribution<double> u(-1.0, 1.0);
+        for (size_t i = 0; i < n; ++i) {
+            Vec3 p(u(rng), u(rng), u(rng));
+            cluster.add(std::make_shared<Body>(p * (10 * Physics::AU), Vec3(), Physics::EARTH_MASS, 6.371e6));
+        }
+        cluster.step(dt);
+
+        auto t0 = std::chrono::high_resolution_clock::now();
+        for (int s = 0; s < steps; ++s) cluster.step(dt);
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - t0).count()
+                    / steps;
+        if (threads == 1) baseline = ms;
+
+        std::printf("%8u %12.2f %8.2fx %10.0f%%%s\n", threads, ms, baseline / ms, 100.0 * baseline / ms / threads,
+                    threads > hardware ? "  (oversubscribed)" : "");
+    }
+
+    // Bloki czasowe: ciasna para planeta-księżyc wymusza krótki krok, pas planetoid nie.
+    // Wspólny krok musi rozwiązać orbitę księżyca dla wszystkich ciał, bloki tylko dla pary.
+    std::cout << "\n=== BLOCK TIMESTEPS ===\n";
+    std::cout << "Sun + planet-moon pair + 200 asteroids, 1 year\n";
+    std::printf("%-22s %12s %14s %10s %14s\n", "mode", "force evals", "evals/body/yr", "ms", "moon error");
+
+    auto system = [](PhysicsEngine &e) {
+        std::mt19937 rng(3);
+        std::uniform_real_distribution<double> u(0.0, 1.0);
+        e.enableCollisions(false);
+        e.add(std::make_shared<Body>(Vec3(0, 0, 0), Vec3(0, 0, 0), Physics::SOLAR_MASS, 6.96e8));
+
+        double mp = Physics::EARTH_MASS, mm = 7.35e22, d = 3.844e8;
+        Vec3 p(Physics::AU, 0, 0), vp(0, std::sqrt(Physics::G * Physics::SOLAR_MASS / Physics::AU), 0);
+        double vrel = std::sqrt(Physics::G * (mp + mm) / d);
+        e.add(std::make_shared<Body>(p - Vec3(d * mm / (mp + mm), 0, 0), vp - Vec3(0, vrel * mm / (mp + mm), 0),
+                                     mp, 6.371e6));
+        e.add(std::make_shared<Body>(p + Vec3(d * mp / (mp + mm), 0, 0), vp + Vec3(0, vrel * mp / (mp + mm), 0),
+                                     mm, 1.737e6));
+
+        for (int i = 0; i < 200; ++i) {
+            double a = (2.2 + u(rng)) * Physics::AU, phase = 2 * M_PI * u(rng);
+            double va = std::sqrt(Physics::G * Physics::SOLAR_MASS / a);
+            e.add(std::make_shared<Body>(Vec3(a * std::cos(phase), a * std::sin(phase), 0),
+                                         Vec3(-va * std::sin(phase), va * std::cos(phase), 0), 1e18, 1e4));
+        }
+    };
+
+    // Odniesienie: wspólny krok 30 min; błąd to odchylenie położenia księżyca względem planety
+    const double year = 365.25 * 86400;
+    auto moonOffset = [](PhysicsEngine &e) { return e.getBodies()[2]->pos - e.getBodies()[1]->pos; };
+    PhysicsEngine reference;
+    system(reference);
+    for (int s = 0; s < 365 * 48; ++s) reference.step(year / (365 * 48));
+    Vec3 moonRef = moonOffset(reference);
+
+    for (int mode = 0; mode < 4; ++mode) {
+        PhysicsEngine e;
+        system(e);
+        const char *name[] = {"shared, 1 day", "shared, 1 h", "block, eta = 0.01", "block, eta = 0.003"};
+        int yearSteps = mode == 1 ? 365 * 24 : 365;
+        if (mode >= 2) {
+            e.enableBlockTimesteps(true);
+            e.setBlockTimestepLevels(16);
+            e.setBlockAccuracy(mode == 2 ? 0.01 : 0.003);
+        }
+
+        auto t0 = std::chrono::high_resolution_clock::now();
+        for (int s = 0; s < yearSteps; ++s) e.step(year / yearSteps);
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - t0).count();
+
+        double error = (moonOffset(e) - moonRef).length() / moonRef.length();
+        size_t evals = e.getForceEvaluationCount();
+        std::printf("%-22s %12zu %14.0f %10.1f %14.2e\n", name[mode], evals, double(evals) / e.getBodies().size(), ms,
+                    error);
+    }
+
+    // Hermite 4. rzędu: jedno przejście po parach na krok (siła + jerk), krok z kryterium Aarsetha
+    std::cout << "\n=== HERMITE4 vs RK4 ===\n";
+    std::cout << "Eccentric binary (e = 0.5) + 30 test bodies, 5 orbits\n";
+    std::printf("%-24s %12s %12s\n", "integrator", "full passes", "energy err");
+
+    auto binary = [](PhysicsEngine &e) {
+        std::mt19937 rng(1);
+        std::uniform_real_distribution<double> u(0.0, 1.0);
+        e.enableCollisions(false);
+        double m = 2e30, a = 1.5e11, rp = a * 0.5;
+        double vp = std::sqrt(Physics::G * 2 * m * 1.5 / rp);
+        e.add(std::make_shared<Body>(Vec3(-rp / 2, 0, 0), Vec3(0, -vp / 2, 0), m, 7e8));
+        e.add(std::make_shared<Body>(Vec3(rp / 2, 0, 0), Vec3(0, vp / 2, 0), m, 7e8));
+        for (int i = 0; i < 30; ++i) {
+            double radius = a * (3 + 2 * u(rng)), phase = 2 * M_PI * u(rng);
+            double vc = std::sqrt(Physics::G * 2 * m / radius);
+            e.add(std::make_shared<Body>(Vec3(radius * std::cos(phase), radius * std::sin(phase), 0),
+                                         Vec3(-vc * std::sin(phase), vc * std::cos(phase), 0), 1e24, 5e6));
+        }
+    };
+
+    const double orbits = 5 * 2 * M_PI * std::sqrt(std::pow(1.5e11, 3) / (Physics::G * 4e30));
+    for (int mode = 0; mode < 4; ++mode) {
+        PhysicsEngine e;
+        binary(e);
+        double e0 = ConservationLaws::totalEnergy(e.getBodies());
+        const char *name[] = {"RK4, 1000 steps", "RK4, 2000 steps", "HERMITE4, 1000 steps", "HERMITE4, block steps"};
+        int steps = mode == 1 ? 2000 : 1000;
+        e.setIntegrator(mode < 2 ? IntegratorType::RK4 : IntegratorType::HERMITE4);
+        if (mode == 3) {
+            e.enableBlockTimesteps(true);
+            e.setBlockTimestepLevels(20);
+            steps = 50;
+        }
+
+        for (int s = 0; s < steps; ++s) e.step(orbits / steps);
+        double passes = double(e.getForceEvaluationCount()) / e.getBodies().size();
+        double error = std::abs(ConservationLaws::totalEnergy(e.getBodies()) / e0 - 1);
+        std::printf("%-24s %12.0f %12.2e\n", name[mode], passes, error);
+    }
+
+    // Regularyzacja KS: ciasna para (a = 0.01 AU, e = 0.7) w gromadzie 40 gwiazd. Krok 1 dzień
+    // jest dłuższy niż okres pary - bez regularyzacji para się rozpada, w KS jej orbita jest dokładna.
+    std::cout << "\n=== KS REGULARIZATION ===\n";
+    std::cout << "Tight binary (a = 0.01 AU, e = 0.7) in a 40-star cluster, 1 year\n";
+    std::printf("%-24s %10s %12s %10s\n", "mode", "a / a0", "energy err", "ms");
+
+    auto cluster = [](PhysicsEngine &e) {
+        std::mt19937 rng(4);
+        std::uniform_real_distribution<double> u(-1.0, 1.0);
+        e.enableCollisions(false);
+        double m = Physics::SOLAR_MASS, a = 0.01 * Physics::AU, rp = a * 0.3;
+        double vp = std::sqrt(Physics::G * 2 * m * 1.7 / rp);
+        Vec3 c(5 * Physics::AU, 0, 0), vc(0, 3e3, 0);
+        e.add(std::make_shared<Body>(c + Vec3(-rp / 2, 0, 0), vc + Vec3(0, -vp / 2, 0), m, 7e8));
+        e.add(std::make_shared<Body>(c + Vec3(rp / 2, 0, 0), vc + Vec3(0, vp / 2, 0), m, 7e8));
+        for (int i = 0; i < 40; ++i) {
+            e.add(std::make_shared<Body>(Vec3(u(rng), u(rng), u(rng)) * (100 * Physics::AU),
+                                         Vec3(u(rng), u(rng), u(rng)) * 2e3, m * (1 + 0.5 * u(rng)), 7e8));
+        }
+    };
+    auto semiMajor = [](PhysicsEngine &e) {
+        auto &b = e.getBodies();
+        double gm = Physics::G * (b[0]->mass + b[1]->mass);
+        double energy = 0.5 * (b[1]->vel - b[0]->vel).lengthSq() - gm / (b[1]->pos - b[0]->pos).length();
+        return -gm / (2 * energy) / (0.01 * Physics::AU);
+    };
+
+    for (int mode = 0; mode < 3; ++mode) {
+        PhysicsEngine e;
+        cluster(e);
+        double e0 = ConservationLaws::totalEnergy(e.getBodies());
+        const char *name[] = {"LEAPFROG, 1 day", "LEAPFROG, 1 day + KS", "HERMITE4, 1 day + KS"};
+        e.enableRegularization(mode > 0);
+        e.setIntegrator(mode == 2 ? IntegratorType::HERMITE4 : IntegratorType::LEAPFROG);
+
+        auto t0 = std::chrono::high_resolution_clock::now();
+        for (int s = 0; s < 365; ++s) e.step(86400);
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - t0).count();
+        double error = std::abs(ConservationLaws::totalEnergy(e.getBodies()) / e0 - 1);
+        std::printf("%-24s %10.6f %12.2e %10.1f\n", name[mode], semiMajor(e), error, ms);
+    }
+
+    // Wisdom-Holman: ruch keplerowski wokół Słońca rozwiązany dokładnie, więc krok może być
+    // ułamkiem okresu Merkurego zamiast ułamkiem jego obiegu rozwiązywanego przez integrator
+    std::cout << "\n=== WISDOM-HOLMAN ===\n";
+    std::cout << "Sun + 8 planets, 10 years; error of Earth's heliocentric position vs YOSHIDA4 at P/2000\n";
+    std::printf("%-26s %10s %12s %12s %10s\n", "integrator", "steps", "energy err", "earth [AU]", "ms");
+
+    auto planets = [](PhysicsEngine &e) {
+        e.enableCollisions(false);
+        e.add(std::make_shared<Body>(Vec3(0, 0, 0), Vec3(0, 0, 0), Physics::SOLAR_MASS, 6.96e8));
+        const double a[] = {0.387, 0.723, 1.0, 1.524, 5.203, 9.537, 19.19, 30.07};
+        const double m[] = {3.3e23, 4.87e24, 5.97e24, 6.42e23, 1.898e27, 5.68e26, 8.68e25, 1.02e26};
+        for (int i = 0; i < 8; ++i) {
+            double radius = a[i] * Physics::AU, phase = 0.7 * i;
+            double vc = std::sqrt(Physics::G * Physics::SOLAR_MASS / radius);
+            e.add(std::make_shared<Body>(Vec3(radius * std::cos(phase), radius * std::sin(phase), 0),
+                                         Vec3(-vc * std::sin(phase), vc * std::cos(phase), 0), m[i], 1e6));
+        }
+    };
+    auto earthOffset = [](PhysicsEngine &e) { return e.getBodies()[3]->pos - e.getBodies()[0]->pos; };
+
+    const double mercury = 0.2408 * year, span = 10 * year;
+    PhysicsEngine planetsRef;
+    planets(planetsRef);
+    planetsRef.setIntegrator(IntegratorType::YOSHIDA4);
+    long refSteps = std::lround(span / (mercury / 2000));
+    for (long s = 0; s < refSteps; ++s) planetsRef.step(span / refSteps);
+    Vec3 earthRef = earthOffset(planetsRef);
+
+    for (int mode = 0; mode < 5; ++mode) {
+        PhysicsEngine e;
+        planets(e);
+        const char *name[] = {"LEAPFROG, P/20", "LEAPFROG, P/400", "YOSHIDA4, P/20", "WISDOM_HOLMAN, P/20",
+                              "WISDOM_HOLMAN + C, P/20"};
+        const IntegratorType type[] = {IntegratorType::LEAPFROG, IntegratorType::LEAPFROG, IntegratorType::YOSHIDA4,
+                                       IntegratorType::WISDOM_HOLMAN, IntegratorType::WISDOM_HOLMAN};
+        e.setIntegrator(type[mode]);
+        e.enableWisdomHolmanCorrector(mode == 4);
+        long steps = std::lround(span / (mercury / (mode == 1 ? 400 : 20)));
+        double e0 = ConservationLaws::totalEnergy(e.getBodies());
+
+        auto t0 = std::chrono::high_resolution_clock::now();
+        for (long s = 0; s < steps; ++s) e.step(span / steps);
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - t0).count();
+        double error = std::abs(ConservationLaws::totalEnergy(e.getBodies()) / e0 - 1);
+        std::printf("%-26s %10ld %12.2e %12.2e %10.1f\n", name[mode], steps, error,
+                    (earthOffset(e) - earthRef).length() / Physics::AU, ms);
+    }
+
+    std::cout << "\n=== SYMPLECTIC COMPOSITIONS ===\n";
+    std::cout << "Sun + 8 planets, 10 years at P/50; error of Earth's position vs IAS15\n";
+    std::printf("%-26s %12s %12s %10s\n", "integrator", "force evals", "earth [AU]", "ms");
+
+    PhysicsEngine exact;
+    planets(exact);
+    exact.setIntegrator(IntegratorType::IAS15);
+    for (int s = 0; s < 10; ++s) exact.step(span / 10);
+    Vec3 earthExact = earthOffset(exact);
+
+    for (IntegratorType type: {IntegratorType::LEAPFROG, IntegratorType::YOSHIDA4, IntegratorType::YOSHIDA6,
+                               IntegratorType::YOSHIDA8}) {
+        PhysicsEngine e;
+        planets(e);
+        e.setIntegrator(type);
+        const char *name = type == IntegratorType::LEAPFROG   ? "LEAPFROG"
+                           : type == IntegratorType::YOSHIDA4 ? "YOSHIDA4"
+                           : type == IntegratorType::YOSHIDA6 ? "YOSHIDA6"
+                                                              : "YOSHIDA8";
+        long steps = std::lround(span / (mercury / 50));
+        size_t evaluations = e.getForceEvaluationCount();
+
+        auto t0 = std::chrono::high_resolution_clock::now();
+        for (long s = 0; s < steps; ++s) e.step(span / steps);
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - t0).count();
+        std::printf("%-26s %12zu %12.2e %10.1f\n", name, e.getForceEvaluationCount() - evaluations,
+                    (earthOffset(e) - earthExact).length() / Physics::AU, ms);
+    }
+
+    std::cout << "\n=== IAS15 ===\n";
+    std::cout << "Sun + 8 point-mass planets, 10 years\n";
+    std::printf("%-26s %12s %12s %12s %10s\n", "integrator", "energy err", "force evals", "iter/step", "ms");
+
+    for (int mode = 0; mode < 3; ++mode) {
+        PhysicsEngine e;
+        planets(e);
+        // Bez zmiękczenia od promieni - błąd energii to wtedy czysty błąd całkowania
+        for (auto &body: e.getBodies()) body->radius = 1;
+        const char *name[] = {"RK4, P/400", "IAS15, 1-day steps", "IAS15, 1-year steps"};
+        e.setIntegrator(mode == 0 ? IntegratorType::RK4 : IntegratorType::IAS15);
+        long steps = mode == 0 ? std::lround(span / (mercury / 400)) : mode == 1 ? 3652 : 10;
+        double e0 = ConservationLaws::totalEnergy(e.getBodies());
+        size_t evaluations = e.getForceEvaluationCount(), internal = 0, iterations = 0;
+
+        auto t0 = std::chrono::high_resolution_clock::now();
+        for (long s = 0; s < steps; ++s) {
+            e.step(span / steps);
+            internal += e.getIAS15Stats().steps;
+            iterations += e.getIAS15Stats().iterations;
+        }
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - t0).count();
+        double error = std::abs(ConservationLaws::totalEnergy(e.getBodies()) / e0 - 1);
+        std::printf("%-26s %12.2e %12zu %12.2f %10.1f\n", name[mode], error, e.getForceEvaluationCount() - evaluations,
+                    internal ? double(iterations) / internal : 0.0, ms);
+    }
+
+    std::cout << "\n=== HYBRID CLOSE ENCOUNTERS ===\n";
+    std::cout << "Sun + 200 planetesimals (0.7-1.5 AU), 2 years at P/40\n";
+    std::printf("%-26s %12s %10s %12s %10s\n", "integrator", "energy err", "groups", "BS substeps", "ms");
+
+    for (int mode = 0; mode < 2; ++mode) {
+        PhysicsEngine e;
+        e.enableCollisions(false);
+        e.add(std::make_shared<Body>(Vec3(0, 0, 0), Vec3(0, 0, 0), Physics::SOLAR_MASS, 6.96e8));
+        std::mt19937 rng(7);
+        std::uniform_real_distribution<double> unit(0, 1);
+        for (int i = 0; i < 200; ++i) {
+            double radius = (0.7 + 0.8 * unit(rng)) * Physics::AU, phase = 2 * M_PI * unit(rng);
+            double vc = std::sqrt(Physics::G * Physics::SOLAR_MASS / radius) * (1 + 0.01 * (unit(rng) - 0.5));
+            double z = radius * 0.002 * (unit(rng) - 0.5);
+            e.add(std::make_shared<Body>(Vec3(radius * std::cos(phase), radius * std::sin(phase), z),
+                                         Vec3(-vc * std::sin(phase), vc * std::cos(phase), 0), 3e23, 3e6));
+        }
+        e.setIntegrator(IntegratorType::WISDOM_HOLMAN);
+        e.enableHybridEncounters(mode == 1);
+        long steps = 80;
+        double e0 = ConservationLaws::totalEnergy(e.getBodies());
+        size_t groups = 0, substeps = 0;
+
+        auto t0 = std::chrono::high_resolution_clock::now();
+        for (long s = 0; s < steps; ++s) {
+            e.step(2 * year / steps);
+            groups = std::max(groups, e.getEncounterStats().groups);
+            substeps += e.getEncounterStats().substeps;
+        }
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - t0).count();
+        double error = std::abs(ConservationLaws::totalEnergy(e.getBodies()) / e0 - 1);
+        std::printf("%-26s %12.2e %10zu %12zu %10.1f\n", mode ? "WISDOM_HOLMAN + hybrid" : "WISDOM_HOLMAN", error,
+                    groups, substeps, ms);
+    }
+
+    std::cout << "\n=== COLLISION BROADPHASE ===\n";
+    std::cout << "Spheres in a 100^3 box, radii 0.01-1 with 1% of 5-15, 20 steps\n";
+    std::printf("%8s %10s %12s %10s %14s %14s\n", "bodies", "contacts", "candidates", "rebuilds", "hash ms", "pair loop ms");
+
+    for (size_t n: {2000, 10000}) {
+        std::mt19937 rng(11);
+        std::uniform_real_distribution<double> unit(0, 1);
+        std::vector<double> x(n), y(n), z(n), radius(n), vx(n), vy(n), vz(n), margins(n);
+        std::vector<uint8_t> alive(n, 1);
+        for (size_t i = 0; i < n; ++i) {
+            x[i] = 100 * unit(rng);
+            y[i] = 100 * unit(rng);
+            z[i] = 100 * unit(rng);
+            radius[i] = unit(rng) < 0.01 ? 5 + 10 * unit(rng) : std::pow(10, -2 + 2 * unit(rng));
+            vx[i] = unit(rng) - 0.5;
+            vy[i] = unit(rng) - 0.5;
+            vz[i] = unit(rng) - 0.5;
+        }
+        SpatialHash::Spheres spheres{x.data(), y.data(), z.data(), radius.data(), alive.data(), n};
+        SpatialHash::Broadphase broadphase;
+        size_t contacts = 0, reference = 0;
+        double hashMs = 0, pairMs = 0, dt = 0.05;
+
+        for (int s = 0; s < 20; ++s) {
+            for (size_t i = 0; i < n; ++i) {
+                x[i] += vx[i] * dt;
+                y[i] += vy[i] * dt;
+                z[i] += vz[i] * dt;
+            }
+            auto t0 = std::chrono::high_resolution_clock::now();
+            std::vector<std::pair<size_t, size_t> > found;
+            if (!broadphase.valid(spheres)) {
+                for (size_t i = 0; i < n; ++i) {
+                    margins[i] = 0.5 * radius[i] + 2 * std::sqrt(vx[i] * vx[i] + vy[i] * vy[i] + vz[i] * vz[i]) * dt;
+                }
+                broadphase.rebuild(spheres, margins.data(), [](size_t total, auto &&fn) { fn(0, total); });
+            }
+            broadphase.overlaps(spheres, found);
+            auto t1 = std::chrono::high_resolution_clock::now();
+            for (size_t i = 0; i < n; ++i) {
+                for (size_t j = i + 1; j < n; ++j) {
+                    double dx = x[i] - x[j], dy = y[i] - y[j], dz = z[i] - z[j], sum = radius[i] + radius[j];
+                    reference += dx * dx + dy * dy + dz * dz < sum * sum;
+                }
+            }
+            auto t2 = std::chrono::high_resolution_clock::now();
+            contacts += found.size();
+            hashMs += std::chrono::duration<double, std::milli>(t1 - t0).count();
+            pairMs += std::chrono::duration<double, std::milli>(t2 - t1).count();
+        }
+        std::printf("%8zu %10zu %12zu %10zu %14.1f %14.1f%s\n", n, contacts, broadphase.candidates(),
+                    broadphase.rebuildCount(), hashMs, pairMs, contacts == reference ? "" : "  MISMATCH");
+    }
+
+    std::cout << "\n=== TREE COLLISIONS ===\n";
+    std::cout << "LINEAR_OCTREE gravity, 20000 bodies in a 10 km box, 10 leapfrog steps\n";
+    std::printf("%-26s %12s %10s %10s\n", "collision source", "tree checks", "rebuilds", "ms");
+
+    for (int mode = 0; mode < 3; ++mode) {
+        PhysicsEngine e;
+        e.setGravitySolver(GravitySolver::LINEAR_OCTREE);
+        e.setIntegrator(IntegratorType::LEAPFROG);
+        e.enableCollisions(mode > 0);
+        e.enableTreeCollisions(mode == 2);
+        std::mt19937 rng(13);
+        std::uniform_real_distribution<double> unit(0, 1);
+        for (int i = 0; i < 20000; ++i) {
+            Vec3 pos(1e4 * unit(rng), 1e4 * unit(rng), 1e4 * unit(rng));
+            Vec3 vel(unit(rng) - 0.5, unit(rng) - 0.5, unit(rng) - 0.5);
+            e.add(std::make_shared<Body>(pos, vel * 20, 1e10, i % 100 ? 2 + 8 * unit(rng) : 100));
+        }
+
+        auto t0 = std::chrono::high_resolution_clock::now();
+        for (int s = 0; s < 10; ++s) e.step(1.0);
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - t0).count();
+        const char *name[] = {"collisions off", "spatial hash", "gravity tree"};
+        std::printf("%-26s %12zu %10zu %10.1f\n", name[mode], e.getTreeCollisionCheckCount(), e.getCollisionRebuildCount(), ms);
+    }
+
+    std::cout << "\n=== CONTINUOUS COLLISIONS ===\n";
+    std::cout << "400 projectiles at 1 km/s through 400 targets (radius 1 m), 1 s\n";
+    std::printf("%-26s %10s %12s %10s\n", "mode", "steps", "hit bodies", "swept");
+
+    for (int mode = 0; mode < 3; ++mode) {
+        PhysicsEngine e;
+        e.enableContinuousCollisions(mode == 2);
+        std::mt19937 rng(17);
+        std::uniform_real_distribution<double> unit(0, 1);
+        for (int i = 0; i < 400; ++i) {
+            e.add(std::make_shared<Body>(Vec3(200 * unit(rng), 30 * unit(rng), 30 * unit(rng)), Vec3(0, 0, 0), 1.0, 1.0));
+            e.add(std::make_shared<Body>(Vec3(-500 - 200 * unit(rng), 30 * unit(rng), 30 * unit(rng)),
+                                         Vec3(1000, 0, 0), 1.0, 1.0));
+        }
+        // Krok 1 ms przesuwa pocisk o połowę średnicy; 10 ms - o pięć średnic
+        long steps = mode == 0 ? 1000 : 100;
+        for (long s = 0; s < steps; ++s) e.step(1.0 / steps);
+        size_t hit = 0;
+        for (auto &body: e.getBodies()) hit += body->lastCollisionType != Body::CollisionType::NONE;
+        const char *name[] = {"discrete, dt = 1 ms", "discrete, dt = 10 ms", "swept, dt = 10 ms"};
+        std::printf("%-26s %10ld %12zu %10zu\n", name[mode], steps, hit, e.getSweptCollisionCount());
+    }
+
+    std::cout << "\n=== COLLISION PIPELINE ===\n";
+    std::cout << "124 colliding pairs from bounces to annihilation, 3 steps\n";
+    std::printf("%8s %10s %20s\n", "threads", "bodies", "checksum");
+
+    for (unsigned threads: {1u, 2u, 4u, 8u}) {
+        PhysicsEngine e;
+        e.setThreads(threads);
+        std::mt19937 rng(19);
+        std::uniform_real_distribution<double> unit(0, 1);
+        for (int p = 0; p < 124; ++p) {
+            Vec3 center(p * 1e9, 0, 0);
+            double speed = std::pow(10, 1 + 5 * unit(rng));
+            e.add(std::make_shared<Body>(center, Vec3(speed, 0, 0), 1e24, 1e7));
+            e.add(std::make_shared<Body>(center + Vec3(1.5e7, 1e6 * unit(rng), 0), Vec3(-speed, 0, 0), 1e24, 1e7));
+        }
+        for (int s = 0; s < 3; ++s) e.step(10);
+        // Suma bitów stanu: przy dowolnej liczbie wątków ta sama
+        uint64_t checksum = 0;
+        for (auto &body: e.getBodies()) {
+            if (body->destroyed) continue;
+            for (double value: {body->pos.x, body->pos.y, body->pos.z, body->vel.x, body->vel.y, body->vel.z, body->mass}) {
+                uint64_t bits;
+                std::memcpy(&bits, &value, sizeof bits);
+                checksum = checksum * 31 + bits;
+            }
+        }
+        std::printf("%8u %10zu %20llx\n", threads, e.getBodyCount(), (unsigned long long) checksum);
+    }
+
+    std::cout << "\n=== BODY POOL ===\n";
+    std::cout << "Merging cloud (400 bodies) and deterministic mode (bodies updated in place)\n";
+    std::printf("%-16s %6s %8s %10s %10s %8s %10s\n", "scenario", "step", "bodies", "created", "recycled", "heap",
+                "scratch B");
+
+    for (int mode = 0; mode < 2; ++mode) {
+        PhysicsEngine e;
+        std::mt19937 rng(23);
+        std::uniform_real_distribution<double> unit(0, 1);
+        for (int i = 0; i < 400; ++i) {
+            Vec3 pos(unit(rng), unit(rng), unit(rng)), vel(unit(rng) - 0.5, unit(rng) - 0.5, unit(rng) - 0.5);
+            e.add(std::make_shared<Body>(pos * 1e9, vel * 3e3, 1e15, mode ? 1e5 : 2e7));
+        }
+        e.enableDeterministicPhysics(mode == 1);
+        for (int s = 0; s < 5; ++s) {
+            e.step(2000);
+            const auto &stats = e.getAllocationStats();
+            std::printf("%-16s %6d %8zu %10zu %10zu %8zu %10zu\n", mode ? "deterministic" : "merging cloud", s,
+                        e.getBodyCount(), stats.bodies, stats.recycled, stats.heap, stats.scratch);
+        }
+    }
+
+    std::cout << "\n=== BODY HANDLES ===\n";
+    std::cout << "Merging cloud (3000 bodies, 20 steps): dead bodies kept as tombstones up to the threshold\n";
+    std::printf("%-14s %10s %8s %12s %10s %12s\n", "mode", "threshold", "bodies", "compactions", "ms/step", "handle ok");
+
+    for (int mode = 0; mode < 4; ++mode) {
+        // Tryb deterministyczny też aktualizuje ciała w miejscu zamiast budować je co krok od nowa
+        const double thresholds[] = {0.0, 0.125, 0.5, 0.125};
+        double threshold = thresholds[mode];
+        PhysicsEngine e;
+        e.setGravitySolver(GravitySolver::LINEAR_OCTREE);
+        e.setCompactionThreshold(threshold);
+        std::mt19937 rng(29);
+        std::uniform_real_distribution<double> unit(0, 1);
+        // Użytkownik trzyma swoje ciała - uchwyt i wskaźnik mają wskazywać ten sam obiekt
+        std::vector<std::pair<BodyHandle, BodyPtr> > tracked;
+        for (int i = 0; i < 3000; ++i) {
+            Vec3 pos(unit(rng), unit(rng), unit(rng)), vel(unit(rng) - 0.5, unit(rng) - 0.5, unit(rng) - 0.5);
+            auto body = std::make_shared<Body>(pos * 1e9, vel * 3e3, 1e15, 1e7);
+            tracked.push_back({e.add(body), body});
+        }
+        e.enableDeterministicPhysics(mode == 3);
+        auto start = std::chrono::high_resolution_clock::now();
+        for (int s = 0; s < 20; ++s) e.step(2000);
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+        // Uchwyt wskazuje swoje ciało albo nic, gdy zostało zniszczone
+        size_t ok = 0;
+        for (auto &[handle, body]: tracked) {
+            auto found = e.findBody(handle);
+            ok += found ? found == body : body->destroyed;
+        }
+        std::printf("%-14s %10.3f %8zu %12zu %10.2f %7zu/%zu\n", mode == 3 ? "deterministic" : "engine", threshold,
+                    e.getBodyCount(), e.getCompactionCount(), ms / 20, ok, tracked.size());
+    }
+
+    std::cout << "\n=== DIAGNOSTICS ===\n";
+    std::cout << "Energy after a step, 8000 bodies: pair loop vs cached diagnostics (potential source in brackets)\n";
+    std::printf("%-22s %10s %12s %12s %12s\n", "solver", "pairs [ms]", "first [ms]", "cached [ms]", "rel. diff");
+
+    for (int mode = 0; mode < 3; ++mode) {
+        PhysicsEngine e;
+        e.enableCollisions(false);
+        if (mode == 1) e.setIntegrator(IntegratorType::RK4);
+        if (mode == 2) e.setGravitySolver(GravitySolver::LINEAR_OCTREE);
+        std::mt19937 rng(31);
+        std::uniform_real_distribution<double> unit(-1, 1);
+        for (int i = 0; i < 8000; ++i) {
+            e.add(std::make_shared<Body>(Vec3(unit(rng), unit(rng), unit(rng)) * 1e11,
+                                         Vec3(unit(rng), unit(rng), unit(rng)) * 1e3, 1e24, 1e3));
+        }
+        e.finalize();
+        e.step(100);
+
+        auto t0 = std::chrono::high_resolution_clock::now();
+        double pairs = ConservationLaws::totalEnergy(e.getBodies());
+        auto t1 = std::chrono::high_resolution_clock::now();
+        const Diagnostics &d = e.getDiagnostics();
+        auto t2 = std::chrono::high_resolution_clock::now();
+        double cached = e.totalEnergy();
+        auto t3 = std::chrono::high_resolution_clock::now();
+        auto ms = [](auto a, auto b) { return std::chrono::duration<double, std::milli>(b - a).count(); };
+        const char *source = d.potentialSource == PotentialSource::FORCE_PASS ? "force pass"
+                             : d.potentialSource == PotentialSource::TREE ? "tree" : "direct";
+        char name[32];
+        std::snprintf(name, sizeof(name), "%s (%s)", mode == 2 ? "tree" : mode == 1 ? "RK4" : "Verlet", source);
+        std::printf("%-22s %10.1f %12.3f %12.5f %12.2e\n", name, ms(t0, t1), ms(t1, t2), ms(t2, t3),
+                    std::abs(cached - pairs) / std::abs(pairs));
+    }
+
+    {
+        // stepFast też unieważnia diagnostykę: energia po kolejnych krokach musi się zmieniać
+        PhysicsEngine e;
+        e.enableCollisions(false);
+        std::mt19937 rng(33);
+        std::uniform_real_distribution<double> unit(-1, 1);
+        for (int i = 0; i < 200; ++i) {
+            e.add(std::make_shared<Body>(Vec3(unit(rng), unit(rng), unit(rng)) * 1e10,
+                                         Vec3(unit(rng), unit(rng), unit(rng)) * 1e3, 1e26, 1e3));
+        }
+        e.finalize();
+        double energy[3];
+        for (double &value: energy) {
+            e.stepFast(1e4);
+            value = e.totalEnergy();
+        }
+        double reference = ConservationLaws::totalEnergy(e.getBodies());
+        bool fresh = energy[0] != energy[1] && energy[1] != energy[2] &&
+                     std::abs(energy[2] - reference) <= 1e-9 * std::abs(reference);
+        std::printf("stepFast invalidates diagnostics: %s\n", fresh ? "yes" : "NO");
+    }
+
+    std::cout << "\n=== MIXED PRECISION ===\n";
+    std::cout << "Direct kernel, 16000 bodies: double vs float on tile-relative coordinates\n";
+    std::printf("%-14s %12s %12s %10s %14s %14s %14s\n", "distribution", "double [ms]", "mixed [ms]", "speedup",
+                "median error", "99% error", "max error");
+
+    for (int layout = 0; layout < 3; ++layout) {
+        const size_t n = 16000;
+        std::mt19937 rng(37);
+        std::uniform_real_distribution<double> unit(-1, 1);
+        std::normal_distribution<double> normal(0, 1);
+        AlignedVector<double> x(n), y(n), z(n), m(n), r(n);
+        for (size_t i = 0; i < n; ++i) {
+            Vec3 p(unit(rng), unit(rng), unit(rng));
+            if (layout == 0) p = p * 1e11;
+            // Gromady 1e9 m, 1e13 m od początku układu: tu absolutne współrzędne float zawodzą
+            Vec3 g(normal(rng), normal(rng), normal(rng));
+            if (layout == 1) p = Vec3(1e13 + 4e12 * double(i % 4), 1e13, 0) + g * 1e9;
+            if (layout == 2) p = g * (i % 10 ? 1e9 : 1e12);
+            x[i] = p.x;
+            y[i] = p.y;
+            z[i] = p.z;
+            m[i] = 1e22 * (1 + 99 * (unit(rng) + 1) / 2);
+            r[i] = 1e5;
+        }
+
+        DirectGravity::Sources sources{x.data(), y.data(), z.data(), m.data(), r.data(), n};
+        DirectGravity::Targets targets{x.data(), y.data(), z.data(), r.data()};
+        AlignedVector<double> dx(n), dy(n), dz(n), fx(n), fy(n), fz(n);
+        DirectGravity::MixedSources mixed;
+
+        auto t0 = std::chrono::high_resolution_clock::now();
+        DirectGravity::field(sources, dx.data(), dy.data(), dz.data(), 0, n);
+        auto t1 = std::chrono::high_resolution_clock::now();
+        DirectGravity::prepareMixed(sources, mixed);
+        DirectGravity::fieldMixed(mixed, targets, fx.data(), fy.data(), fz.data(), 0, n);
+        auto t2 = std::chrono::high_resolution_clock::now();
+
+        std::vector<double> error(n);
+        for (size_t i = 0; i < n; ++i) {
+            double ex = fx[i] - dx[i], ey = fy[i] - dy[i], ez = fz[i] - dz[i];
+            error[i] = std::sqrt((ex * ex + ey * ey + ez * ez) / (dx[i] * dx[i] + dy[i] * dy[i] + dz[i] * dz[i]));
+        }
+        std::sort(error.begin(), error.end());
+        double doubleMs = std::chrono::duration<double, std::milli>(t1 - t0).count();
+        double mixedMs = std::chrono::duration<double, std::milli>(t2 - t1).count();
+        const char *name = layout == 0 ? "uniform" : layout == 1 ? "offset groups" : "hierarchical";
+        std::printf("%-14s %12.1f %12.1f %9.2fx %14.2e %14.2e %14.2e\n", name, doubleMs, mixedMs,
+                    doubleMs / mixedMs, error[n / 2], error[n * 99 / 100], error.back());
+    }
+
+    std::cout << "\n=== REPRODUCIBLE MODE ===\n";
+    std::cout << "3000 bodies + 60 colliding pairs, 3 steps: checksums on 1/2/4/8 threads, best of 3 times on 8 threads\n";
+    std::printf("%-14s %12s %12s %10s %10s %10s\n", "solver", "fast", "reproducible", "fast [ms]", "repr. [ms]",
+                "overhead");
+
+    for (int solver = 0; solver < 5; ++solver) {
+        auto run = [&](unsigned threads, bool reproducible, double *ms) {
+            PhysicsEngine e;
+            e.setThreads(threads);
+            e.enableReproducible(reproducible);
+            e.setRandomSeed(41);
+            if (solver == 1) e.setDirectKernelLimit(0);
+            if (solver == 2) e.setGravitySolver(GravitySolver::LINEAR_OCTREE);
+            if (solver == 3) e.setGravitySolver(GravitySolver::FMM);
+            std::mt19937 rng(43);
+            std::uniform_real_distribution<double> unit(-1, 1);
+            for (int i = 0; i < 3000; ++i) {
+                e.add(std::make_shared<Body>(Vec3(unit(rng), unit(rng), unit(rng)) * 1e11,
+                                             Vec3(unit(rng), unit(rng), unit(rng)) * 1e3, 1e24, 1e3));
+            }
+            for (int p = 0; p < 60; ++p) {
+                Vec3 center(3e11 + p * 1e9, 0, 0);
+                double speed = std::pow(10, 1 + 5 * (unit(rng) + 1) / 2);
+                e.add(std::make_shared<Body>(center, Vec3(speed, 0, 0), 1e24, 1e7));
+                e.add(std::make_shared<Body>(center + Vec3(1.5e7, 1e6 * unit(rng), 0), Vec3(-speed, 0, 0), 1e24, 1e7));
+            }
+            if (solver == 4) e.enableDeterministicPhysics(true);
+            e.finalize();
+            auto t0 = std::chrono::high_resolution_clock::now();
+            for (int s = 0; s < 3; ++s) e.step(10);
+            auto t1 = std::chrono::high_resolution_clock::now();
+            if (ms) *ms = std::chrono::duration<double, std::milli>(t1 - t0).count();
+            uint64_t checksum = 0;
+            for (auto &body: e.getBodies()) {
+                if (body->destroyed) continue;
+                for (double value: {body->pos.x, body->pos.y, body->pos.z, body->vel.x, body->vel.y, body->vel.z, body->mass}) {
+                    uint64_t bits;
+                    std::memcpy(&bits, &value, sizeof bits);
+                    checksum = checksum * 31 + bits;
+                }
+            }
+            return checksum;
+        };
+
+        bool same[2] = {true, true};
+        for (int reproducible = 0; reproducible < 2; ++reproducible) {
+            uint64_t first = run(1, reproducible, nullptr);
+            for (unsigned threads: {2u, 4u, 8u}) same[reproducible] &= run(threads, reproducible, nullptr) == first;
+        }
+        // Najlepszy z trzech przebiegów na przemian - pojedynczy pomiar ginie w szumie
+        double fastMs = 1e300, reproducibleMs = 1e300;
+        for (int k = 0; k < 3; ++k) {
+            double ms = 0;
+            run(8, false, &ms);
+            fastMs = std::min(fastMs, ms);
+            run(8, true, &ms);
+            reproducibleMs = std::min(reproducibleMs, ms);
+        }
+        const char *name[] = {"direct kernel", "pair loop", "linear octree", "fmm", "deterministic"};
+        std::printf("%-14s %12s %12s %10.1f %10.1f %9.1f%%\n", name[solver], same[0] ? "identical" : "differs",
+                    same[1] ? "identical" : "differs", fastMs, reproducibleMs, 100 * (reproducibleMs / fastMs - 1));
+    }
+
+    std::cout << "\n=== FORCE PASSES ===\n";
+    std::cout << "VERLET, 4000 bodies, linear octree, 20 steps: closing accelerations reused by the next step\n";
+    std::printf("%-24s %16s %12s\n", "case", "passes / step", "ms / step");
+
+    for (int mode = 0; mode < 3; ++mode) {
+        PhysicsEngine e;
+        e.setGravitySolver(GravitySolver::LINEAR_OCTREE);
+        e.enableCollisions(mode == 1);
+        // Siły zależne od prędkości: przyspieszeń z końca kroku nie da się przenieść
+        e.enableRelativistic(mode == 2);
+        std::mt19937 rng(53);
+        std::uniform_real_distribution<double> unit(-1, 1);
+        for (int i = 0; i < 4000; ++i) {
+            e.add(std::make_shared<Body>(Vec3(unit(rng), unit(rng), unit(rng)) * 1e11,
+                                         Vec3(unit(rng), unit(rng), unit(rng)) * 1e4, mode == 1 ? 1e15 : 1e24,
+                                         mode == 1 ? 2e9 : 1e3));
+        }
+        e.finalize();
+        e.step(100);
+        size_t before = e.getForceEvaluationCount();
+        auto t0 = std::chrono::high_resolution_clock::now();
+        for (int s = 0; s < 20; ++s) e.step(100);
+        auto t1 = std::chrono::high_resolution_clock::now();
+        double passes = double(e.getForceEvaluationCount() - before) / (20.0 * double(e.getBodyCount()));
+        const char *name[] = {"gravity only", "with collisions", "post-Newtonian"};
+        std::printf("%-24s %16.2f %12.1f\n", name[mode], passes,
+                    std::chrono::duration<double, std::milli>(t1 - t0).count() / 20);
+    }
+
+    std::cout << "\n=== POST-NEWTONIAN CONVERGENCE ===\n";
+    std::cout << "Sun + Earth with PN corrections, 1 year: position error against 16x finer steps\n";
+    std::printf("%-10s %14s %14s %8s\n", "integrator", "err 365 [AU]", "err 730 [AU]", "order");
+
+    for (auto integrator: {IntegratorType::VERLET, IntegratorType::RK4, IntegratorType::YOSHIDA4}) {
+        const double AU = 1.495978707e11, YEAR = 365.25 * 86400, SUN = 1.989e30;
+        auto earth = [&](int steps) {
+            PhysicsEngine e;
+            e.setIntegrator(integrator);
+            e.enableRelativistic(true);
+            e.add(std::make_shared<Body>(Vec3(), Vec3(), SUN, 7e8));
+            e.add(std::make_shared<Body>(Vec3(AU, 0, 0), Vec3(0, std::sqrt(Physics::G * SUN / AU), 0), 5.97e24, 6.4e6));
+            for (int s = 0; s < steps; ++s) e.step(YEAR / steps);
+            const auto &bodies = e.getBodies();
+            return bodies[1]->pos - bodies[0]->pos;
+        };
+        Vec3 reference = earth(16 * 730);
+        double coarse = (earth(365) - reference).length() / AU, fine = (earth(730) - reference).length() / AU;
+        const char *name = integrator == IntegratorType::VERLET ? "VERLET" : integrator == IntegratorType::RK4 ? "RK4" : "YOSHIDA4";
+        std::printf("%-10s %14.3e %14.3e %8.2f\n", name, coarse, fine, std::log2(coarse / fine));
+    }
+
+    std::cout << "\n=== TIDAL FORCES ===\n";
+    std::cout << "500 bodies with tidal forces: max relative difference of total force between gravity paths\n";
+    {
+        auto forces = [](int path) {
+            PhysicsEngine e;
+            // 0 - jądro, 1 - pętla par, 2 - drzewo; 3 i 4 - drzewo i jądro bez pływów
+            e.enableTidalForces(path < 3);
+            if (path == 1) e.setDirectKernelLimit(0);
+            if (path == 2 || path == 3) e.setGravitySolver(GravitySolver::OCTREE);
+            std::mt19937 rng(47);
+            std::uniform_real_distribution<double> unit(-1, 1);
+            for (int i = 0; i < 500; ++i) {
+                // Lekkie ciała: pływy (bez czynnika masy celu) porównywalne z grawitacją
+                e.add(std::make_shared<Body>(Vec3(unit(rng), unit(rng), unit(rng)) * 10.0, Vec3(), 1.0, 1.0));
+            }
+            e.finalize();
+            e.computeForces();
+            return e.getForces();
+        };
+        auto difference = [](const std::vector<Vec3> &a, const std::vector<Vec3> &b) {
+            double worst = 0;
+            for (size_t i = 0; i < a.size(); ++i) worst = std::max(worst, (a[i] - b[i]).length() / b[i].length());
+            return worst;
+        };
+        auto kernel = forces(0), pairs = forces(1);
+        std::printf("%-28s %12.2e\n", "kernel vs pair loop", difference(kernel, pairs));
+
+        // Część pływowa (siła z pływami - bez) nie może zależeć od solvera grawitacji
+        auto tree = forces(2), treeGravity = forces(3), gravity = forces(4);
+        std::vector<Vec3> treeTidal(tree.size()), directTidal(tree.size());
+        for (size_t i = 0; i < tree.size(); ++i) {
+            treeTidal[i] = tree[i] - treeGravity[i];
+            directTidal[i] = kernel[i] - gravity[i];
+        }
+        std::printf("%-28s %12.2e\n", "tidal part, octree vs direct", difference(treeTidal, directTidal));
+    }
+
+    std::cout << "\n=== STATIC SOURCES ===\n";
+    std::cout << "500 bodies, every 10th STATIC | NO_INTEGRATION: static bodies pull but collect no force\n";
+    {
+        auto forces = [](bool pairLoop) {
+            PhysicsEngine e;
+            if (pairLoop) e.setDirectKernelLimit(0);
+            std::mt19937 rng(59);
+            std::uniform_real_distribution<double> unit(-1, 1);
+            for (int i = 0; i < 500; ++i) {
+                auto body = std::make_shared<Body>(Vec3(unit(rng), unit(rng), unit(rng)) * 1e11, Vec3(), 1e24, 1e3);
+                if (i % 10 == 0) body->flags = 1 | 2;
+                e.add(body);
+            }
+            e.finalize();
+            e.computeForces();
+            return e.getForces();
+        };
+        auto kernel = forces(false), pairs = forces(true);
+        double worst = 0, onStatic = 0;
+        for (size_t i = 0; i < kernel.size(); ++i) {
+            if (i % 10 == 0) onStatic = std::max({onStatic, kernel[i].length(), pairs[i].length()});
+            else worst = std::max(worst, (kernel[i] - pairs[i]).length() / kernel[i].length());
+        }
+        std::printf("%-28s %12.2e\n", "kernel vs pair loop", worst);
+        std::printf("%-28s %12.2e\n", "force on static bodies", onStatic);
+
+        // Nieruchome Słońce: Ziemia po roku na orbicie w obu ścieżkach
+        for (bool pairLoop: {false, true}) {
+            PhysicsEngine e;
+            if (pairLoop) e.setDirectKernelLimit(0);
+            auto sun = std::make_shared<Body>(Vec3(), Vec3(), Physics::SOLAR_MASS, 6.96e8);
+            sun->flags = 1 | 2;
+            e.add(sun);
+            double v = std::sqrt(Physics::G * Physics::SOLAR_MASS / Physics::AU);
+            auto earth = std::make_shared<Body>(Vec3(Physics::AU, 0, 0), Vec3(0, v, 0), Physics::EARTH_MASS, 6.371e6);
+            e.add(earth);
+            for (int s = 0; s < 365; ++s) e.step(86400);
+            std::printf("%-28s %12.6f AU\n", pairLoop ? "static Sun, pair loop" : "static Sun, kernel",
+                        earth->pos.length() / Physics::AU);
+        }
+    }
+
+    std::cout << "\n=== SOLVER SOFTENING ===\n";
+    std::cout << "400 bodies + 50 close pairs (gap 1/100 of radius): max relative deviation from DIRECT\n";
+    {
+        auto forces = [](GravitySolver solver) {
+            PhysicsEngine e;
+            e.setGravitySolver(solver);
+            std::mt19937 rng(61);
+            std::uniform_real_distribution<double> unit(-1, 1);
+            for (int i = 0; i < 400; ++i) {
+                Vec3 pos = Vec3(unit(rng), unit(rng), unit(rng)) * 1e11;
+                e.add(std::make_shared<Body>(pos, Vec3(), 1e24, 1e7));
+                if (i % 8 == 0) e.add(std::make_shared<Body>(pos + Vec3(1e5, 0, 0), Vec3(), 1e24, 1e7));
+            }
+            e.finalize();
+            e.computeForces();
+            return e.getForces();
+        };
+        auto direct = forces(GravitySolver::DIRECT);
+        for (auto [name, solver]: {std::pair{"OCTREE", GravitySolver::OCTREE},
+                                   std::pair{"LINEAR_OCTREE", GravitySolver::LINEAR_OCTREE},
+                                   std::pair{"FMM", GravitySolver::FMM}}) {
+            auto tree = forces(solver);
+            double worst = 0;
+            for (size_t i = 0; i < direct.size(); ++i)
+                worst = std::max(worst, (tree[i] - direct[i]).length() / direct[i].length());
+            std::printf("%-28s %12.2e\n", name, worst);
+        }
+    }
+
     return 0;
 }
@@ -70,7 +70,7 @@ int main() {
         comet->maxVelocityForColor = 5e4;
     }
 
-    sim.physics->setIntegrator(IntegratorType::LEAPFROG);
+    sim.physics->setIntegrator(IntegratorType::WISDOM_HOLMAN);
     sim.physics->enableAdaptiveTimestep(false);
     sim.physics->enableSleeping(false);
     sim.enableCollisions();
@@ -78,8 +78,8 @@ int main() {
     sim.setTimeStep(3600 * 6);
 
     std::cout << "\n=== REALISTIC SOLAR SYSTEM ===\n";
-    std::cout << "Bodies: " << sim.physics->getBodies().size() << "\n";
-    std::cout << "Integrator: Leapfrog (symplectic)\n";
+    std::cout << "Bodies: " << sim.physics->getBodyCount() << "\n";
+    std::cout << "Integrator: Wisdom-Holman (symplectic)\n";
     std::cout << "Labels: Enabled\n";
     std::cout << "Effects: Glow, Velocity colors\n\n";
     std::cout << "Controls:\n";
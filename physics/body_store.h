@@ -0,0 +1,365 @@
+#pragma once
+#include "body.h"
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <vector>
+
+// Alokator wyrównany do linii cache - tablice stanu nadają się do wektorowych load/store
+template<typename T, size_t Align = 64>
+struct AlignedAllocator {
+    using value_type = T;
+
+    template<typename U>
+    struct rebind {
+        using other = AlignedAllocator<U, Align>;
+    };
+
+    AlignedAllocator() = default;
+
+    template<typename U>
+    AlignedAllocator(const AlignedAllocator<U, Align> &) {}
+
+    T *allocate(size_t n) { return static_cast<T *>(::operator new(n * sizeof(T), std::align_val_t(Align))); }
+    void deallocate(T *p, size_t) { ::operator delete(p, std::align_val_t(Align)); }
+
+    template<typename U>
+    bool operator==(const AlignedAllocator<U, Align> &) const { return true; }
+
+    template<typename U>
+    bool operator!=(const AlignedAllocator<U, Align> &) const { return false; }
+};
+
+template<typename T>
+using AlignedVector = std::vector<T, AlignedAllocator<T> >;
+
+class BodyStore;
+
+// Trwały uchwyt do ciała: slot w tabeli uchwytów i jego generacja. Przeżywa kompaktowanie
+// (slot wskazuje nowy indeks), a po zniszczeniu ciała generacja slotu rośnie, więc stary uchwyt
+// przestaje cokolwiek wskazywać - także gdy slot dostanie już nowe ciało.
+struct BodyHandle {
+    uint32_t slot = UINT32_MAX;
+    uint32_t generation = 0;
+
+    bool empty() const { return slot == UINT32_MAX; }
+    bool operator==(const BodyHandle &) const = default;
+};
+
+// Lekki uchwyt (magazyn + indeks) do ciała; ważny do najbliższego kompaktowania
+class BodyRef {
+    BodyStore *store;
+    size_t i;
+
+public:
+    BodyRef(BodyStore *store, size_t index) : store(store), i(index) {}
+
+    size_t index() const { return i; }
+    inline Vec3 pos() const;
+    inline Vec3 vel() const;
+    inline Vec3 acc() const;
+    inline double mass() const;
+    inline double radius() const;
+    inline int flags() const;
+    inline void setPos(Vec3 p);
+    inline void setVel(Vec3 v);
+    inline void setMass(double m);
+    inline Body &meta() const;
+};
+
+// Magazyn ciał w układzie SoA. Gorący stan (pozycja, prędkość, przyspieszenie, masa, promień,
+// flagi) leży w ciągłych tablicach, po których chodzą pętle sił, całkowania i kolizji.
+// Obiekty Body zostają tabelą zimnych danych (nazwy, kolory, ślad) i publicznym widokiem
+// BodyPtr: gather() wczytuje z nich stan na początku kroku, scatter() zapisuje go na końcu.
+// Zniszczone ciała zostają na swoich indeksach jako nagrobki (alive = 0, masa i promień 0,
+// flagi STATIC | NO_INTEGRATION), więc indeksy nie przesuwają się co krok; compact() usuwa je
+// dopiero, gdy ich udział przekroczy próg.
+class BodyStore {
+    static constexpr uint32_t NONE = UINT32_MAX;
+
+    std::vector<BodyPtr> handles;
+    size_t changes = 0;
+    size_t dead = 0;
+    size_t compactions = 0;
+    double threshold = 0.125;
+    std::vector<uint32_t> slotOf;     // indeks -> slot (NONE dla nagrobka)
+    std::vector<uint32_t> slotIndex;  // slot -> indeks (NONE dla wolnego slotu)
+    std::vector<uint32_t> generation; // slot -> generacja
+    std::vector<uint32_t> freeSlots;
+
+    void load(size_t i, const Body &b) {
+        px[i] = b.pos.x;
+        py[i] = b.pos.y;
+        pz[i] = b.pos.z;
+        vx[i] = b.vel.x;
+        vy[i] = b.vel.y;
+        vz[i] = b.vel.z;
+        ax[i] = b.acc.x;
+        ay[i] = b.acc.y;
+        az[i] = b.acc.z;
+        mass[i] = b.mass;
+        radius[i] = b.radius;
+        flags[i] = b.flags;
+    }
+
+    // Slot martwego ciała wraca na listę wolnych z nową generacją
+    void release(size_t i) {
+        uint32_t slot = slotOf[i];
+        ++generation[slot];
+        slotIndex[slot] = NONE;
+        freeSlots.push_back(slot);
+        slotOf[i] = NONE;
+        ++dead;
+    }
+
+    // Martwe ciało -> nagrobek: bez masy nie jest źródłem sił, bez integracji nie jest celem
+    void bury(size_t i) {
+        alive[i] = 0;
+        mass[i] = 0;
+        radius[i] = 0;
+        flags[i] = 3;
+        vx[i] = vy[i] = vz[i] = 0;
+        ax[i] = ay[i] = az[i] = 0;
+        timestep[i] = 0;
+        release(i);
+    }
+
+    void prune() {
+        if (dead > 0 && double(dead) > threshold * double(handles.size())) compact();
+    }
+
+    void push(const Body &b) {
+        px.push_back(b.pos.x);
+        py.push_back(b.pos.y);
+        pz.push_back(b.pos.z);
+        vx.push_back(b.vel.x);
+        vy.push_back(b.vel.y);
+        vz.push_back(b.vel.z);
+        ax.push_back(b.acc.x);
+        ay.push_back(b.acc.y);
+        az.push_back(b.acc.z);
+        mass.push_back(b.mass);
+        radius.push_back(b.radius);
+        flags.push_back(b.flags);
+        alive.push_back(b.destroyed ? 0 : 1);
+    }
+
+    void clearArrays() {
+        for (auto *v: {&px, &py, &pz, &vx, &vy, &vz, &ax, &ay, &az, &mass, &radius}) v->clear();
+        flags.clear();
+        alive.clear();
+    }
+
+public:
+    AlignedVector<double> px, py, pz;
+    AlignedVector<double> vx, vy, vz;
+    AlignedVector<double> ax, ay, az;
+    AlignedVector<double> mass, radius;
+    AlignedVector<int32_t> flags;
+    AlignedVector<uint8_t> alive;
+    // Stan silnika z poprzedniego kroku, którego nie ma w Body - w odróżnieniu od reszty tablic
+    // przeżywa gather() i compact(): koszt ciała (np. liczba oddziaływań w drzewie), ostatni
+    // oszacowany własny krok czasowy (0 - brak oszacowania) i pochodna przyspieszenia (Hermite)
+    std::vector<uint32_t> work;
+    std::vector<double> timestep;
+    std::vector<Vec3> jerk;
+
+    // Liczba indeksów razem z nagrobkami; żywych ciał jest live()
+    size_t size() const { return handles.size(); }
+    bool empty() const { return handles.empty(); }
+    size_t live() const { return handles.size() - dead; }
+    // Rośnie przy każdej zmianie indeksów (dodanie, kompaktowanie): struktury zbudowane dla
+    // starszej wersji nie pasują już do indeksów, nawet gdy adres nowego ciała powtarza stary
+    size_t revision() const { return changes; }
+    size_t compactionCount() const { return compactions; }
+
+    // Udział nagrobków, powyżej którego gather() kompaktuje tablice; 0 - po każdym usunięciu
+    void setCompactionThreshold(double fraction) { threshold = fraction; }
+    double compactionThreshold() const { return threshold; }
+
+    size_t add(BodyPtr body) {
+        ++changes;
+        size_t i = handles.size();
+        uint32_t slot;
+        if (!freeSlots.empty()) {
+            slot = freeSlots.back();
+            freeSlots.pop_back();
+        } else {
+            slot = uint32_t(generation.size());
+            generation.push_back(0);
+            slotIndex.push_back(NONE);
+        }
+        slotIndex[slot] = uint32_t(i);
+        slotOf.push_back(slot);
+        handles.push_back(body);
+        push(*body);
+        work.push_back(0);
+        timestep.push_back(0);
+        jerk.push_back(Vec3(0, 0, 0));
+        if (!alive[i]) bury(i);
+        return i;
+    }
+
+    // Wszystkie wydane uchwyty tracą ważność
+    void clear() {
+        ++changes;
+        for (uint32_t slot: slotOf) {
+            if (slot == NONE) continue;
+            ++generation[slot];
+            slotIndex[slot] = NONE;
+            freeSlots.push_back(slot);
+        }
+        slotOf.clear();
+        dead = 0;
+        handles.clear();
+        work.clear();
+        timestep.clear();
+        jerk.clear();
+        clearArrays();
+    }
+
+    // Uchwyt żywego ciała i (pusty dla martwego)
+    BodyHandle handleOf(size_t i) const {
+        if (i >= handles.size() || !alive[i] || slotOf[i] == NONE) return {};
+        return {slotOf[i], generation[slotOf[i]]};
+    }
+
+    // Bieżący indeks ciała albo SIZE_MAX, gdy uchwyt jest nieaktualny
+    size_t indexOf(BodyHandle h) const {
+        if (h.slot >= generation.size() || generation[h.slot] != h.generation) return SIZE_MAX;
+        uint32_t i = slotIndex[h.slot];
+        return i != NONE && alive[i] ? i : SIZE_MAX;
+    }
+
+    BodyPtr find(BodyHandle h) const {
+        size_t i = indexOf(h);
+        return i == SIZE_MAX ? nullptr : handles[i];
+    }
+
+    const std::vector<BodyPtr> &bodies() const { return handles; }
+    const BodyPtr &handle(size_t i) const { return handles[i]; }
+    BodyRef ref(size_t i) { return BodyRef(this, i); }
+
+    Vec3 pos(size_t i) const { return Vec3(px[i], py[i], pz[i]); }
+    Vec3 vel(size_t i) const { return Vec3(vx[i], vy[i], vz[i]); }
+    Vec3 acc(size_t i) const { return Vec3(ax[i], ay[i], az[i]); }
+
+    void setPos(size_t i, Vec3 p) {
+        px[i] = p.x;
+        py[i] = p.y;
+        pz[i] = p.z;
+    }
+
+    void setVel(size_t i, Vec3 v) {
+        vx[i] = v.x;
+        vy[i] = v.y;
+        vz[i] = v.z;
+    }
+
+    void setAcc(size_t i, Vec3 a) {
+        ax[i] = a.x;
+        ay[i] = a.y;
+        az[i] = a.z;
+    }
+
+    // Dotyka tylko ciała i, więc można ją wołać równolegle dla różnych ciał; nagrobek
+    // powstaje w scatter()
+    void kill(size_t i) {
+        alive[i] = 0;
+        handles[i]->destroy();
+    }
+
+    // Body -> tablice w miejscu. Ciała usunięte z zewnątrz (nullptr lub destroyed) zostają
+    // nagrobkami; gdy jest ich więcej niż próg, tablice są kompaktowane z zachowaniem kolejności.
+    void gather() {
+        for (size_t i = 0; i < handles.size(); ++i) {
+            if (slotOf[i] == NONE) continue;
+            if (alive[i] && handles[i] && !handles[i]->destroyed) {
+                load(i, *handles[i]);
+            } else {
+                bury(i);
+            }
+        }
+        prune();
+    }
+
+    void scatterOne(size_t i) {
+        Body &b = *handles[i];
+        b.pos = pos(i);
+        b.vel = vel(i);
+        b.acc = acc(i);
+        b.mass = mass[i];
+        b.radius = radius[i];
+        b.flags = flags[i];
+        if (!alive[i]) b.destroyed = true;
+    }
+
+    // Tablice -> Body. Ciała zabite w tym kroku dostają stan końcowy i stają się nagrobkami;
+    // stare nagrobki nie nadpisują już zniszczonych obiektów.
+    void scatter() {
+        for (size_t i = 0; i < handles.size(); ++i) {
+            if (slotOf[i] == NONE) continue;
+            scatterOne(i);
+            if (!alive[i]) bury(i);
+        }
+        prune();
+    }
+
+    // Usuwa nagrobki i ciała zabite od ostatniego gather() z tablic i z tabeli uchwytów,
+    // zachowując kolejność; uchwyty żywych ciał wskazują nowe indeksy
+    void compact() {
+        size_t live = 0;
+        for (size_t i = 0; i < handles.size(); ++i) {
+            if (!alive[i]) {
+                if (slotOf[i] != NONE) release(i);
+                continue;
+            }
+            if (live != i) {
+                handles[live] = std::move(handles[i]);
+                slotOf[live] = slotOf[i];
+                slotIndex[slotOf[live]] = uint32_t(live);
+                px[live] = px[i];
+                py[live] = py[i];
+                pz[live] = pz[i];
+                vx[live] = vx[i];
+                vy[live] = vy[i];
+                vz[live] = vz[i];
+                ax[live] = ax[i];
+                ay[live] = ay[i];
+                az[live] = az[i];
+                mass[live] = mass[i];
+                radius[live] = radius[i];
+                flags[live] = flags[i];
+                alive[live] = 1;
+                work[live] = work[i];
+                timestep[live] = timestep[i];
+                jerk[live] = jerk[i];
+            }
+            ++live;
+        }
+        if (live != handles.size()) {
+            ++changes;
+            ++compactions;
+        }
+        dead = 0;
+        handles.resize(live);
+        slotOf.resize(live);
+        for (auto *v: {&px, &py, &pz, &vx, &vy, &vz, &ax, &ay, &az, &mass, &radius}) v->resize(live);
+        flags.resize(live);
+        alive.resize(live);
+        work.resize(live);
+        timestep.resize(live);
+        jerk.resize(live);
+    }
+};
+
+inline Vec3 BodyRef::pos() const { return store->pos(i); }
+inline Vec3 BodyRef::vel() const { return store->vel(i); }
+inline Vec3 BodyRef::acc() const { return store->acc(i); }
+inline double BodyRef::mass() const { return store->mass[i]; }
+inline double BodyRef::radius() const { return store->radius[i]; }
+inline int BodyRef::flags() const { return store->flags[i]; }
+inline void BodyRef::setPos(Vec3 p) { store->setPos(i, p); }
+inline void BodyRef::setVel(Vec3 v) { store->setVel(i, v); }
+inline void BodyRef::setMass(double m) { store->mass[i] = m; }
+inline Body &BodyRef::meta() const { return *store->handle(i); }
@@ -0,0 +1,89 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+// Adaptacyjny Bulirsch-Stoer dla y' = f(y): krok H to n podkroków metody punktu środkowego
+// Gragga dla n = 2, 4, 6, ..., 16, ekstrapolowanych wielomianowo do H / n -> 0. Krok jest
+// przyjmowany, gdy dwie ostatnie kolumny tablicy ekstrapolacji zgadzają się z dokładnością tol
+// względem scale[k]; kolejny H wynika z rzędu, przy którym to nastąpiło.
+namespace BulirschStoer {
+
+inline constexpr int STAGES = 8;
+
+// derivative(y, dydt); accepted(yOld, yNew) po każdym przyjętym kroku. Zwraca liczbę kroków.
+template<typename Derivative, typename Accepted>
+inline size_t integrate(std::vector<double> &y, double span, const std::vector<double> &scale, double tol,
+                        Derivative &&derivative, Accepted &&accepted) {
+    size_t dim = y.size(), steps = 0;
+    std::vector<double> dy(dim), ym(dim), yn(dim), yt(dim), f(dim);
+    // Wiersze tablicy ekstrapolacji: row[j] = T(stage, j), previous - wiersz poprzedni
+    std::vector<std::vector<double> > row(STAGES, std::vector<double>(dim)), previous = row;
+    double t = 0, h = span;
+    const double direction = span < 0 ? -1 : 1;
+
+    while (direction * (span - t) > 0) {
+        if (direction * (t + h - span) > 0) h = span - t;
+        derivative(y, dy);
+
+        bool done = false;
+        double error = 0;
+        int stage = 0;
+        for (; stage < STAGES; ++stage) {
+            // Punkt środkowy Gragga z n = 2 (stage + 1) podkrokami
+            int n = 2 * (stage + 1);
+            double sub = h / n;
+            for (size_t k = 0; k < dim; ++k) {
+                ym[k] = y[k];
+                yn[k] = y[k] + sub * dy[k];
+            }
+            for (int m = 1; m < n; ++m) {
+                derivative(yn, f);
+                for (size_t k = 0; k < dim; ++k) {
+                    yt[k] = ym[k] + 2 * sub * f[k];
+                    ym[k] = yn[k];
+                    yn[k] = yt[k];
+                }
+            }
+            derivative(yn, f);
+            for (size_t k = 0; k < dim; ++k) row[0][k] = 0.5 * (ym[k] + yn[k] + sub * f[k]);
+
+            // Neville w zmiennej (H / n)^2
+            for (int j = 1; j <= stage; ++j) {
+                double ratio = double(stage + 1) / (stage + 1 - j);
+                double denom = ratio * ratio - 1;
+                for (size_t k = 0; k < dim; ++k) {
+                    row[j][k] = row[j - 1][k] + (row[j - 1][k] - previous[j - 1][k]) / denom;
+                }
+            }
+            row.swap(previous);
+            if (stage == 0) continue;
+
+            error = 0;
+            for (size_t k = 0; k < dim; ++k) {
+                error = std::max(error, std::abs(previous[stage][k] - previous[stage - 1][k]) / scale[k]);
+            }
+            error /= tol;
+            if (error <= 1) {
+                done = true;
+                break;
+            }
+        }
+
+        if (!done) {
+            h *= 0.25;
+            continue;
+        }
+
+        accepted(y, previous[stage]);
+        y.swap(previous[stage]);
+        t += h;
+        ++steps;
+        int order = 2 * stage + 1;
+        double grow = error > 0 ? 0.94 * std::pow(0.65 / error, 1.0 / order) : 4.0;
+        h *= std::clamp(grow, 0.2, 4.0);
+    }
+    return steps;
+}
+}
@@ -1,17 +1,43 @@
 #pragma once
 #include "physics_body.h"
 #include "physics_forces.h"
+#include "spatial_hash.h"
+#include "../core/object_pool.h"
+#include "../core/parallel.h"
 #include <vector>
 #include <algorithm>
 #include <cmath>
+#include <cstdint>
 
 enum class CollisionResult {
   ELASTIC_BOUNCE, INELASTIC_MERGE, FRAGMENTATION, FUSION,
   ANNIHILATION, TIDAL_DISRUPTION, EXPLOSION
 };
 
+// splitmix64 dla losowości kolizji: stan z ziarna, numeru kroku i indeksów pary, więc wynik nie
+// zależy od kolejności rozstrzygania par ani od liczby wątków
+struct CollisionRandom {
+  uint64_t state;
+
+  CollisionRandom(size_t step, size_t a, size_t b, uint64_t seed = 0)
+    : state(uint64_t(step) * 0x9E3779B97F4A7C15ull ^ uint64_t(a) * 0xBF58476D1CE4E5B9ull ^
+            uint64_t(b) * 0x94D049BB133111EBull ^ seed * 0xD6E8FEB86659FD93ull) {}
+
+  uint64_t next() {
+    uint64_t z = state += 0x9E3779B97F4A7C15ull;
+    z = (z ^ z >> 30) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ z >> 27) * 0x94D049BB133111EBull;
+    return z ^ z >> 31;
+  }
+
+  // [0, 1)
+  double uniform() { return double(next() >> 11) * 0x1.0p-53; }
+  int below(int n) { return int(next() % uint64_t(n)); }
+};
+
 struct CollisionEvent {
   PhysicsBodyPtr a, b;
+  size_t indexA, indexB;
   Vec3 collisionPoint;
   double relativeSpeed;
   double collisionEnergy;
@@ -22,64 +48,143 @@ class DeterministicPhysicsEngine {
   std::vector<PhysicsBodyPtr> bodies;
   double totalEnergy = 0;
   double simulationTime = 0;
+  SpatialHash::Broadphase broadphase;
+  // Wersja składu bodies, dla której zbudowano listę kandydatów (adresy z puli się powtarzają)
+  size_t revision = 0, broadphaseRevision = SIZE_MAX;
+  // Produkty zderzeń z puli - obiekty usuniętych ciał wracają do niej zamiast do alokatora
+  ObjectPool<PhysicsBody> bodyPool;
+  // Zniszczone ciała zostają w bodies (wszystkie pętle je pomijają) aż ich udział przekroczy próg
+  size_t dead = 0;
+  double compactionThreshold = 0.125;
+  // Siły liczone równolegle, ale każde ciało sumuje swoje samo, w stałej kolejności - wynik nie zależy
+  // od liczby wątków; odłamki losowane z ziarna, kroku i pary
+  Parallel::Workers workers{nullptr, 1};
+  uint64_t seed = 0;
+  size_t stepCount = 0;
+  std::vector<Vec3> accelerations;
+  // Bufory wykrywania kolizji żyją między krokami - w stanie ustalonym krok nie alokuje
+  std::vector<double> sphereX, sphereY, sphereZ, sphereRadius, sphereMargin;
+  std::vector<uint8_t> sphereAlive;
+  std::vector<CollisionEvent> collisions;
+
+  void retire(PhysicsBodyPtr &body) {
+    if(body->destroyed) return;
+    body->destroy();
+    ++dead;
+  }
   
 public:
   void addBody(PhysicsBodyPtr body) {
     bodies.push_back(body);
+    ++revision;
+  }
+
+  // Nowe ciało z puli silnika
+  PhysicsBodyPtr createBody(Vec3 pos, Vec3 vel, double m, double r, PhysicsBodyType t = PhysicsBodyType::RIGID_BODY) {
+    auto body = bodyPool.make(pos, vel, m, r, t);
+    addBody(body);
+    return body;
   }
   
   void step(double dt) {
     simulationTime += dt;
+    ++stepCount;
     
-    for(auto &body : bodies) {
-      if(body->destroyed || body->invMass == 0) continue;
-      
-      Vec3 totalForce(0, 0, 0);
-      for(auto &other : bodies) {
-        if(body == other || other->destroyed) continue;
-        totalForce += PhysicsForces::gravity(*body, *other);
+    // Najpierw wszystkie przyspieszenia ze stanu na początku kroku, potem ruch
+    size_t n = bodies.size();
+    accelerations.assign(n, Vec3(0, 0, 0));
+    workers.forRange(0, n, [&](size_t begin, size_t end, size_t) {
+      for(size_t i = begin; i < end; ++i) {
+        auto &body = bodies[i];
+        if(body->destroyed || body->invMass == 0) continue;
+        
+        Vec3 totalForce(0, 0, 0);
+        for(auto &other : bodies) {
+          if(body == other || other->destroyed) continue;
+          totalForce += PhysicsForces::gravity(*body, *other);
+        }
+        accelerations[i] = totalForce * body->invMass;
       }
-      
-      Vec3 acc = totalForce * body->invMass;
-      body->velocity += acc * dt;
+    }, 64);
+    
+    for(size_t i = 0; i < n; ++i) {
+      auto &body = bodies[i];
+      if(body->destroyed || body->invMass == 0) continue;
+      body->velocity += accelerations[i] * dt;
       body->position += body->velocity * dt;
       body->updateEnergy();
     }
     
-    auto collisions = detectCollisions();
+    detectCollisions();
     for(auto &col : collisions) {
       resolveCollision(col);
     }
     
-    bodies.erase(std::remove_if(bodies.begin(), bodies.end(),
-                 [](const PhysicsBodyPtr &b) { return b->destroyed; }),
-                 bodies.end());
+    if(dead > 0 && dead > compactionThreshold * bodies.size()) {
+      bodies.erase(std::remove_if(bodies.begin(), bodies.end(),
+                   [](const PhysicsBodyPtr &b) { return b->destroyed; }),
+                   bodies.end());
+      dead = 0;
+      ++revision;
+    }
   }
   
-  std::vector<CollisionEvent> detectCollisions() {
-    std::vector<CollisionEvent> collisions;
+  // 0 - usuwanie zniszczonych ciał po każdym kroku
+  void setCompactionThreshold(double fraction) { compactionThreshold = fraction; }
+  void setThreads(unsigned n) { workers.threads = std::max(1u, n); }
+  // Przejście sił na trwałych wątkach puli (np. puli silnika) zamiast nowych w każdym kroku
+  void setPool(Parallel::ThreadPool *pool) { workers.pool = pool; }
+  void setSeed(uint64_t value) { seed = value; }
+  
+  const std::vector<CollisionEvent> &detectCollisions() {
+    collisions.clear();
+    
+    size_t n = bodies.size();
+    auto &x = sphereX, &y = sphereY, &z = sphereZ, &r = sphereRadius;
+    auto &alive = sphereAlive;
+    for(auto *v : {&x, &y, &z, &r}) v->resize(n);
+    alive.resize(n);
+    for(size_t i = 0; i < n; ++i) {
+      x[i] = bodies[i]->position.x;
+      y[i] = bodies[i]->position.y;
+      z[i] = bodies[i]->position.z;
+      r[i] = bodies[i]->radius;
+      alive[i] = !bodies[i]->destroyed;
+    }
+    SpatialHash::Spheres spheres{x.data(), y.data(), z.data(), r.data(), alive.data(), n};
     
-    for(size_t i = 0; i < bodies.size(); ++i) {
-      if(bodies[i]->destroyed) continue;
-      for(size_t j = i + 1; j < bodies.size(); ++j) {
-        if(bodies[j]->destroyed) continue;
+    // Lista kandydatów z marginesem pół promienia przetrwa kolejne kroki, dopóki ciała się nie
+    // przesuną dalej; nowy zestaw ciał zawsze ją przebudowuje
+    if(revision != broadphaseRevision || !broadphase.valid(spheres)) {
+      auto &margins = sphereMargin;
+      margins.resize(n);
+      for(size_t i = 0; i < n; ++i) margins[i] = 0.5 * r[i];
+      broadphase.rebuild(spheres, margins.data(), [](size_t total, auto &&fn) { fn(0, total); });
+      broadphaseRevision = revision;
+    }
+    
+    // Kandydaci idą rosnąco po (i, j), więc zdarzenia mają tę samą kolejność co pętla po parach
+    for(size_t k = 0; k < broadphase.candidates(); ++k) {
+      auto [i, j] = broadphase.candidate(k);
+      if(bodies[i]->destroyed || bodies[j]->destroyed) continue;
+      
+      auto &a = bodies[i];
+      auto &b = bodies[j];
+      double dist = (a->position - b->position).length();
+      
+      if(dist < a->radius + b->radius) {
+        CollisionEvent col;
+        col.a = a;
+        col.b = b;
+        col.indexA = i;
+        col.indexB = j;
+        col.collisionPoint = (a->position * b->mass + b->position * a->mass) / (a->mass + b->mass);
+        col.relativeSpeed = (a->velocity - b->velocity).length();
         
-        auto &a = bodies[i];
-        auto &b = bodies[j];
-        double dist = (a->position - b->position).length();
+        double reducedMass = (a->mass * b->mass) / (a->mass + b->mass);
+        col.collisionEnergy = 0.5 * reducedMass * col.relativeSpeed * col.relativeSpeed;
         
-        if(dist < a->radius + b->radius) {
-          CollisionEvent col;
-          col.a = a;
-          col.b = b;
-          col.collisionPoint = (a->position * b->mass + b->position * a->mass) / (a->mass + b->mass);
-          col.relativeSpeed = (a->velocity - b->velocity).length();
-          
-          double reducedMass = (a->mass * b->mass) / (a->mass + b->mass);
-          col.collisionEnergy = 0.5 * reducedMass * col.relativeSpeed * col.relativeSpeed;
-          
-          collisions.push_back(col);
-        }
+        collisions.push_back(col);
       }
     }
     
@@ -99,7 +204,7 @@ public:
     } else if(col.collisionEnergy < MERGE_THRESHOLD) {
       inelasticMerge(a, b);
     } else {
-      fragmentate(a, b, col.collisionEnergy);
+      fragmentate(a, b, col.collisionEnergy, CollisionRandom(stepCount, col.indexA, col.indexB, seed));
     }
   }
   
@@ -108,7 +213,7 @@ public:
     Vec3 relVel = a->velocity - b->velocity;
     double velAlongNormal = relVel.dot(normal);
     
-    if(velAlongNormal > 0) return;
+    if(velAlongNormal <= 0) return;
     
     double e = 0.8;
     double j = -(1 + e) * velAlongNormal / (a->invMass + b->invMass);
@@ -122,7 +227,7 @@ public:
     Vec3 totalMomentum = a->momentumVector() + b->momentumVector();
     double totalMass = a->mass + b->mass;
     
-    auto merged = std::make_shared<PhysicsBody>(
+    auto merged = bodyPool.make(
       (a->position * a->mass + b->position * b->mass) / totalMass,
       totalMomentum / totalMass,
       totalMass,
@@ -133,41 +238,51 @@ public:
     merged->label = "MRG";
     merged->setColor(0.9f, 0.7f, 0.3f);
     
-    a->destroy();
-    b->destroy();
+    retire(a);
+    retire(b);
     bodies.push_back(merged);
+    ++revision;
   }
   
-  void fragmentate(PhysicsBodyPtr &a, PhysicsBodyPtr &b, double collisionEnergy) {
+  void fragmentate(PhysicsBodyPtr &a, PhysicsBodyPtr &b, double collisionEnergy, CollisionRandom random) {
     Vec3 totalMomentum = a->momentumVector() + b->momentumVector();
     double totalMass = a->mass + b->mass;
     Vec3 collisionPoint = (a->position * a->mass + b->position * b->mass) / totalMass;
     
-    int numFragments = 3 + rand() % 5;
+    int numFragments = 3 + random.below(5);
     double fragmentMass = totalMass / numFragments;
     double fragmentRadius = std::pow(fragmentMass / totalMass, 1.0/3.0) * std::max(a->radius, b->radius);
     
     for(int i = 0; i < numFragments; i++) {
       double theta = 2.0 * M_PI * i / numFragments;
-      double phi = M_PI * (rand() / (double)RAND_MAX - 0.5);
+      double phi = M_PI * (random.uniform() - 0.5);
       
       Vec3 dir(cos(theta) * cos(phi), sin(phi), sin(theta) * cos(phi));
       double speed = std::sqrt(2.0 * collisionEnergy / (fragmentMass * numFragments));
       
-      Vec3 fragmentVel = totalMomentum / totalMass + dir * speed * (0.5 + rand() / (double)RAND_MAX);
+      Vec3 fragmentVel = totalMomentum / totalMass + dir * speed * (0.5 + random.uniform());
       Vec3 fragmentPos = collisionPoint + dir * fragmentRadius * 2;
       
-      auto fragment = std::make_shared<PhysicsBody>(fragmentPos, fragmentVel, fragmentMass, fragmentRadius, PhysicsBodyType::ASTEROID_RUBBLE);
+      auto fragment = bodyPool.make(fragmentPos, fragmentVel, fragmentMass, fragmentRadius, PhysicsBodyType::ASTEROID_RUBBLE);
       fragment->label = "FRG";
       fragment->setColor(0.8f, 0.5f, 0.2f);
       bodies.push_back(fragment);
+      ++revision;
     }
     
-    a->destroy();
-    b->destroy();
+    retire(a);
+    retire(b);
   }
   
   const std::vector<PhysicsBodyPtr>& getBodies() const { return bodies; }
+  ObjectPool<PhysicsBody>::Stats poolStats() const { return bodyPool.stats(); }
+  // Pojemność list i buforów kroku w bajtach; rośnie tylko z liczbą ciał i zderzeń
+  size_t scratchBytes() const {
+    auto bytes = [](const auto &v) { return v.capacity() * sizeof(v[0]); };
+    return bytes(bodies) + bytes(accelerations) + bytes(sphereX) + bytes(sphereY) + bytes(sphereZ) +
+           bytes(sphereRadius) + bytes(sphereMargin) + bytes(sphereAlive) + bytes(collisions) +
+           broadphase.scratchBytes();
+  }
   double getTotalEnergy() const { return totalEnergy; }
   double getSimulationTime() const { return simulationTime; }
 };
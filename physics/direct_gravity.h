@@ -0,0 +1,535 @@
+#pragma once
+#include "../core/constants.h"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define PHYSPP_X86_DISPATCH 1
+#endif
+
+// Bezpośrednia suma grawitacji po tablicach SoA, kafelkowana i wektoryzowana.
+// Liczy pole (przyspieszenie) g_i = G * sum_j m_j * d / (d^2 + eps^2)^(3/2), gdzie
+// eps = (r_i + r_j) * 0.01 - to samo zmiękczenie co Forces::gravity. Pary bliższe niż
+// 1e-10 (w tym i == j) są pomijane. Cele idą po 8 (AVX-512) lub 4 (AVX2) w rejestrze,
+// źródła są rozgłaszane po jednym, w kafelkach mieszczących się w L1. Na życzenie w tym samym
+// przejściu powstaje potencjał phi_i = -G * sum_j m_j / (d^2 + eps^2)^(1/2).
+namespace DirectGravity {
+
+enum class Isa { SCALAR, AVX2, AVX512 };
+
+struct Sources {
+    const double *x, *y, *z, *m, *radius;
+    size_t n;
+};
+
+// Punkty, w których liczymy pole; zwykle te same tablice co źródła
+struct Targets {
+    const double *x, *y, *z, *radius;
+};
+
+struct Velocities {
+    const double *x, *y, *z;
+};
+
+// 5 tablic źródeł po 512 double = 20 KB
+constexpr size_t SOURCE_TILE = 512;
+constexpr double MIN_DIST2 = 1e-20;
+constexpr double SOFTENING = 0.01;
+
+inline const char *isaName(Isa isa) {
+    switch (isa) {
+        case Isa::AVX512: return "AVX-512";
+        case Isa::AVX2: return "AVX2";
+        default: return "scalar";
+    }
+}
+
+inline bool isaSupported(Isa isa) {
+#ifdef PHYSPP_X86_DISPATCH
+    __builtin_cpu_init();
+    if (isa == Isa::AVX512) return __builtin_cpu_supports("avx512f");
+    if (isa == Isa::AVX2) return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+    return isa == Isa::SCALAR;
+}
+
+inline Isa bestIsa() {
+    static const Isa best = isaSupported(Isa::AVX512) ? Isa::AVX512
+                            : isaSupported(Isa::AVX2) ? Isa::AVX2
+                            : Isa::SCALAR;
+    return best;
+}
+
+template<bool Potential>
+inline void fieldScalar(const Sources &s, const Targets &t, double *gx, double *gy, double *gz, double *phi,
+                        size_t begin, size_t end) {
+    for (size_t t0 = 0; t0 < s.n; t0 += SOURCE_TILE) {
+        size_t t1 = std::min(s.n, t0 + SOURCE_TILE);
+        for (size_t i = begin; i < end; ++i) {
+            double xi = t.x[i], yi = t.y[i], zi = t.z[i], ri = t.radius[i];
+            double ax = 0, ay = 0, az = 0, p = 0;
+            for (size_t j = t0; j < t1; ++j) {
+                double dx = s.x[j] - xi, dy = s.y[j] - yi, dz = s.z[j] - zi;
+                double r2 = dx * dx + dy * dy + dz * dz;
+                if (r2 < MIN_DIST2) continue;
+                double eps = (ri + s.radius[j]) * SOFTENING;
+                double inv = 1.0 / std::sqrt(r2 + eps * eps);
+                double w = s.m[j] * inv * inv * inv;
+                ax += dx * w;
+                ay += dy * w;
+                az += dz * w;
+                if constexpr (Potential) p += s.m[j] * inv;
+            }
+            gx[i] += ax;
+            gy[i] += ay;
+            gz[i] += az;
+            if constexpr (Potential) phi[i] += p;
+        }
+    }
+}
+
+#ifdef PHYSPP_X86_DISPATCH
+// AVX2 nie ma rsqrt dla double, a rsqrt_ps nie obejmuje zakresu r^2 w metrach - zostaje sqrt + div
+template<bool Potential>
+__attribute__((target("avx2,fma")))
+inline void fieldAvx2(const Sources &s, const Targets &t, double *gx, double *gy, double *gz, double *phi,
+                      size_t begin, size_t end) {
+    const __m256d one = _mm256_set1_pd(1.0), soft = _mm256_set1_pd(SOFTENING);
+    const __m256d minR2 = _mm256_set1_pd(MIN_DIST2);
+
+    for (size_t t0 = 0; t0 < s.n; t0 += SOURCE_TILE) {
+        size_t t1 = std::min(s.n, t0 + SOURCE_TILE);
+        for (size_t i0 = begin; i0 < end; i0 += 4) {
+            size_t lanes = std::min<size_t>(4, end - i0);
+            __m256i mask = _mm256_cmpgt_epi64(_mm256_set1_epi64x(int64_t(lanes)), _mm256_setr_epi64x(0, 1, 2, 3));
+            __m256d xi = _mm256_maskload_pd(t.x + i0, mask);
+            __m256d yi = _mm256_maskload_pd(t.y + i0, mask);
+            __m256d zi = _mm256_maskload_pd(t.z + i0, mask);
+            __m256d ri = _mm256_maskload_pd(t.radius + i0, mask);
+            __m256d ax = _mm256_setzero_pd(), ay = _mm256_setzero_pd(), az = _mm256_setzero_pd();
+            __m256d p = _mm256_setzero_pd();
+
+            for (size_t j = t0; j < t1; ++j) {
+                __m256d dx = _mm256_sub_pd(_mm256_set1_pd(s.x[j]), xi);
+                __m256d dy = _mm256_sub_pd(_mm256_set1_pd(s.y[j]), yi);
+                __m256d dz = _mm256_sub_pd(_mm256_set1_pd(s.z[j]), zi);
+                __m256d r2 = _mm256_fmadd_pd(dx, dx, _mm256_fmadd_pd(dy, dy, _mm256_mul_pd(dz, dz)));
+                __m256d eps = _mm256_mul_pd(_mm256_add_pd(ri, _mm256_set1_pd(s.radius[j])), soft);
+                __m256d inv = _mm256_div_pd(one, _mm256_sqrt_pd(_mm256_fmadd_pd(eps, eps, r2)));
+                __m256d mj = _mm256_set1_pd(s.m[j]), far = _mm256_cmp_pd(r2, minR2, _CMP_GE_OQ);
+                __m256d w = _mm256_mul_pd(mj, _mm256_mul_pd(inv, _mm256_mul_pd(inv, inv)));
+                w = _mm256_and_pd(w, far);
+                ax = _mm256_fmadd_pd(dx, w, ax);
+                ay = _mm256_fmadd_pd(dy, w, ay);
+                az = _mm256_fmadd_pd(dz, w, az);
+                if constexpr (Potential) p = _mm256_add_pd(p, _mm256_and_pd(_mm256_mul_pd(mj, inv), far));
+            }
+
+            _mm256_maskstore_pd(gx + i0, mask, _mm256_add_pd(_mm256_maskload_pd(gx + i0, mask), ax));
+            _mm256_maskstore_pd(gy + i0, mask, _mm256_add_pd(_mm256_maskload_pd(gy + i0, mask), ay));
+            _mm256_maskstore_pd(gz + i0, mask, _mm256_add_pd(_mm256_maskload_pd(gz + i0, mask), az));
+            if constexpr (Potential) {
+                _mm256_maskstore_pd(phi + i0, mask, _mm256_add_pd(_mm256_maskload_pd(phi + i0, mask), p));
+            }
+        }
+    }
+}
+
+template<bool Potential>
+__attribute__((target("avx512f")))
+inline void fieldAvx512(const Sources &s, const Targets &t, double *gx, double *gy, double *gz, double *phi,
+                        size_t begin, size_t end) {
+    const __m512d half = _mm512_set1_pd(0.5), threeHalves = _mm512_set1_pd(1.5);
+    const __m512d soft = _mm512_set1_pd(SOFTENING), minR2 = _mm512_set1_pd(MIN_DIST2);
+
+    for (size_t t0 = 0; t0 < s.n; t0 += SOURCE_TILE) {
+        size_t t1 = std::min(s.n, t0 + SOURCE_TILE);
+        for (size_t i0 = begin; i0 < end; i0 += 8) {
+            __mmask8 mask = __mmask8((1u << std::min<size_t>(8, end - i0)) - 1);
+            __m512d xi = _mm512_maskz_loadu_pd(mask, t.x + i0);
+            __m512d yi = _mm512_maskz_loadu_pd(mask, t.y + i0);
+            __m512d zi = _mm512_maskz_loadu_pd(mask, t.z + i0);
+            __m512d ri = _mm512_maskz_loadu_pd(mask, t.radius + i0);
+            __m512d ax = _mm512_setzero_pd(), ay = _mm512_setzero_pd(), az = _mm512_setzero_pd();
+            __m512d p = _mm512_setzero_pd();
+
+            for (size_t j = t0; j < t1; ++j) {
+                __m512d dx = _mm512_sub_pd(_mm512_set1_pd(s.x[j]), xi);
+                __m512d dy = _mm512_sub_pd(_mm512_set1_pd(s.y[j]), yi);
+                __m512d dz = _mm512_sub_pd(_mm512_set1_pd(s.z[j]), zi);
+                __m512d r2 = _mm512_fmadd_pd(dx, dx, _mm512_fmadd_pd(dy, dy, _mm512_mul_pd(dz, dz)));
+                __m512d eps = _mm512_mul_pd(_mm512_add_pd(ri, _mm512_set1_pd(s.radius[j])), soft);
+                __m512d s2 = _mm512_fmadd_pd(eps, eps, r2);
+
+                // rsqrt14 + dwa kroki Newtona y *= 1.5 - 0.5 * s2 * y^2: 14 -> 28 -> ~52 bity
+                __m512d y = _mm512_maskz_rsqrt14_pd(0xff, s2);
+                __m512d h = _mm512_mul_pd(half, s2);
+                y = _mm512_mul_pd(y, _mm512_fnmadd_pd(_mm512_mul_pd(h, y), y, threeHalves));
+                y = _mm512_mul_pd(y, _mm512_fnmadd_pd(_mm512_mul_pd(h, y), y, threeHalves));
+
+                __m512d mj = _mm512_set1_pd(s.m[j]);
+                __mmask8 far = _mm512_cmp_pd_mask(r2, minR2, _CMP_GE_OQ);
+                __m512d w = _mm512_maskz_mov_pd(far, _mm512_mul_pd(mj, _mm512_mul_pd(y, _mm512_mul_pd(y, y))));
+                ax = _mm512_fmadd_pd(dx, w, ax);
+                ay = _mm512_fmadd_pd(dy, w, ay);
+                az = _mm512_fmadd_pd(dz, w, az);
+                if constexpr (Potential) p = _mm512_add_pd(p, _mm512_maskz_mov_pd(far, _mm512_mul_pd(mj, y)));
+            }
+
+            _mm512_mask_storeu_pd(gx + i0, mask, _mm512_add_pd(_mm512_maskz_loadu_pd(mask, gx + i0), ax));
+            _mm512_mask_storeu_pd(gy + i0, mask, _mm512_add_pd(_mm512_maskz_loadu_pd(mask, gy + i0), ay));
+            _mm512_mask_storeu_pd(gz + i0, mask, _mm512_add_pd(_mm512_maskz_loadu_pd(mask, gz + i0), az));
+            if constexpr (Potential) {
+                _mm512_mask_storeu_pd(phi + i0, mask, _mm512_add_pd(_mm512_maskz_loadu_pd(mask, phi + i0), p));
+            }
+        }
+    }
+}
+#endif
+
+template<bool Potential>
+inline void dispatch(const Sources &s, const Targets &t, double *gx, double *gy, double *gz, double *phi,
+                     size_t begin, size_t end, Isa isa) {
+    switch (isa) {
+#ifdef PHYSPP_X86_DISPATCH
+        case Isa::AVX512:
+            fieldAvx512<Potential>(s, t, gx, gy, gz, phi, begin, end);
+            break;
+        case Isa::AVX2:
+            fieldAvx2<Potential>(s, t, gx, gy, gz, phi, begin, end);
+            break;
+#endif
+        default:
+            fieldScalar<Potential>(s, t, gx, gy, gz, phi, begin, end);
+            break;
+    }
+}
+
+// Pole w celach [begin, end) od wszystkich n źródeł; nadpisuje gx, gy, gz (i phi, jeśli podany)
+// w tym zakresie. Nieobsługiwany isa spada do wersji skalarnej.
+inline void field(const Sources &s, const Targets &t, double *gx, double *gy, double *gz, size_t begin, size_t end,
+                  Isa isa = bestIsa(), double *phi = nullptr) {
+    std::fill(gx + begin, gx + end, 0.0);
+    std::fill(gy + begin, gy + end, 0.0);
+    std::fill(gz + begin, gz + end, 0.0);
+    if (!isaSupported(isa)) isa = Isa::SCALAR;
+
+    if (phi) {
+        std::fill(phi + begin, phi + end, 0.0);
+        dispatch<true>(s, t, gx, gy, gz, phi, begin, end, isa);
+        for (size_t i = begin; i < end; ++i) phi[i] *= -Physics::G;
+    } else {
+        dispatch<false>(s, t, gx, gy, gz, nullptr, begin, end, isa);
+    }
+
+    for (size_t i = begin; i < end; ++i) {
+        gx[i] *= Physics::G;
+        gy[i] *= Physics::G;
+        gz[i] *= Physics::G;
+    }
+}
+
+// Pole i jego pochodna po czasie (jerk) w jednym przejściu po parach - dla całkowania Hermite'a:
+// j_i = G * sum_j m_j * (dv / s^3 - 3 (d . dv) d / s^5), s^2 = d^2 + eps^2, dv = v_j - v_i.
+// Nadpisuje gx..jz w zakresie [begin, end) celów.
+inline void fieldJerk(const Sources &s, const Velocities &sv, const Targets &t, const Velocities &tv, double *gx,
+                      double *gy, double *gz, double *jx, double *jy, double *jz, size_t begin, size_t end) {
+    for (double *out: {gx, gy, gz, jx, jy, jz}) std::fill(out + begin, out + end, 0.0);
+
+    for (size_t t0 = 0; t0 < s.n; t0 += SOURCE_TILE) {
+        size_t t1 = std::min(s.n, t0 + SOURCE_TILE);
+        for (size_t i = begin; i < end; ++i) {
+            double xi = t.x[i], yi = t.y[i], zi = t.z[i], ri = t.radius[i];
+            double vxi = tv.x[i], vyi = tv.y[i], vzi = tv.z[i];
+            double ax = 0, ay = 0, az = 0, bx = 0, by = 0, bz = 0;
+            for (size_t j = t0; j < t1; ++j) {
+                double dx = s.x[j] - xi, dy = s.y[j] - yi, dz = s.z[j] - zi;
+                double r2 = dx * dx + dy * dy + dz * dz;
+                if (r2 < MIN_DIST2) continue;
+                double ux = sv.x[j] - vxi, uy = sv.y[j] - vyi, uz = sv.z[j] - vzi;
+                double eps = (ri + s.radius[j]) * SOFTENING;
+                double inv2 = 1.0 / (r2 + eps * eps);
+                double w = s.m[j] * inv2 * std::sqrt(inv2);
+                double rv = 3.0 * (dx * ux + dy * uy + dz * uz) * inv2;
+                ax += dx * w;
+                ay += dy * w;
+                az += dz * w;
+                bx += (ux - rv * dx) * w;
+                by += (uy - rv * dy) * w;
+                bz += (uz - rv * dz) * w;
+            }
+            gx[i] += ax;
+            gy[i] += ay;
+            gz[i] += az;
+            jx[i] += bx;
+            jy[i] += by;
+            jz[i] += bz;
+        }
+    }
+
+    for (double *out: {gx, gy, gz, jx, jy, jz}) {
+        for (size_t i = begin; i < end; ++i) out[i] *= Physics::G;
+    }
+}
+
+// Pole w samych źródłach (cele = ciała [begin, end) z tych samych tablic)
+inline void field(const Sources &s, double *gx, double *gy, double *gz, size_t begin, size_t end,
+                  Isa isa = bestIsa(), double *phi = nullptr) {
+    field(s, Targets{s.x, s.y, s.z, s.radius}, gx, gy, gz, begin, end, isa, phi);
+}
+
+// Tryb mieszany: pary liczone we float, dwa razy więcej celów w rejestrze. Źródła są sortowane
+// po kluczu Mortona, więc kafelek SOURCE_TILE źródeł zajmuje zwarty obszar; ich położenia są
+// zapisane we float względem środka kafelka. Różnica środek - cel powstaje w double raz na
+// kafelek i cel, więc d = (s - o) + (o - t) traci tylko względną precyzję float, także daleko od
+// początku układu. Długości i masy są w jednostkach length i mass (r^2 i m^3 mieszczą się we
+// float), suma kafelka we float trafia do akumulatorów double. Pary bliższe niż 1e-12 length
+// są pomijane - float ich nie rozróżnia, a inv^3 przekroczyłoby zakres.
+constexpr float MIXED_MIN_DIST2 = 1e-24f;
+
+struct MixedSources {
+    std::vector<float> x, y, z, m, radius;
+    std::vector<double> originX, originY, originZ; // środek kafelka
+    std::vector<std::pair<uint64_t, uint32_t> > keys;
+    double length = 1, mass = 1;
+    size_t n = 0;
+};
+
+inline void prepareMixed(const Sources &s, MixedSources &out) {
+    size_t n = s.n;
+    out.n = n;
+    if (n == 0) return;
+
+    double minX = s.x[0], minY = s.y[0], minZ = s.z[0], maxX = minX, maxY = minY, maxZ = minZ, maxMass = 0;
+    for (size_t i = 0; i < n; ++i) {
+        minX = std::min(minX, s.x[i]);
+        minY = std::min(minY, s.y[i]);
+        minZ = std::min(minZ, s.z[i]);
+        maxX = std::max(maxX, s.x[i]);
+        maxY = std::max(maxY, s.y[i]);
+        maxZ = std::max(maxZ, s.z[i]);
+        maxMass = std::max(maxMass, std::abs(s.m[i]));
+    }
+    double extent = std::max({maxX - minX, maxY - minY, maxZ - minZ});
+    out.length = extent > 0 ? extent : 1;
+    out.mass = maxMass > 0 ? maxMass : 1;
+
+    auto spread = [](uint64_t v) {
+        v &= 0x1fffff;
+        v = (v | v << 32) & 0x1f00000000ffffULL;
+        v = (v | v << 16) & 0x1f0000ff0000ffULL;
+        v = (v | v << 8) & 0x100f00f00f00f00fULL;
+        v = (v | v << 4) & 0x10c30c30c30c30c3ULL;
+        v = (v | v << 2) & 0x1249249249249249ULL;
+        return v;
+    };
+    double scale = double((1 << 21) - 1) / out.length;
+    out.keys.resize(n);
+    for (size_t i = 0; i < n; ++i) {
+        uint64_t key = spread(uint64_t((s.x[i] - minX) * scale)) | spread(uint64_t((s.y[i] - minY) * scale)) << 1 |
+                       spread(uint64_t((s.z[i] - minZ) * scale)) << 2;
+        out.keys[i] = {key, uint32_t(i)};
+    }
+    std::sort(out.keys.begin(), out.keys.end());
+
+    size_t tiles = (n + SOURCE_TILE - 1) / SOURCE_TILE;
+    for (auto *v: {&out.x, &out.y, &out.z, &out.m, &out.radius}) v->resize(n);
+    for (auto *v: {&out.originX, &out.originY, &out.originZ}) v->resize(tiles);
+    const double invLength = 1 / out.length, invMass = 1 / out.mass;
+    for (size_t tile = 0; tile < tiles; ++tile) {
+        size_t j0 = tile * SOURCE_TILE, j1 = std::min(n, j0 + SOURCE_TILE);
+        double lo[3] = {s.x[out.keys[j0].second], s.y[out.keys[j0].second], s.z[out.keys[j0].second]};
+        double hi[3] = {lo[0], lo[1], lo[2]};
+        for (size_t j = j0; j < j1; ++j) {
+            size_t i = out.keys[j].second;
+            lo[0] = std::min(lo[0], s.x[i]);
+            lo[1] = std::min(lo[1], s.y[i]);
+            lo[2] = std::min(lo[2], s.z[i]);
+            hi[0] = std::max(hi[0], s.x[i]);
+            hi[1] = std::max(hi[1], s.y[i]);
+            hi[2] = std::max(hi[2], s.z[i]);
+        }
+        double ox = 0.5 * (lo[0] + hi[0]), oy = 0.5 * (lo[1] + hi[1]), oz = 0.5 * (lo[2] + hi[2]);
+        out.originX[tile] = ox;
+        out.originY[tile] = oy;
+        out.originZ[tile] = oz;
+        for (size_t j = j0; j < j1; ++j) {
+            size_t i = out.keys[j].second;
+            out.x[j] = float((s.x[i] - ox) * invLength);
+            out.y[j] = float((s.y[i] - oy) * invLength);
+            out.z[j] = float((s.z[i] - oz) * invLength);
+            out.m[j] = float(s.m[i] * invMass);
+            out.radius[j] = float(s.radius[i] * invLength);
+        }
+    }
+}
+
+// Przesunięcia środek kafelka - cel i promienie celów [i0, i0 + W) w jednostkach length; ostatni
+// cel powtarza się w pustych torach
+template<size_t W>
+inline void mixedLanes(const MixedSources &s, const Targets &t, size_t tile, size_t i0, size_t end, float *ox,
+                       float *oy, float *oz, float *ri) {
+    const double invLength = 1 / s.length;
+    for (size_t l = 0; l < W; ++l) {
+        size_t i = std::min(i0 + l, end - 1);
+        ox[l] = float((s.originX[tile] - t.x[i]) * invLength);
+        oy[l] = float((s.originY[tile] - t.y[i]) * invLength);
+        oz[l] = float((s.originZ[tile] - t.z[i]) * invLength);
+        ri[l] = float(t.radius[i] * invLength);
+    }
+}
+
+inline void fieldMixedScalar(const MixedSources &s, const Targets &t, double *gx, double *gy, double *gz,
+                             size_t begin, size_t end) {
+    const float soft = float(SOFTENING);
+    for (size_t j0 = 0, tile = 0; j0 < s.n; j0 += SOURCE_TILE, ++tile) {
+        size_t j1 = std::min(s.n, j0 + SOURCE_TILE);
+        for (size_t i = begin; i < end; ++i) {
+            float ox, oy, oz, ri;
+            mixedLanes<1>(s, t, tile, i, end, &ox, &oy, &oz, &ri);
+            float ax = 0, ay = 0, az = 0;
+            for (size_t j = j0; j < j1; ++j) {
+                float dx = s.x[j] + ox, dy = s.y[j] + oy, dz = s.z[j] + oz;
+                float r2 = dx * dx + dy * dy + dz * dz;
+                if (r2 < MIXED_MIN_DIST2) continue;
+                float eps = (ri + s.radius[j]) * soft;
+                float inv = 1.0f / std::sqrt(r2 + eps * eps);
+                float w = s.m[j] * inv * inv * inv;
+                ax += dx * w;
+                ay += dy * w;
+                az += dz * w;
+            }
+            gx[i] += ax;
+            gy[i] += ay;
+            gz[i] += az;
+        }
+    }
+}
+
+#ifdef PHYSPP_X86_DISPATCH
+// rsqrt_ps (12 bitów) + krok Newtona: ~23 bity, pełna precyzja float
+__attribute__((target("avx2,fma")))
+inline void fieldMixedAvx2(const MixedSources &s, const Targets &t, double *gx, double *gy, double *gz,
+                           size_t begin, size_t end) {
+    const __m256 half = _mm256_set1_ps(0.5f), threeHalves = _mm256_set1_ps(1.5f);
+    const __m256 soft = _mm256_set1_ps(float(SOFTENING)), minR2 = _mm256_set1_ps(MIXED_MIN_DIST2);
+    alignas(32) float lane[4][8], sum[3][8];
+
+    for (size_t j0 = 0, tile = 0; j0 < s.n; j0 += SOURCE_TILE, ++tile) {
+        size_t j1 = std::min(s.n, j0 + SOURCE_TILE);
+        for (size_t i0 = begin; i0 < end; i0 += 8) {
+            mixedLanes<8>(s, t, tile, i0, end, lane[0], lane[1], lane[2], lane[3]);
+            __m256 ox = _mm256_load_ps(lane[0]), oy = _mm256_load_ps(lane[1]), oz = _mm256_load_ps(lane[2]);
+            __m256 ri = _mm256_load_ps(lane[3]);
+            __m256 ax = _mm256_setzero_ps(), ay = _mm256_setzero_ps(), az = _mm256_setzero_ps();
+
+            for (size_t j = j0; j < j1; ++j) {
+                __m256 dx = _mm256_add_ps(_mm256_set1_ps(s.x[j]), ox);
+                __m256 dy = _mm256_add_ps(_mm256_set1_ps(s.y[j]), oy);
+                __m256 dz = _mm256_add_ps(_mm256_set1_ps(s.z[j]), oz);
+                __m256 r2 = _mm256_fmadd_ps(dx, dx, _mm256_fmadd_ps(dy, dy, _mm256_mul_ps(dz, dz)));
+                __m256 eps = _mm256_mul_ps(_mm256_add_ps(ri, _mm256_set1_ps(s.radius[j])), soft);
+                __m256 s2 = _mm256_fmadd_ps(eps, eps, r2);
+                __m256 y = _mm256_rsqrt_ps(s2);
+                y = _mm256_mul_ps(y, _mm256_fnmadd_ps(_mm256_mul_ps(_mm256_mul_ps(half, s2), y), y, threeHalves));
+                __m256 w = _mm256_mul_ps(_mm256_set1_ps(s.m[j]), _mm256_mul_ps(y, _mm256_mul_ps(y, y)));
+                w = _mm256_and_ps(w, _mm256_cmp_ps(r2, minR2, _CMP_GE_OQ));
+                ax = _mm256_fmadd_ps(dx, w, ax);
+                ay = _mm256_fmadd_ps(dy, w, ay);
+                az = _mm256_fmadd_ps(dz, w, az);
+            }
+
+            _mm256_store_ps(sum[0], ax);
+            _mm256_store_ps(sum[1], ay);
+            _mm256_store_ps(sum[2], az);
+            for (size_t l = 0; l < std::min<size_t>(8, end - i0); ++l) {
+                gx[i0 + l] += sum[0][l];
+                gy[i0 + l] += sum[1][l];
+                gz[i0 + l] += sum[2][l];
+            }
+        }
+    }
+}
+
+// rsqrt14 + krok Newtona: pełna precyzja float
+__attribute__((target("avx512f")))
+inline void fieldMixedAvx512(const MixedSources &s, const Targets &t, double *gx, double *gy, double *gz,
+                             size_t begin, size_t end) {
+    const __m512 half = _mm512_set1_ps(0.5f), threeHalves = _mm512_set1_ps(1.5f);
+    const __m512 soft = _mm512_set1_ps(float(SOFTENING)), minR2 = _mm512_set1_ps(MIXED_MIN_DIST2);
+    alignas(64) float lane[4][16], sum[3][16];
+
+    for (size_t j0 = 0, tile = 0; j0 < s.n; j0 += SOURCE_TILE, ++tile) {
+        size_t j1 = std::min(s.n, j0 + SOURCE_TILE);
+        for (size_t i0 = begin; i0 < end; i0 += 16) {
+            mixedLanes<16>(s, t, tile, i0, end, lane[0], lane[1], lane[2], lane[3]);
+            __m512 ox = _mm512_load_ps(lane[0]), oy = _mm512_load_ps(lane[1]), oz = _mm512_load_ps(lane[2]);
+            __m512 ri = _mm512_load_ps(lane[3]);
+            __m512 ax = _mm512_setzero_ps(), ay = _mm512_setzero_ps(), az = _mm512_setzero_ps();
+
+            for (size_t j = j0; j < j1; ++j) {
+                __m512 dx = _mm512_add_ps(_mm512_set1_ps(s.x[j]), ox);
+                __m512 dy = _mm512_add_ps(_mm512_set1_ps(s.y[j]), oy);
+                __m512 dz = _mm512_add_ps(_mm512_set1_ps(s.z[j]), oz);
+                __m512 r2 = _mm512_fmadd_ps(dx, dx, _mm512_fmadd_ps(dy, dy, _mm512_mul_ps(dz, dz)));
+                __m512 eps = _mm512_mul_ps(_mm512_add_ps(ri, _mm512_set1_ps(s.radius[j])), soft);
+                __m512 s2 = _mm512_fmadd_ps(eps, eps, r2);
+                __m512 y = _mm512_maskz_rsqrt14_ps(0xFFFF, s2);
+                y = _mm512_mul_ps(y, _mm512_fnmadd_ps(_mm512_mul_ps(_mm512_mul_ps(half, s2), y), y, threeHalves));
+                __m512 w = _mm512_mul_ps(_mm512_set1_ps(s.m[j]), _mm512_mul_ps(y, _mm512_mul_ps(y, y)));
+                w = _mm512_maskz_mov_ps(_mm512_cmp_ps_mask(r2, minR2, _CMP_GE_OQ), w);
+                ax = _mm512_fmadd_ps(dx, w, ax);
+                ay = _mm512_fmadd_ps(dy, w, ay);
+                az = _mm512_fmadd_ps(dz, w, az);
+            }
+
+            _mm512_store_ps(sum[0], ax);
+            _mm512_store_ps(sum[1], ay);
+            _mm512_store_ps(sum[2], az);
+            for (size_t l = 0; l < std::min<size_t>(16, end - i0); ++l) {
+                gx[i0 + l] += sum[0][l];
+                gy[i0 + l] += sum[1][l];
+                gz[i0 + l] += sum[2][l];
+            }
+        }
+    }
+}
+#endif
+
+// Jak field(), ale ze źródeł przygotowanych przez prepareMixed()
+inline void fieldMixed(const MixedSources &s, const Targets &t, double *gx, double *gy, double *gz, size_t begin,
+                       size_t end, Isa isa = bestIsa()) {
+    std::fill(gx + begin, gx + end, 0.0);
+    std::fill(gy + begin, gy + end, 0.0);
+    std::fill(gz + begin, gz + end, 0.0);
+    if (begin >= end) return;
+    if (!isaSupported(isa)) isa = Isa::SCALAR;
+
+    switch (isa) {
+#ifdef PHYSPP_X86_DISPATCH
+        case Isa::AVX512:
+            fieldMixedAvx512(s, t, gx, gy, gz, begin, end);
+            break;
+        case Isa::AVX2:
+            fieldMixedAvx2(s, t, gx, gy, gz, begin, end);
+            break;
+#endif
+        default:
+            fieldMixedScalar(s, t, gx, gy, gz, begin, end);
+            break;
+    }
+
+    const double scale = Physics::G * s.mass / (s.length * s.length);
+    for (size_t i = begin; i < end; ++i) {
+        gx[i] *= scale;
+        gy[i] *= scale;
+        gz[i] *= scale;
+    }
+}
+}
@@ -1,5 +1,7 @@
 #pragma once
 #include "body.h"
+#include "body_store.h"
+#include "direct_gravity.h"
 #include "physics_body.h"
 #include "deterministic_engine.h"
 #include "forces.h"
@@ -12,13 +14,28 @@
 #include "thermodynamics.h"
 #include "electromagnetic_forces.h"
 #include "octree.h"
+#include "linear_octree.h"
+#include "fmm.h"
+#include "particle_mesh.h"
+#include "ks_regularization.h"
+#include "wisdom_holman.h"
+#include "ias15.h"
+#include "spatial_hash.h"
+#include "../core/object_pool.h"
+#include <array>
 #include <memory>
 #include <vector>
 #include <iostream>
 #include <algorithm>
+#include <chrono>
 #include <cmath>
+#include <unordered_map>
 
-enum class IntegratorType { EULER, VERLET, RK4, LEAPFROG, YOSHIDA4 };
+enum class IntegratorType {
+    EULER, VERLET, RK4, LEAPFROG, YOSHIDA4, HERMITE4, WISDOM_HOLMAN, IAS15, YOSHIDA6, YOSHIDA8
+};
+
+enum class GravitySolver { DIRECT, OCTREE, LINEAR_OCTREE, FMM, PM, TREEPM };
 
 enum class BodyFlags {
     NONE = 0,
@@ -34,6 +51,72 @@ struct BoundingBox {
     double size() const { return (max - min).length(); }
 };
 
+struct BlockStats {
+    size_t substeps = 0;     // chwile, w których ktoś był aktywny
+    size_t activeBodies = 0; // suma aktywnych ciał po wszystkich chwilach
+    int deepestLevel = 0;    // najdrobniejszy użyty poziom (krok dt / 2^level)
+};
+
+struct IAS15Stats {
+    size_t steps = 0;      // kroki wewnętrzne w ostatnim kroku
+    size_t rejected = 0;
+    size_t iterations = 0; // przebiegi predyktor-korektor (po 7 obliczeń sił) w ostatnim kroku
+    double timestep = 0;   // proponowany następny krok wewnętrzny
+};
+
+struct RegularizationStats {
+    size_t active = 0;   // pary regularyzowane w ostatnim kroku
+    size_t formed = 0;
+    size_t released = 0;
+};
+
+struct AllocationStats {
+    size_t bodies = 0;   // ciała utworzone przez silnik w ostatnim kroku
+    size_t recycled = 0; // w tym obiekty z puli
+    size_t heap = 0;     // alokacje ciał na stercie w ostatnim kroku; w stanie ustalonym 0
+    size_t scratch = 0;  // bajty, o które urosły bufory etapów kolizji w ostatnim kroku; w stanie ustalonym 0
+};
+
+struct EncounterStats {
+    size_t groups = 0;   // grupy bliskich spotkań w ostatnim kroku
+    size_t bodies = 0;
+    size_t substeps = 0; // kroki Bulirscha-Stoera w ostatnim kroku
+    size_t contacts = 0; // zetknięcia znalezione wewnątrz podkroków od początku symulacji
+};
+
+// Skąd pochodzi potencjał w Diagnostics: z pełnego przejścia jądra sił w położeniach końcowych
+// kroku, z drzewa (przy grawitacji drzewem - przybliżenie z tym samym theta) albo z osobnej sumy
+enum class PotentialSource { NONE, FORCE_PASS, TREE, DIRECT };
+
+// Wielkości zachowane dla stanu po ostatnim kroku; pęd i moment pędu względem początku układu.
+// Potencjał jest zmiękczony jak siły jądra bezpośredniego (bez zmiękczenia przy drzewie).
+struct Diagnostics {
+    double kinetic = 0, potential = 0, energy = 0;
+    double mass = 0;
+    Vec3 momentum, angularMomentum, centerOfMass;
+    BoundingBox bounds{};
+    size_t bodies = 0;
+    PotentialSource potentialSource = PotentialSource::NONE;
+};
+
+// Ciasna para prowadzona we współrzędnych KS; w kroku globalnym a jest środkiem masy pary,
+// a b nie ma masy ani nie jest całkowane
+struct RegularizedPair {
+    BodyPtr a, b;
+    size_t ia = 0, ib = 0;
+    double massA = 0, massB = 0;
+    int32_t flagsB = 0;
+    KS::State state;
+    KS::Tidal tidal;
+    double perturbation = 0;
+};
+
+struct GravityTimings {
+    double treeBuild = 0;
+    double treeWalk = 0;
+    Parallel::BalanceStats walkBalance;
+};
+
 inline constexpr int operator|(BodyFlags a, BodyFlags b) {
     return static_cast<int>(a) | static_cast<int>(b);
 }
@@ -43,18 +126,25 @@ inline constexpr int operator&(int a, BodyFlags b) {
 }
 
 class PhysicsEngine {
-    std::vector<BodyPtr> bodies;
+    BodyStore store;
     std::unique_ptr<DeterministicPhysicsEngine> deterministicEngine;
+    // Ciało magazynu dla każdego żywego ciała silnika deterministycznego, w kolejności jego listy -
+    // obiekty Body i uchwyty przeżywają kroki, zmieniają się tylko ich stany
+    std::vector<const PhysicsBody *> deterministicSources;
+    std::vector<BodyHandle> deterministicHandles;
     std::vector<Vec3> forces;
     IntegratorType integrator = IntegratorType::VERLET;
     bool useRelativistic = false;
     bool detectCollisions = true;
     bool useDeterministicPhysics = false;
+    // Wynik bit w bit niezależny od liczby wątków; zmienia tylko redukcje zależne od podziału pracy
+    bool reproducible = false;
+    uint64_t randomSeed = 0;
     bool useTidalForces = false;
     bool useMHD = false;
     bool useRadiativeTransfer = false;
     bool useParticleInteractions = false;
-    bool useOctree = false;
+    GravitySolver gravitySolver = GravitySolver::DIRECT;
     bool useConstraints = false;
     bool useSleeping = false;
     bool useAdaptiveTimestep = false;
@@ -62,6 +152,112 @@ class PhysicsEngine {
     double initialEnergy = 0;
     Vec3 initialMomentum;
     std::unique_ptr<Octree> octree;
+    std::unique_ptr<LinearOctree> linearOctree;
+    FastMultipole fmm;
+    size_t fmmLeafSize = 64;
+    ParticleMesh particleMesh;
+    double octreeTheta = 0.5;
+    size_t octreeBucketSize = 8;
+    unsigned treeThreads = Parallel::defaultThreads();
+    GravityTimings gravityTimings;
+    DirectGravity::Isa directIsa = DirectGravity::bestIsa();
+    size_t directKernelLimit = 20000;
+    bool useMixedPrecision = false;
+    DirectGravity::MixedSources mixedSources;
+    AlignedVector<double> fieldX, fieldY, fieldZ;
+    std::unique_ptr<Parallel::ThreadPool> pool = std::make_unique<Parallel::ThreadPool>(Parallel::defaultThreads());
+    std::vector<std::vector<Vec3> > threadForces;
+    std::vector<uint8_t> moving;
+    Integrators::SystemScratch integratorScratch;
+    // Podzbiór ciał, dla których evaluateForces() liczy siły (nullptr - wszystkie)
+    const uint8_t *forceTargets = nullptr;
+    std::vector<size_t> targetIndex;
+    AlignedVector<double> targetX, targetY, targetZ, targetRadius;
+    AlignedVector<double> targetVX, targetVY, targetVZ, jerkX, jerkY, jerkZ;
+    std::vector<Vec3> jerks;
+    double hermiteAccuracy = 0.02;
+    size_t forceEvaluations = 0;
+    // Stan, dla którego kończący kick-drift-kick policzył przyspieszenia w store.ax..; następny
+    // krok bierze je zamiast liczyć siły od nowa, jeśli pozycje, masy, promienie i zbiór ruchomych
+    // ciał są te same (zderzenia, dodanie ciała, kompaktowanie, edycja Body z zewnątrz to psują)
+    bool closingValid = false;
+    size_t closingRevision = 0;
+    AlignedVector<double> closingX, closingY, closingZ, closingMass, closingRadius;
+    std::vector<uint8_t> closingMoving;
+    bool useBlockTimesteps = false;
+    int blockLevels = 16;
+    double blockAccuracy = 0.01;
+    BlockStats blockStats;
+    std::vector<double> blockPos, blockVel, blockAcc;
+    std::vector<uint64_t> blockStart, blockTicks;
+    std::vector<uint8_t> blockActive;
+    bool useRegularization = false;
+    double regularizationFormPerturbation = 0.05;
+    double regularizationReleasePerturbation = 0.25;
+    std::vector<RegularizedPair> regularizedPairs;
+    RegularizationStats regularizationStats;
+    WisdomHolman::Coordinates wisdomHolmanCoordinates = WisdomHolman::Coordinates::JACOBI;
+    bool useWisdomHolmanCorrector = false;
+    // Stan po ostatnim kroku WISDOM_HOLMAN (z korektorem: wisdomHolmanMap - zmienne mapy) i jego
+    // ciała w kolejności Jacobiego; wisdomHolmanStep - krok, dla którego policzono korektor
+    WisdomHolman::System wisdomHolman, wisdomHolmanMap;
+    std::vector<size_t> wisdomHolmanIndex;
+    std::vector<const Body *> wisdomHolmanBodies;
+    std::vector<uint8_t> wisdomHolmanTargets;
+    double wisdomHolmanStep = 0;
+    bool useHybridEncounters = false;
+    double encounterHillRadii = 3;
+    EncounterStats encounterStats;
+    // Zetknięcia z podkroków ostatniego kroku (indeksy magazynu) do rozwiązania w checkCollisions()
+    std::vector<WisdomHolman::System::Contact> encounterContacts;
+    // Stan IAS15 między krokami i jego ciała (ruchome, w kolejności magazynu)
+    IAS15::State ias15;
+    std::vector<const Body *> ias15Bodies;
+    std::vector<size_t> ias15Index;
+    std::vector<double> ias15Pos, ias15Vel;
+    double ias15Tolerance = 1e-9;
+    IAS15Stats ias15Stats;
+    // Kandydaci do kolizji z siatki haszowanej i wersja składu magazynu, dla której ją zbudowano
+    SpatialHash::Broadphase collisionBroadphase;
+    size_t collisionRevision = SIZE_MAX;
+    // Ciała tworzone przez silnik (produkty kolizji) pochodzą z puli; bufory etapów kolizji
+    // żyją między krokami, więc w stanie ustalonym rozstrzyganie nie alokuje
+    ObjectPool<Body> bodyPool;
+    AllocationStats allocationStats;
+    std::vector<size_t> collisionParent;
+    std::vector<uint32_t> collisionComponent, collisionPairComponent, collisionBegin, collisionOrder, collisionFill;
+    std::vector<std::vector<BodyPtr> > spawnedBodies;
+    std::vector<std::pair<size_t, size_t> > contactPairs, collisionPairs;
+    std::vector<std::vector<std::pair<size_t, size_t> > > treeContacts;
+    std::vector<double> collisionMargins;
+    // Drzewo liniowe zbudowane w tym kroku może zastąpić siatkę (useTreeCollisions)
+    bool useTreeCollisions = true;
+    bool collisionTreeCurrent = false;
+    size_t treeCollisionChecks = 0;
+    // Położenia z początku kroku dla zderzeń po odcinkach ruchu (useContinuousCollisions)
+    bool useContinuousCollisions = false;
+    std::vector<double> sweepX, sweepY, sweepZ;
+    SpatialHash::Broadphase sweepBroadphase;
+    size_t sweptCollisions = 0;
+    struct SweptImpact {
+        double t;
+        size_t a, b;
+        bool operator<(const SweptImpact &o) const { return t < o.t || (t == o.t && (a < o.a || (a == o.a && b < o.b))); }
+    };
+    std::vector<double> sweptMidX, sweptMidY, sweptMidZ, sweptReach, sweptMargins, sweptTimes;
+    std::vector<std::pair<size_t, size_t> > sweptCandidates, sweptPairs;
+    std::vector<SweptImpact> sweptImpacts;
+    std::vector<uint8_t> sweptTouched;
+    // Diagnostyka liczona przy pierwszym odczycie po kroku, potem z pamięci. Gdy ktoś jej używa,
+    // pełne przejście jądra bezpośredniego liczy też potencjał (forcePotential) i zapamiętuje
+    // stan, dla którego go policzono - jeśli to stan końcowy kroku, suma par nie jest potrzebna.
+    mutable Diagnostics diagnostics;
+    mutable bool diagnosticsCurrent = false;
+    mutable bool trackPotential = false;
+    AlignedVector<double> forcePotential, potentialX, potentialY, potentialZ, potentialMass, potentialRadius;
+    mutable AlignedVector<double> diagnosticX, diagnosticY, diagnosticZ, diagnosticMass, diagnosticRadius;
+    mutable AlignedVector<double> diagnosticPhi, diagnosticGX, diagnosticGY, diagnosticGZ;
+    mutable std::unique_ptr<LinearOctree> diagnosticTree;
     bool finalized = false;
     double sleepThreshold = 1e-6;
     double minTimestep = 1e-3;
@@ -69,61 +265,228 @@ class PhysicsEngine {
     size_t stepCount = 0;
 
 public:
-    void add(BodyPtr body) {
-        bodies.push_back(body);
-        if (bodies.size() == 1) {
-            initialEnergy = ConservationLaws::totalEnergy(bodies);
-            initialMomentum = ConservationLaws::totalMomentum(bodies);
+    BodyHandle add(BodyPtr body) {
+        diagnosticsCurrent = false;
+        size_t i = store.add(body);
+        if (store.size() == 1) {
+            initialEnergy = ConservationLaws::totalEnergy(store.bodies());
+            initialMomentum = ConservationLaws::totalMomentum(store.bodies());
         }
+        return store.handleOf(i);
+    }
+
+    void setIntegrator(IntegratorType type) {
+        // Zapamiętane kroki i jerk pochodzą z innego schematu
+        if (type != integrator) std::fill(store.timestep.begin(), store.timestep.end(), 0.0);
+        integrator = type;
+        closingValid = false;
     }
 
-    void setIntegrator(IntegratorType type) { integrator = type; }
     void enableRelativistic(bool enable) { useRelativistic = enable; }
     void enableCollisions(bool enable) { detectCollisions = enable; }
+    // Przy LINEAR_OCTREE i FMM zetknięcia z drzewa grawitacji zamiast osobnej siatki
+    void enableTreeCollisions(bool enable) { useTreeCollisions = enable; }
+    // Zderzenia także dla par, które w trakcie kroku przeleciały przez siebie (czas zetknięcia
+    // z ruchu po odcinkach); pozwala na dużo dłuższe kroki przy szybkich odłamkach
+    void enableContinuousCollisions(bool enable) { useContinuousCollisions = enable; }
 
     void enableDeterministicPhysics(bool enable) {
         useDeterministicPhysics = enable;
         if (enable && !deterministicEngine) {
             deterministicEngine = std::make_unique<DeterministicPhysicsEngine>();
+            deterministicEngine->setThreads(pool->size());
+            deterministicEngine->setPool(pool.get());
+            deterministicEngine->setSeed(randomSeed);
             syncToDeterministic();
         }
     }
 
-    void enableTidalForces(bool enable) { useTidalForces = enable; }
+    // Ten sam stan początkowy daje bitowo ten sam wynik na 1 i na 64 wątkach: pętla par sumuje
+    // w stałej liczbie części, FMM dzieli cele niezależnie od liczby wątków. Jądra liczone per
+    // cel, drzewa, zderzenia i diagnostyka mają stałą kolejność zawsze.
+    void enableReproducible(bool enable) {
+        reproducible = enable;
+        fmm.setReproducible(enable);
+    }
+    bool isReproducible() const { return reproducible; }
+
+    // Ziarno losowości zderzeń (odłamki, fotony); strumień zależy od ziarna, kroku i pary
+    void setRandomSeed(uint64_t seed) {
+        randomSeed = seed;
+        if (deterministicEngine) deterministicEngine->setSeed(seed);
+    }
+    uint64_t getRandomSeed() const { return randomSeed; }
+
+    void enableTidalForces(bool enable) {
+        useTidalForces = enable;
+        closingValid = false;
+    }
     void enableMHD(bool enable) { useMHD = enable; }
     void enableRadiativeTransfer(bool enable) { useRadiativeTransfer = enable; }
     void enableParticleInteractions(bool enable) { useParticleInteractions = enable; }
-    void enableOctree(bool enable) { useOctree = enable; }
+    void enableOctree(bool enable) { gravitySolver = enable ? GravitySolver::OCTREE : GravitySolver::DIRECT; }
+    // DIRECT, OCTREE, LINEAR_OCTREE i bliskie pole FMM stosują to samo zmiękczenie (r_i + r_j) * 0.01;
+    // PM wygładza siłę na skali komórki siatki, a krótkozasięgowa część TreePM jest niezmiękczona,
+    // więc bliskie przejścia w obu różnią się od DIRECT
+    void setGravitySolver(GravitySolver solver) {
+        gravitySolver = solver;
+        diagnosticsCurrent = false;
+        closingValid = false;
+    }
+    GravitySolver getGravitySolver() const { return gravitySolver; }
+
+    void setOctreeTheta(double theta) {
+        octreeTheta = theta;
+        if (octree) octree->setTheta(theta);
+        if (linearOctree) linearOctree->setTheta(theta);
+    }
+
+    void setOctreeBucketSize(size_t size) {
+        octreeBucketSize = size;
+        if (linearOctree) linearOctree->setBucketSize(size);
+    }
+
+    void setTreeThreads(unsigned threads) {
+        treeThreads = std::max(1u, threads);
+        if (linearOctree) linearOctree->setThreads(treeThreads);
+        fmm.setThreads(treeThreads);
+        particleMesh.setThreads(treeThreads);
+    }
+
+    // Wątki puli silnika; solvery drzewiaste i PM dostają tę samą liczbę
+    void setThreads(unsigned threads) {
+        pool->resize(threads);
+        setTreeThreads(threads);
+        if (deterministicEngine) deterministicEngine->setThreads(threads);
+    }
+
+    unsigned getThreads() const { return pool->size(); }
+
+    void setFmmOrder(int order) { fmm.setOrder(order); }
+    void setFmmTheta(double theta) { fmm.setTheta(theta); }
+    void setFmmLeafSize(size_t size) { fmmLeafSize = std::max<size_t>(1, size); }
+    const FmmStats &getFmmStats() const { return fmm.getStats(); }
+
+    void setPmGridSize(size_t size) { particleMesh.setGridSize(size); }
+    void setPmBoundary(MeshBoundary boundary, Vec3 boxMin = Vec3(0, 0, 0), double boxSize = 0) {
+        particleMesh.setBoundary(boundary);
+        particleMesh.setPeriodicBox(boxMin, boxSize);
+    }
+    void setPmSplitScale(double cells) { particleMesh.setSplitScale(cells); }
+    const PmStats &getPmStats() const { return particleMesh.getStats(); }
+
+    // Powyżej limitu suma bezpośrednia zostaje przy dokładnej pętli par (odniesienie dla drzew)
+    void setDirectKernelLimit(size_t n) { directKernelLimit = n; }
+    void setDirectIsa(DirectGravity::Isa isa) { directIsa = isa; }
+    DirectGravity::Isa getDirectIsa() const { return directIsa; }
+    // Jądro bezpośrednie we float na współrzędnych względem kafelków (akumulacja w double);
+    // błąd względny siły rzędu 1e-6, potencjał i jerk zostają w double
+    void enableMixedPrecision(bool enable) {
+        useMixedPrecision = enable;
+        closingValid = false;
+    }
+    bool isMixedPrecision() const { return useMixedPrecision; }
+
+    double getOctreeTheta() const { return octreeTheta; }
+    const GravityTimings &getGravityTimings() const { return gravityTimings; }
     void enableConstraints(bool enable) { useConstraints = enable; }
     void enableSleeping(bool enable) { useSleeping = enable; }
     void enableAdaptiveTimestep(bool enable) { useAdaptiveTimestep = enable; }
     void setTimeScale(double scale) { timeScale = scale; }
     void setSleepThreshold(double threshold) { sleepThreshold = threshold; }
 
+    // Każde ciało idzie własnym krokiem dt / 2^k (k <= levels), dobieranym kryterium
+    // eta * |a| / |da/dt|; siły liczone są tylko dla ciał, których krok właśnie się kończy
+    void enableBlockTimesteps(bool enable) { useBlockTimesteps = enable; }
+    void setBlockTimestepLevels(int levels) { blockLevels = std::clamp(levels, 0, 40); }
+    void setBlockAccuracy(double eta) { blockAccuracy = eta; }
+    // Parametr eta kryterium Aarsetha dla HERMITE4
+    void setHermiteAccuracy(double eta) { hermiteAccuracy = eta; }
+    const BlockStats &getBlockStats() const { return blockStats; }
+
+    // Ciasne pary związane (czas dynamiczny sqrt(r^3 / GM) krótszy od kroku, słabo zaburzone)
+    // idą jako jedna cząstka w środku masy, a ich ruch względny w regularyzacji KS. Para się
+    // rozpada, gdy przestaje być związana albo przewidywane w kroku zaburzenie |P| / |a|
+    // przekroczy release.
+    void enableRegularization(bool enable) { useRegularization = enable; }
+    void setRegularizationPerturbation(double form, double release) {
+        regularizationFormPerturbation = form;
+        regularizationReleasePerturbation = std::max(form, release);
+    }
+    const RegularizationStats &getRegularizationStats() const { return regularizationStats; }
+
+    // WISDOM_HOLMAN: ruch keplerowski wokół najcięższego ciała jest rozwiązywany dokładnie, reszta
+    // sił działa jako kick. Podział Jacobiego (domyślny) albo demokratyczno-heliocentryczny;
+    // korektor 3. rzędu kosztuje 4 dodatkowe obliczenia sił na krok, ale zbija błąd o rzędy.
+    void setWisdomHolmanCoordinates(WisdomHolman::Coordinates coordinates) {
+        wisdomHolmanCoordinates = coordinates;
+        wisdomHolmanBodies.clear();
+    }
+    void enableWisdomHolmanCorrector(bool enable) {
+        useWisdomHolmanCorrector = enable;
+        wisdomHolmanBodies.clear();
+    }
+
+    // Tryb hybrydowy WISDOM_HOLMAN (jak MERCURY): pary, które w kroku mogą zbliżyć się na kilka
+    // promieni Hilla, mają bliską część oddziaływania całkowaną Bulirschem-Stoerem razem z ruchem
+    // keplerowskim; reszta układu zostaje na mapie. Wymusza współrzędne demokratyczno-heliocentryczne
+    // i wyłącza korektor.
+    void enableHybridEncounters(bool enable) {
+        useHybridEncounters = enable;
+        wisdomHolmanBodies.clear();
+    }
+    void setEncounterHillRadii(double hillRadii) { encounterHillRadii = hillRadii; }
+    const EncounterStats &getEncounterStats() const { return encounterStats; }
+
+    // IAS15: krok wewnętrzny dobierany tak, żeby b6 / |a| nie przekraczało epsilon (domyślnie 1e-9,
+    // co w praktyce daje błąd na poziomie zaokrągleń)
+    void setIAS15Tolerance(double epsilon) { ias15Tolerance = epsilon; }
+    const IAS15Stats &getIAS15Stats() const { return ias15Stats; }
+
+    // Liczba ciał, dla których policzono siłę, od początku symulacji
+    size_t getForceEvaluationCount() const { return forceEvaluations; }
+
     void setTimestepRange(double minDt, double maxDt) {
         minTimestep = minDt;
         maxTimestep = maxDt;
     }
 
     BodyPtr createBody() {
-        auto body = std::make_shared<Body>(Vec3(), Vec3(), 1.0, 1.0);
-        bodies.push_back(body);
+        diagnosticsCurrent = false;
+        auto body = bodyPool.make(Vec3(), Vec3(), 1.0, 1.0);
+        store.add(body);
         return body;
     }
 
     void finalize() {
         finalized = true;
-        forces.resize(bodies.size());
-        if (bodies.size() > 0) {
-            initialEnergy = ConservationLaws::totalEnergy(bodies);
-            initialMomentum = ConservationLaws::totalMomentum(bodies);
+        forces.resize(store.size());
+        diagnosticsCurrent = false;
+        if (store.size() > 0) {
+            initialEnergy = getDiagnostics().energy;
+            initialMomentum = getDiagnostics().momentum;
         }
     }
 
-    BoundingBox getBoundingBox() const {
-        if (bodies.empty()) return {{0, 0, 0}, {0, 0, 0}};
-        Vec3 minPos = bodies[0]->pos;
-        Vec3 maxPos = bodies[0]->pos;
+    // Z pamięci do następnego kroku, add() lub finalize(); po ręcznej zmianie obiektów Body
+    // między krokami trzeba wołać invalidateDiagnostics()
+    const Diagnostics &getDiagnostics() const {
+        if (!diagnosticsCurrent) computeDiagnostics();
+        return diagnostics;
+    }
+
+    void invalidateDiagnostics() { diagnosticsCurrent = false; }
+
+    BoundingBox getBoundingBox() const { return getDiagnostics().bounds; }
+
+private:
+    // Obwiednia bieżących obiektów Body, bez pamięci - w trakcie kroku
+    BoundingBox currentBounds() const {
+        const auto &bodies = store.bodies();
+        auto first = std::find_if(bodies.begin(), bodies.end(), [](const BodyPtr &b) { return !b->destroyed; });
+        if (first == bodies.end()) return {{0, 0, 0}, {0, 0, 0}};
+        Vec3 minPos = (*first)->pos;
+        Vec3 maxPos = (*first)->pos;
         for (const auto &b: bodies) {
             if (b->destroyed) continue;
             minPos.x = std::min(minPos.x, b->pos.x);
@@ -136,173 +499,1637 @@ public:
         return {minPos, maxPos};
     }
 
-    const std::vector<BodyPtr> &getBodies() const { return bodies; }
+    // Jedno przejście po obiektach Body (energia kinetyczna, pędy, środek masy, obwiednia) w
+    // stałych porcjach, więc sumy nie zależą od liczby wątków; potem potencjał
+    void computeDiagnostics() const {
+        constexpr size_t CHUNKS = 64;
+        struct Partial {
+            double kinetic = 0, mass = 0;
+            Vec3 momentum, angular, weighted, min, max;
+            size_t bodies = 0;
+        };
+        const auto &bodies = store.bodies();
+        size_t n = bodies.size();
+        for (auto *v: {&diagnosticX, &diagnosticY, &diagnosticZ, &diagnosticMass, &diagnosticRadius}) v->resize(n);
+        std::array<Partial, CHUNKS> partial{};
+        pool->forRange(0, CHUNKS, [&](size_t begin, size_t end, size_t) {
+            for (size_t c = begin; c < end; ++c) {
+                Partial &p = partial[c];
+                for (size_t i = n * c / CHUNKS; i < n * (c + 1) / CHUNKS; ++i) {
+                    const Body &b = *bodies[i];
+                    diagnosticX[i] = b.pos.x;
+                    diagnosticY[i] = b.pos.y;
+                    diagnosticZ[i] = b.pos.z;
+                    // Nagrobki jak w magazynie: bez masy i promienia
+                    diagnosticMass[i] = b.destroyed ? 0 : b.mass;
+                    diagnosticRadius[i] = b.destroyed ? 0 : b.radius;
+                    if (b.destroyed) continue;
+                    p.kinetic += b.kineticEnergy();
+                    p.mass += b.mass;
+                    p.momentum += b.momentum();
+                    p.angular += b.pos.cross(b.momentum());
+                    p.weighted += b.pos * b.mass;
+                    if (p.bodies++ == 0) p.min = p.max = b.pos;
+                    p.min = Vec3(std::min(p.min.x, b.pos.x), std::min(p.min.y, b.pos.y), std::min(p.min.z, b.pos.z));
+                    p.max = Vec3(std::max(p.max.x, b.pos.x), std::max(p.max.y, b.pos.y), std::max(p.max.z, b.pos.z));
+                }
+            }
+        }, 1);
+
+        Diagnostics d;
+        for (const Partial &p: partial) {
+            if (p.bodies == 0) continue;
+            if (d.bodies == 0) d.bounds = {p.min, p.max};
+            d.bounds.min = Vec3(std::min(d.bounds.min.x, p.min.x), std::min(d.bounds.min.y, p.min.y),
+                                std::min(d.bounds.min.z, p.min.z));
+            d.bounds.max = Vec3(std::max(d.bounds.max.x, p.max.x), std::max(d.bounds.max.y, p.max.y),
+                                std::max(d.bounds.max.z, p.max.z));
+            d.kinetic += p.kinetic;
+            d.mass += p.mass;
+            d.momentum += p.momentum;
+            d.angularMomentum += p.angular;
+            d.centerOfMass += p.weighted;
+            d.bodies += p.bodies;
+        }
+        if (d.mass > 0) d.centerOfMass = d.centerOfMass / d.mass;
+        d.potential = diagnosticPotential(d.potentialSource);
+        d.energy = d.kinetic + d.potential;
+        diagnostics = d;
+        diagnosticsCurrent = true;
+        trackPotential = true;
+    }
+
+    // U = 1/2 sum_i m_i phi_i po stanie w diagnosticX..; źródło w source
+    double diagnosticPotential(PotentialSource &source) const {
+        size_t n = diagnosticX.size();
+        source = PotentialSource::NONE;
+        if (n < 2) return 0;
+
+        bool current = forcePotential.size() == n && potentialX.size() == n;
+        for (size_t i = 0; current && i < n; ++i) {
+            current = potentialX[i] == diagnosticX[i] && potentialY[i] == diagnosticY[i] &&
+                      potentialZ[i] == diagnosticZ[i] && potentialMass[i] == diagnosticMass[i] &&
+                      potentialRadius[i] == diagnosticRadius[i];
+        }
+
+        diagnosticPhi.resize(n);
+        if (current) {
+            source = PotentialSource::FORCE_PASS;
+            std::copy(forcePotential.begin(), forcePotential.end(), diagnosticPhi.begin());
+        } else if (gravitySolver != GravitySolver::DIRECT) {
+            source = PotentialSource::TREE;
+            if (!diagnosticTree) diagnosticTree = std::make_unique<LinearOctree>();
+            diagnosticTree->setTheta(octreeTheta);
+            diagnosticTree->setThreads(treeThreads);
+            diagnosticTree->setPool(pool.get());
+            diagnosticTree->build(diagnosticX.data(), diagnosticY.data(), diagnosticZ.data(), diagnosticMass.data(), n,
+                                  diagnosticRadius.data());
+            pool->forRange(0, n, [&](size_t begin, size_t end, size_t) {
+                for (size_t i = begin; i < end; ++i) {
+                    diagnosticPhi[i] = diagnosticMass[i] > 0
+                                           ? diagnosticTree->potential(Vec3(diagnosticX[i], diagnosticY[i], diagnosticZ[i]),
+                                                                        diagnosticRadius[i])
+                                           : 0;
+                }
+            }, 64);
+        } else {
+            source = PotentialSource::DIRECT;
+            for (auto *v: {&diagnosticGX, &diagnosticGY, &diagnosticGZ}) v->resize(n);
+            DirectGravity::Sources sources{diagnosticX.data(), diagnosticY.data(), diagnosticZ.data(),
+                                           diagnosticMass.data(), diagnosticRadius.data(), n};
+            pool->forRange(0, n, [&](size_t begin, size_t end, size_t) {
+                DirectGravity::field(sources, diagnosticGX.data(), diagnosticGY.data(), diagnosticGZ.data(), begin, end,
+                                     directIsa, diagnosticPhi.data());
+            }, targetGrain(n));
+        }
+
+        // Stałe porcje - suma nie zależy od liczby wątków
+        constexpr size_t CHUNKS = 64;
+        std::array<double, CHUNKS> partial{};
+        pool->forRange(0, CHUNKS, [&](size_t begin, size_t end, size_t) {
+            for (size_t c = begin; c < end; ++c) {
+                for (size_t i = n * c / CHUNKS; i < n * (c + 1) / CHUNKS; ++i) {
+                    partial[c] += diagnosticMass[i] * diagnosticPhi[i];
+                }
+            }
+        }, 1);
+        double sum = 0;
+        for (double p: partial) sum += p;
+        return 0.5 * sum;
+    }
+
+public:
+    // Zawiera też zniszczone ciała (nagrobki) do najbliższego kompaktowania - indeks i
+    // pozostaje ważny tylko do niego, trwałe odwołanie daje getHandle(i)
+    const std::vector<BodyPtr> &getBodies() const { return store.bodies(); }
+    size_t getBodyCount() const { return store.live(); }
+    BodyHandle getHandle(size_t i) const { return store.handleOf(i); }
+    // Ciało uchwytu albo nullptr, gdy zostało zniszczone
+    BodyPtr findBody(BodyHandle handle) const { return store.find(handle); }
+    size_t indexOf(BodyHandle handle) const { return store.indexOf(handle); }
+    // Udział nagrobków, po którym tablice są kompaktowane (domyślnie 1/8; 0 - po każdym kroku z usunięciem)
+    void setCompactionThreshold(double fraction) { store.setCompactionThreshold(fraction); }
+    size_t getCompactionCount() const { return store.compactionCount(); }
+    BodyStore &getStore() { return store; }
+    const BodyStore &getStore() const { return store; }
+    BodyRef getBody(size_t i) { return store.ref(i); }
+    const std::vector<Vec3> &getForces() const { return forces; }
     size_t getStepCount() const { return stepCount; }
 
+    // Siły dla bieżącego stanu obiektów Body (wywołanie spoza step())
     void computeForces() {
-        if (forces.size() != bodies.size()) {
-            forces.resize(bodies.size());
+        store.gather();
+        evaluateForces();
+    }
+
+    // Siły dla stanu w tablicach magazynu; forces[i] odpowiada ciału i w store. Z maską targets
+    // liczone są tylko siły ciał z targets[i] != 0 (reszta zostaje zerem), ale źródłami dalej są
+    // wszystkie ciała. PM i FMM i tak liczą pole całego układu naraz.
+    void evaluateForces(const uint8_t *targets = nullptr) {
+        beginForces(targets);
+
+        // Drzewo liczy tylko grawitację newtonowską - poprawki PN zostają przy sumowaniu par
+        if (gravitySolver != GravitySolver::DIRECT && !useRelativistic) {
+            computeTreeGravity();
+        } else {
+            computeDirectGravity();
+        }
+
+        if (useMHD || useParticleInteractions || useRadiativeTransfer) computeExtraForces();
+        forceTargets = nullptr;
+    }
+
+    // Jak evaluateForces(), ale grawitacja zawsze z sumy bezpośredniej, razem z pochodną
+    // przyspieszenia jerks[i] (HERMITE4). Pływy i siły dodatkowe wchodzą bez wkładu do jerku.
+    void evaluateForcesWithJerk(const uint8_t *targets = nullptr) {
+        beginForces(targets);
+        jerks.assign(store.size(), Vec3(0, 0, 0));
+        computeDirectJerk();
+        if (useMHD || useParticleInteractions || useRadiativeTransfer) computeExtraForces();
+        forceTargets = nullptr;
+    }
+
+    void beginForces(const uint8_t *targets) {
+        if (forces.size() != store.size()) {
+            forces.resize(store.size());
         }
         std::fill(forces.begin(), forces.end(), Vec3(0, 0, 0));
+        forceTargets = targets;
+        for (size_t i = 0; i < store.size(); ++i) {
+            if (isTarget(i)) ++forceEvaluations;
+        }
+    }
 
-        for (size_t i = 0; i < bodies.size(); ++i) {
-            auto &body = bodies[i];
-            if (!body || body->destroyed || body->flags & 3) continue;
+    bool isTarget(size_t i) const { return !(store.flags[i] & 3) && (!forceTargets || forceTargets[i]); }
 
-            for (size_t j = i + 1; j < bodies.size(); ++j) {
-                auto &other = bodies[j];
-                if (!other || other->destroyed) continue;
+    void computeExtraForces() {
+        pool->forRange(0, store.size(), [&](size_t begin, size_t end, size_t) {
+            for (size_t i = begin; i < end; ++i) {
+                if (!isTarget(i)) continue;
+                Vec3 vel = store.vel(i);
 
-                Vec3 force = useRelativistic
-                                 ? Forces::relativisticGravity(*body, *other)
-                                 : Forces::gravity(*body, *other);
+                if (useMHD) {
+                    Vec3 B(0, 0, 1e-4);
+                    forces[i] += MHD::lorentzForce(vel, B, 1e-10);
+                }
 
-                forces[i] += force;
-                forces[j] -= force;
+                if (useParticleInteractions) {
+                    forces[i] += ParticleInteractions::viscousForce(vel, 0.01, 1e-10);
+                }
 
-                if (useTidalForces) {
-                    Vec3 tidal = Forces::tidalForce(*body, *other);
-                    forces[i] += tidal;
+                if (useRadiativeTransfer) {
+                    double cooling = RadiativeTransfer::radiativeCooling(1e-10, 1e7);
+                    forces[i] += vel * (-cooling * 1e-20);
                 }
             }
+        }, 4096);
+    }
+
+    // Liczba celów na kawałek pracy, gdy każdy cel kosztuje n oddziaływań (~64k par na kawałek)
+    static size_t targetGrain(size_t n) { return std::max<size_t>(16, (size_t(1) << 16) / std::max<size_t>(1, n)); }
+
+    unsigned pairThreads(size_t n) const { return n < 256 ? 1 : pool->size(); }
+    static constexpr unsigned REPRODUCIBLE_PARTS = 64;
+
+    // Wiersze [0, n) pętli i < j podzielone na parts części o zbliżonej liczbie par
+    static std::vector<size_t> triangleBounds(size_t n, unsigned parts) {
+        std::vector<size_t> bounds(parts + 1, n);
+        bounds[0] = 0;
+        double total = 0.5 * double(n) * double(n > 0 ? n - 1 : 0), pairs = 0;
+        unsigned k = 1;
+        for (size_t i = 0; i < n && k < parts; ++i) {
+            pairs += double(n - 1 - i);
+            while (k < parts && pairs >= total * k / parts) bounds[k++] = i + 1;
+        }
+        return bounds;
+    }
+
+    // To samo co Forces::gravity(a, b), ale prosto z tablic
+    Vec3 pairGravity(size_t i, size_t j) const {
+        double dx = store.px[j] - store.px[i];
+        double dy = store.py[j] - store.py[i];
+        double dz = store.pz[j] - store.pz[i];
+        double dist = std::sqrt(dx * dx + dy * dy + dz * dz);
+        if (dist < 1e-10) return Vec3();
+
+        double softening = (store.radius[i] + store.radius[j]) * 0.01;
+        double distSoft = std::sqrt(dist * dist + softening * softening);
+        double s = Physics::G * store.mass[i] * store.mass[j] / (distSoft * distSoft * distSoft);
+        return Vec3(dx * s, dy * s, dz * s);
+    }
+
+    // Forces::tidalForce(a, b) na tablicach
+    Vec3 pairTidal(size_t i, size_t j) const {
+        double dx = store.px[j] - store.px[i];
+        double dy = store.py[j] - store.py[i];
+        double dz = store.pz[j] - store.pz[i];
+        double dist = std::sqrt(dx * dx + dy * dy + dz * dz);
+        if (dist < 1e-10) return Vec3();
+
+        double tidal = 2.0 * Physics::G * store.mass[j] * store.radius[i] / (dist * dist * dist * dist);
+        return Vec3(dx * tidal, dy * tidal, dz * tidal);
+    }
+
+    // Forces::relativisticGravity(a, b) na tablicach: etapy integratora i podkroki IAS15 zmieniają
+    // tylko tablice, a obiekty Body odświeża dopiero scatter()
+    Vec3 pairRelativistic(size_t i, size_t j) const {
+        Vec3 r = store.pos(j) - store.pos(i);
+        double dist = r.length();
+        if (dist < 1e-10) return Vec3();
+
+        const double c = Physics::C;
+        double rs = 2.0 * Physics::G * store.mass[j] / (c * c);
+        if (dist < rs * 1.5) return Vec3();
+
+        double v = store.vel(i).length();
+        double beta = v / c;
+        double gamma = 1.0 / std::sqrt(1.0 - beta * beta);
+
+        double pn = 1.0 + (3.0 * v * v / (c * c)) + (4.0 * Physics::G * store.mass[j] / (dist * c * c));
+        double force = Physics::G * store.mass[i] * store.mass[j] / (dist * dist) * pn;
+        Vec3 frameDrag = Vec3(-r.y, r.x, 0) * (2.0 * Physics::G * store.mass[j] / (c * c * dist * dist));
+        return (r.normalized() * force + frameDrag) * gamma;
+    }
 
-            if (useMHD) {
-                Vec3 B(0, 0, 1e-4);
-                forces[i] += MHD::lorentzForce(body->vel, B, 1e-10);
+    // Pływy działające na ciało i od wszystkich pozostałych - ta sama suma w każdej ścieżce sił
+    Vec3 tidalSum(size_t i) const {
+        Vec3 sum;
+        for (size_t j = 0; j < store.size(); ++j) {
+            if (j != i) sum += pairTidal(i, j);
+        }
+        return sum;
+    }
+
+    // Pole grawitacyjne wszystkich ciał jądrem wektorowym -> fieldX/Y/Z
+    void computeDirectField() {
+        size_t n = store.size();
+        fieldX.resize(n);
+        fieldY.resize(n);
+        fieldZ.resize(n);
+        DirectGravity::Sources sources{store.px.data(), store.py.data(), store.pz.data(),
+                                       store.mass.data(), store.radius.data(), n};
+        if (useMixedPrecision) {
+            // Potencjał z tego przejścia byłby we float - diagnostyka policzy go sama
+            potentialX.clear();
+            DirectGravity::prepareMixed(sources, mixedSources);
+            DirectGravity::Targets targets{sources.x, sources.y, sources.z, sources.radius};
+            pool->forRange(0, n, [&](size_t begin, size_t end, size_t) {
+                DirectGravity::fieldMixed(mixedSources, targets, fieldX.data(), fieldY.data(), fieldZ.data(), begin,
+                                          end, directIsa);
+            }, targetGrain(n));
+            return;
+        }
+        // Potencjał przy okazji: kilka działań na parę zamiast osobnej sumy O(N^2) w diagnostyce
+        double *phi = nullptr;
+        if (trackPotential) {
+            forcePotential.resize(n);
+            phi = forcePotential.data();
+            potentialX.assign(store.px.begin(), store.px.end());
+            potentialY.assign(store.py.begin(), store.py.end());
+            potentialZ.assign(store.pz.begin(), store.pz.end());
+            potentialMass.assign(store.mass.begin(), store.mass.end());
+            potentialRadius.assign(store.radius.begin(), store.radius.end());
+        }
+        pool->forRange(0, n, [&](size_t begin, size_t end, size_t) {
+            DirectGravity::field(sources, fieldX.data(), fieldY.data(), fieldZ.data(), begin, end, directIsa, phi);
+        }, targetGrain(n));
+    }
+
+    // Cele bieżącego obliczenia sił w ciągłych tablicach; wyniki k-tego celu należą do ciała
+    // targetIndex[k]
+    void gatherTargets() {
+        targetIndex.clear();
+        for (size_t i = 0; i < store.size(); ++i) {
+            if (isTarget(i)) targetIndex.push_back(i);
+        }
+        size_t m = targetIndex.size();
+        for (auto *v: {&targetX, &targetY, &targetZ, &targetRadius, &targetVX, &targetVY, &targetVZ}) v->resize(m);
+        for (size_t k = 0; k < m; ++k) {
+            size_t i = targetIndex[k];
+            targetX[k] = store.px[i];
+            targetY[k] = store.py[i];
+            targetZ[k] = store.pz[i];
+            targetRadius[k] = store.radius[i];
+            targetVX[k] = store.vx[i];
+            targetVY[k] = store.vy[i];
+            targetVZ[k] = store.vz[i];
+        }
+    }
+
+    // Pole jądrem wektorowym tylko w wybranych celach
+    void computeTargetField() {
+        size_t n = store.size();
+        gatherTargets();
+        size_t m = targetIndex.size();
+        for (auto *v: {&fieldX, &fieldY, &fieldZ}) v->resize(m);
+
+        DirectGravity::Sources sources{store.px.data(), store.py.data(), store.pz.data(),
+                                       store.mass.data(), store.radius.data(), n};
+        DirectGravity::Targets targets{targetX.data(), targetY.data(), targetZ.data(), targetRadius.data()};
+        if (useMixedPrecision) DirectGravity::prepareMixed(sources, mixedSources);
+        pool->forRange(0, m, [&](size_t begin, size_t end, size_t) {
+            if (useMixedPrecision) {
+                DirectGravity::fieldMixed(mixedSources, targets, fieldX.data(), fieldY.data(), fieldZ.data(), begin,
+                                          end, directIsa);
+            } else {
+                DirectGravity::field(sources, targets, fieldX.data(), fieldY.data(), fieldZ.data(), begin, end,
+                                     directIsa);
             }
+        }, targetGrain(n));
+    }
 
-            if (useParticleInteractions) {
-                forces[i] += ParticleInteractions::viscousForce(body->vel, 0.01, 1e-10);
+    void computeDirectJerk() {
+        size_t n = store.size();
+        gatherTargets();
+        size_t m = targetIndex.size();
+        for (auto *v: {&fieldX, &fieldY, &fieldZ, &jerkX, &jerkY, &jerkZ}) v->resize(m);
+
+        DirectGravity::Sources sources{store.px.data(), store.py.data(), store.pz.data(),
+                                       store.mass.data(), store.radius.data(), n};
+        DirectGravity::Velocities sourceVel{store.vx.data(), store.vy.data(), store.vz.data()};
+        DirectGravity::Targets targets{targetX.data(), targetY.data(), targetZ.data(), targetRadius.data()};
+        DirectGravity::Velocities targetVel{targetVX.data(), targetVY.data(), targetVZ.data()};
+        pool->forRange(0, m, [&](size_t begin, size_t end, size_t) {
+            DirectGravity::fieldJerk(sources, sourceVel, targets, targetVel, fieldX.data(), fieldY.data(),
+                                     fieldZ.data(), jerkX.data(), jerkY.data(), jerkZ.data(), begin, end);
+            for (size_t k = begin; k < end; ++k) {
+                size_t i = targetIndex[k];
+                forces[i] += Vec3(fieldX[k], fieldY[k], fieldZ[k]) * store.mass[i];
+                jerks[i] = Vec3(jerkX[k], jerkY[k], jerkZ[k]);
+                if (useTidalForces) forces[i] += tidalSum(i);
             }
+        }, targetGrain(n));
+    }
 
-            if (useRadiativeTransfer) {
-                double cooling = RadiativeTransfer::radiativeCooling(1e-10, 1e7);
-                forces[i] += body->vel * (-cooling * 1e-20);
+    void computeDirectGravity() {
+        size_t n = store.size();
+
+        auto addField = [&](size_t i, size_t k) {
+            forces[i] += Vec3(fieldX[k], fieldY[k], fieldZ[k]) * store.mass[i];
+            if (useTidalForces) forces[i] += tidalSum(i);
+        };
+
+        if (!useRelativistic && n <= directKernelLimit && forceTargets) {
+            computeTargetField();
+            pool->forRange(0, targetIndex.size(), [&](size_t begin, size_t end, size_t) {
+                for (size_t k = begin; k < end; ++k) addField(targetIndex[k], k);
+            }, targetGrain(n));
+            return;
+        }
+
+        if (!useRelativistic && n <= directKernelLimit) {
+            computeDirectField();
+            pool->forRange(0, n, [&](size_t begin, size_t end, size_t) {
+                for (size_t i = begin; i < end; ++i) {
+                    if (store.flags[i] & 3) continue;
+                    addField(i, i);
+                }
+            }, targetGrain(n));
+            return;
+        }
+
+        auto pair = [&](size_t i, size_t j) {
+            if (!useRelativistic) return pairGravity(i, j);
+            return store.alive[i] && store.alive[j] ? pairRelativistic(i, j) : Vec3();
+        };
+
+        // Przy części celów symetria i < j nic nie daje - każdy cel sumuje po wszystkich źródłach
+        if (forceTargets) {
+            pool->forRange(0, n, [&](size_t begin, size_t end, size_t) {
+                for (size_t i = begin; i < end; ++i) {
+                    if (!isTarget(i)) continue;
+                    for (size_t j = 0; j < n; ++j) {
+                        if (j != i) forces[i] += pair(i, j);
+                    }
+                    if (useTidalForces) forces[i] += tidalSum(i);
+                }
+            }, targetGrain(n));
+            return;
+        }
+
+        // Każda część trójkąta sumuje do własnej tablicy, więc forces[j] -= force nie ściga się
+        // z innymi. Zwykle część to wątek; w trybie powtarzalnym części jest stale
+        // REPRODUCIBLE_PARTS, a wątki biorą je po kolei - kolejność sum nie zależy od ich liczby.
+        unsigned parts = reproducible ? (n < 256 ? 1 : REPRODUCIBLE_PARTS) : pairThreads(n);
+        auto bounds = triangleBounds(n, parts);
+        threadForces.resize(parts);
+        // Część t pisze tylko do wierszy [bounds[t], n) - tylko te zeruje i tylko te trafiają do sumy
+        auto part = [&](unsigned t) {
+            size_t first = bounds[t];
+            auto &acc = threadForces[t];
+            acc.assign(n - first, Vec3(0, 0, 0));
+            // Ciała nieruchome (STATIC | NO_INTEGRATION) przyciągają jak w jądrze, ale same sił nie zbierają
+            for (size_t i = bounds[t]; i < bounds[t + 1]; ++i) {
+                bool freeI = !(store.flags[i] & 3);
+                for (size_t j = i + 1; j < n; ++j) {
+                    bool freeJ = !(store.flags[j] & 3);
+                    if (!freeI && !freeJ) continue;
+                    Vec3 force = pair(i, j);
+                    if (freeI) acc[i - first] += force;
+                    if (freeJ) acc[j - first] -= force;
+
+                    // Pływy nie są antysymetryczne - każde ciało pary dostaje swoje
+                    if (useTidalForces) {
+                        if (freeI) acc[i - first] += pairTidal(i, j);
+                        if (freeJ) acc[j - first] += pairTidal(j, i);
+                    }
+                }
             }
+        };
+        if (reproducible) {
+            pool->forRange(0, parts, [&](size_t begin, size_t end, size_t) {
+                for (size_t t = begin; t < end; ++t) part(unsigned(t));
+            }, 1);
+        } else {
+            pool->run(parts, part);
         }
+
+        pool->forRange(0, n, [&](size_t begin, size_t end, size_t) {
+            for (size_t i = begin; i < end; ++i) {
+                for (unsigned t = 0; t < parts && bounds[t] <= i; ++t) forces[i] += threadForces[t][i - bounds[t]];
+            }
+        }, 4096);
+    }
+
+    void computeTreeGravity() {
+        using Clock = std::chrono::high_resolution_clock;
+        auto start = Clock::now();
+
+        // Koszt ciała w drzewie mocno zależy od gęstości otoczenia: podział startowy według liczby
+        // oddziaływań z poprzedniego kroku, resztę wyrównuje podkradanie bloków
+        auto walk = [this](const auto &tree) {
+            pool->forBalanced(store.size(), store.work.data(), [&](size_t begin, size_t end, unsigned) {
+                for (size_t i = begin; i < end; ++i) {
+                    if (!isTarget(i)) continue;
+
+                    size_t interactions = 0;
+                    forces[i] += tree.computeForce(store.pos(i), store.mass[i], store.radius[i], &interactions);
+                    store.work[i] = uint32_t(std::min<size_t>(interactions, UINT32_MAX));
+                }
+            }, 32, &gravityTimings.walkBalance);
+        };
+
+        auto built = start;
+        if (gravitySolver == GravitySolver::PM || gravitySolver == GravitySolver::TREEPM) {
+            particleMesh.enableTreePM(gravitySolver == GravitySolver::TREEPM);
+            particleMesh.setTheta(octreeTheta);
+            particleMesh.setPool(pool.get());
+            particleMesh.compute(store.px.data(), store.py.data(), store.pz.data(), store.mass.data(), store.size());
+            for (size_t i = 0; i < store.size(); ++i) {
+                if (!isTarget(i)) continue;
+                forces[i] += particleMesh.acceleration(i) * store.mass[i];
+            }
+        } else if (gravitySolver == GravitySolver::LINEAR_OCTREE || gravitySolver == GravitySolver::FMM) {
+            if (!linearOctree) {
+                linearOctree = std::make_unique<LinearOctree>();
+                linearOctree->setTheta(octreeTheta);
+                linearOctree->setThreads(treeThreads);
+                linearOctree->setPool(pool.get());
+            }
+            bool useFmm = gravitySolver == GravitySolver::FMM;
+            linearOctree->setBucketSize(useFmm ? fmmLeafSize : octreeBucketSize);
+            linearOctree->build(store.px.data(), store.py.data(), store.pz.data(), store.mass.data(), store.size(),
+                                store.radius.data());
+            collisionTreeCurrent = true;
+            built = Clock::now();
+
+            if (useFmm) {
+                fmm.setPool(pool.get());
+                fmm.evaluate(*linearOctree);
+                const auto &index = linearOctree->getBodies().index;
+                for (size_t k = 0; k < index.size(); ++k) {
+                    size_t i = index[k];
+                    if (!isTarget(i)) continue;
+                    forces[i] += fmm.acceleration(k) * store.mass[i];
+                }
+            } else {
+                walk(*linearOctree);
+            }
+        } else {
+            // Drzewo wskaźnikowe czyta pozycje, masy i promienie z Body, a w trakcie kroku aktualne są tablice
+            // (etapy integratora, predykcja bloków, pary KS)
+            for (size_t i = 0; i < store.size(); ++i) {
+                if (!store.alive[i]) continue;
+                store.handle(i)->pos = store.pos(i);
+                store.handle(i)->mass = store.mass[i];
+                store.handle(i)->radius = store.radius[i];
+            }
+            BoundingBox box = currentBounds();
+            Vec3 extent = box.max - box.min;
+            double halfSize = std::max({extent.x, extent.y, extent.z}) * 0.5 * 1.001 + 1.0;
+            if (!octree) {
+                octree = std::make_unique<Octree>(box.center(), halfSize);
+                octree->setTheta(octreeTheta);
+            } else {
+                octree->setBounds(box.center(), halfSize);
+            }
+            octree->build(store.bodies());
+            built = Clock::now();
+            walk(*octree);
+        }
+
+        // Pływy dokładnie jak przy sumie bezpośredniej - solver zmienia tylko błąd grawitacji
+        if (useTidalForces) {
+            size_t n = store.size();
+            pool->forRange(0, n, [&](size_t begin, size_t end, size_t) {
+                for (size_t i = begin; i < end; ++i) {
+                    if (isTarget(i)) forces[i] += tidalSum(i);
+                }
+            }, targetGrain(n));
+        }
+
+        auto walked = Clock::now();
+        gravityTimings.treeBuild = std::chrono::duration<double>(built - start).count();
+        gravityTimings.treeWalk = std::chrono::duration<double>(walked - built).count();
     }
 
     void step(double dt) {
+        diagnosticsCurrent = false;
+        auto pooled = bodyPool.stats();
+        size_t heap = bodyHeapAllocations(), scratch = collisionScratchBytes();
+        auto countAllocations = [&] {
+            auto now = bodyPool.stats();
+            allocationStats = {now.created - pooled.created, now.recycled - pooled.recycled,
+                               bodyHeapAllocations() - heap, collisionScratchBytes() - scratch};
+        };
+
         if (useDeterministicPhysics && deterministicEngine) {
             deterministicEngine->step(dt);
             syncFromDeterministic();
+            countAllocations();
             return;
         }
 
 
         stepCount++;
 
-        if (useAdaptiveTimestep) {
-            dt = computeAdaptiveTimestep(dt);
+        // Krok liczy na tablicach; obiekty Body dostają wynik w scatter() na końcu
+        store.gather();
+        collisionTreeCurrent = false;
+        if (detectCollisions && useContinuousCollisions) {
+            sweepX.assign(store.px.begin(), store.px.end());
+            sweepY.assign(store.py.begin(), store.py.end());
+            sweepZ.assign(store.pz.begin(), store.pz.end());
+        }
+
+        // Poprawki PN działają na obiektach Body, gdzie para nie jest złożona w jedno ciało
+        bool regularize = useRegularization && !useRelativistic;
+        if (regularize) {
+            formRegularizedPairs(dt);
+        } else {
+            regularizedPairs.clear();
+        }
+
+        // Bloki i HERMITE4 liczą siły tylko z tablic; poprawki PN liczą się na obiektach Body
+        if ((useBlockTimesteps || integrator == IntegratorType::HERMITE4) && !useRelativistic) {
+            if (!useBlockTimesteps && useAdaptiveTimestep) {
+                dt = computeAdaptiveTimestep(dt);
+            }
+            integrateBlocks(dt, useBlockTimesteps ? blockLevels : 0);
+        } else {
+            // Przyspieszenia po wspólnym kroku nie muszą odpowiadać końcowym pozycjom
+            std::fill(store.timestep.begin(), store.timestep.end(), 0.0);
+            if (useAdaptiveTimestep) {
+                dt = computeAdaptiveTimestep(dt);
+            }
+            if (integrator == IntegratorType::IAS15) {
+                integrateIAS15(dt);
+            } else if (integrator == IntegratorType::WISDOM_HOLMAN && !useRelativistic) {
+                integrateWisdomHolman(dt);
+            } else {
+                integrate(dt);
+            }
+        }
+
+        if (regularize) {
+            advanceRegularizedPairs(dt);
         }
+        updateTrails();
 
-        if (forces.size() != bodies.size()) {
-            forces.resize(bodies.size());
+        if (detectCollisions) {
+            checkCollisions(dt);
+        } else {
+            encounterContacts.clear();
         }
 
-        computeForces();
+        // Ciała zabite w kroku zostają nagrobkami; tablice są kompaktowane dopiero po
+        // przekroczeniu progu, a uchwyty BodyHandle przeżywają i to
+        store.scatter();
+        countAllocations();
 
-        for (size_t i = 0; i < bodies.size(); ++i) {
-            auto &body = bodies[i];
-            if (!body || body->destroyed || body->flags & 3) continue;
+        if (store.size() != forces.size()) {
+            forces.resize(store.size());
+        }
+    }
 
-            if (useSleeping && body->vel.lengthSq() < sleepThreshold * sleepThreshold) {
-                body->flags |= 8;
+    // moving[i] = 1 dla ciał całkowanych w tym kroku; wolne ciała zasypiają (flaga 8)
+    void markMoving() {
+        size_t n = store.size();
+        moving.assign(n, 0);
+        for (size_t i = 0; i < n; ++i) {
+            if (store.flags[i] & 3) continue;
+            if (useSleeping && store.vel(i).lengthSq() < sleepThreshold * sleepThreshold) {
+                store.flags[i] |= 8;
                 continue;
             }
+            moving[i] = 1;
+        }
+    }
+
+    // Ślad i kolor zależą od stanu po całkowaniu, a przed kolizjami
+    void updateTrails() {
+        pool->forRange(0, store.size(), [&](size_t begin, size_t end, size_t) {
+            for (size_t i = begin; i < end; ++i) {
+                if (!moving[i]) continue;
+                Body &body = *store.handle(i);
+                if (body.showTrail || body.colorByVelocity) {
+                    store.scatterOne(i);
+                    if (body.showTrail) body.updateTrail();
+                    body.updateColorByVelocity();
+                }
+            }
+        }, 256);
+    }
 
-            auto forceFunc = [this, i](const Body &) { return forces[i]; };
+    // Jeden krok wybranego integratora dla całego układu; siły są przeliczane na każdym etapie
+    void integrate(double dt) {
+        size_t n = store.size();
+        markMoving();
+
+        Integrators::SystemState state{store.px.data(), store.py.data(), store.pz.data(),
+                                       store.vx.data(), store.vy.data(), store.vz.data(),
+                                       store.ax.data(), store.ay.data(), store.az.data(),
+                                       moving.data(), n};
+        auto loop = [this](size_t count, auto &&fn) {
+            pool->forRange(0, count, [&](size_t begin, size_t end, size_t) { fn(begin, end); }, 4096);
+        };
+        auto evaluate = [&] {
+            evaluateForces();
+            loop(n, [&](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; ++i) {
+                    if (moving[i]) store.setAcc(i, forces[i] / store.mass[i]);
+                }
+            });
+        };
+
+        bool closing = integrator == IntegratorType::VERLET || integrator == IntegratorType::LEAPFROG;
+        bool ready = closing && closingForcesCurrent();
+        closingValid = false;
+
+        switch (integrator) {
+            case IntegratorType::EULER:
+                Integrators::euler(state, dt, evaluate, loop);
+                break;
+            case IntegratorType::VERLET:
+                Integrators::verlet(state, dt, evaluate, loop, ready);
+                break;
+            case IntegratorType::RK4:
+                Integrators::rk4(state, dt, integratorScratch, evaluate, loop);
+                break;
+            case IntegratorType::LEAPFROG:
+                Integrators::leapfrog(state, dt, evaluate, loop, ready);
+                break;
+            case IntegratorType::YOSHIDA4:
+                Integrators::yoshida4(state, dt, evaluate, loop);
+                break;
+            case IntegratorType::YOSHIDA6:
+                Integrators::compose<Integrators::Compositions::Yoshida6>(state, dt, evaluate, loop);
+                break;
+            case IntegratorType::YOSHIDA8:
+                Integrators::compose<Integrators::Compositions::Yoshida8>(state, dt, evaluate, loop);
+                break;
+            case IntegratorType::IAS15:
+                integrateIAS15(dt);
+                break;
+            case IntegratorType::HERMITE4:
+            case IntegratorType::WISDOM_HOLMAN:
+                // Dla poprawek PN nie ma jerku ani podziału na ruch keplerowski - zostaje kick-drift-kick
+                Integrators::verlet(state, dt, evaluate, loop);
+                break;
+        }
+        if (closing) rememberClosingForces();
+    }
 
-            switch (integrator) {
-                case IntegratorType::EULER:
-                    Integrators::euler(*body, dt, forceFunc);
-                    break;
-                case IntegratorType::VERLET:
-                    Integrators::verlet(*body, dt, forceFunc);
-                    break;
-                case IntegratorType::RK4:
-                    Integrators::rk4(*body, dt, forceFunc);
-                    break;
-                case IntegratorType::LEAPFROG:
-                    Integrators::leapfrog(*body, dt, forceFunc);
-                    break;
-                case IntegratorType::YOSHIDA4:
-                    Integrators::yoshida4(*body, dt, forceFunc);
-                    break;
+    // Siły zależne od prędkości (PN, MHD, oddziaływania cząstek, promieniowanie) zmienia już
+    // kończący kick, więc ich przyspieszeń nie da się przenieść do następnego kroku
+    bool closingForcesCurrent() const {
+        if (!closingValid || closingRevision != store.revision()) return false;
+        if (useRelativistic || useMHD || useParticleInteractions || useRadiativeTransfer) return false;
+        size_t n = store.size();
+        if (closingX.size() != n) return false;
+        for (size_t i = 0; i < n; ++i) {
+            if (closingX[i] != store.px[i] || closingY[i] != store.py[i] || closingZ[i] != store.pz[i] ||
+                closingMass[i] != store.mass[i] || closingRadius[i] != store.radius[i] ||
+                closingMoving[i] != moving[i]) {
+                return false;
             }
+        }
+        return true;
+    }
+
+    void rememberClosingForces() {
+        closingX.assign(store.px.begin(), store.px.end());
+        closingY.assign(store.py.begin(), store.py.end());
+        closingZ.assign(store.pz.begin(), store.pz.end());
+        closingMass.assign(store.mass.begin(), store.mass.end());
+        closingRadius.assign(store.radius.begin(), store.radius.end());
+        closingMoving.assign(moving.begin(), moving.end());
+        closingRevision = store.revision();
+        closingValid = true;
+    }
 
-            if (body->showTrail) {
-                body->updateTrail();
+    // Krok dt integratorem IAS15 z własnym krokiem wewnętrznym; ostatni jest przycinany do końca dt.
+    // Predykcja b i sumy kompensacyjne przechodzą do następnego kroku, dopóki zbiór ruchomych ciał
+    // się nie zmienia. Siły z evaluateForces(), więc działa z każdym solverem; poprawki PN liczą
+    // się z tablic, czyli ze stanu bieżącego podkroku.
+    void integrateIAS15(double dt) {
+        size_t n = store.size();
+        markMoving();
+
+        std::vector<size_t> &index = ias15Index;
+        index.clear();
+        for (size_t i = 0; i < n; ++i) {
+            if (moving[i]) index.push_back(i);
+        }
+        size_t count = index.size();
+        bool resume = ias15Bodies.size() == count;
+        for (size_t k = 0; resume && k < count; ++k) resume = store.handle(index[k]).get() == ias15Bodies[k];
+        if (!resume) {
+            ias15.reset(3 * count);
+            ias15Bodies.resize(count);
+            for (size_t k = 0; k < count; ++k) ias15Bodies[k] = store.handle(index[k]).get();
+        }
+        ias15Stats = IAS15Stats();
+        if (count == 0) return;
+        if (ias15.dt <= 0) ias15.dt = dt;
+        ias15.ready = false;
+
+        ias15Pos.resize(3 * count);
+        ias15Vel.resize(3 * count);
+        for (size_t k = 0; k < count; ++k) {
+            size_t i = index[k];
+            ias15Pos[3 * k] = store.px[i];
+            ias15Pos[3 * k + 1] = store.py[i];
+            ias15Pos[3 * k + 2] = store.pz[i];
+            ias15Vel[3 * k] = store.vx[i];
+            ias15Vel[3 * k + 1] = store.vy[i];
+            ias15Vel[3 * k + 2] = store.vz[i];
+        }
+        auto evaluate = [&](const std::vector<double> &x, const std::vector<double> &v, std::vector<double> &a) {
+            for (size_t k = 0; k < count; ++k) {
+                store.setPos(index[k], Vec3(x[3 * k], x[3 * k + 1], x[3 * k + 2]));
+                store.setVel(index[k], Vec3(v[3 * k], v[3 * k + 1], v[3 * k + 2]));
             }
-            if (!body->destroyed) {
-                body->updateColorByVelocity();
+            evaluateForces(moving.data());
+            for (size_t k = 0; k < count; ++k) {
+                Vec3 acc = forces[index[k]] / store.mass[index[k]];
+                a[3 * k] = acc.x;
+                a[3 * k + 1] = acc.y;
+                a[3 * k + 2] = acc.z;
             }
+        };
+
+        size_t iterations = ias15.iterations;
+        for (double t = 0; t < dt;) {
+            double planned = ias15.dt;
+            bool last = planned >= dt - t;
+            double h = last ? dt - t : planned;
+            if (!IAS15::step(ias15, ias15Pos, ias15Vel, h, ias15Tolerance, evaluate)) {
+                ++ias15Stats.rejected;
+                continue;
+            }
+            ++ias15Stats.steps;
+            t = last ? dt : t + h;
+            // Przycięty krok nie ogranicza następnego, jeśli kryterium błędu pozwala na planowany
+            if (last && h < planned) ias15.retime(std::max(ias15.dt, std::min(planned, ias15.optimal)));
+        }
+        ias15Stats.iterations = ias15.iterations - iterations;
+        ias15Stats.timestep = ias15.dt;
+
+        for (size_t k = 0; k < count; ++k) {
+            size_t i = index[k];
+            store.setPos(i, Vec3(ias15Pos[3 * k], ias15Pos[3 * k + 1], ias15Pos[3 * k + 2]));
+            store.setVel(i, Vec3(ias15Vel[3 * k], ias15Vel[3 * k + 1], ias15Vel[3 * k + 2]));
+            store.setAcc(i, Vec3(ias15.at[3 * k], ias15.at[3 * k + 1], ias15.at[3 * k + 2]));
         }
+    }
 
-        if (detectCollisions) {
-            checkCollisions();
+    // Krok Wisdoma-Holmana. Centrum to najcięższe ciało; układ tworzą ono i ciała ruchome
+    // w kolejności odległości od centrum, a pozostałe (nieruchome, uśpione) działają jak źródła
+    // zewnętrzne. Oddziaływanie liczy evaluateForces() przy zerowej masie centrum, więc działa
+    // z każdym solverem grawitacji. Gdy stan ciał jest dokładnie taki, jak na końcu poprzedniego
+    // kroku, krok rusza z zapamiętanych zmiennych - bez ponownej transformacji i bez C^-1.
+    void integrateWisdomHolman(double dt) {
+        size_t n = store.size();
+        markMoving();
+
+        size_t centre = 0, count = 1;
+        for (size_t i = 1; i < n; ++i) {
+            if (store.mass[i] > store.mass[centre]) centre = i;
+        }
+        for (size_t i = 0; i < n; ++i) {
+            if (moving[i] && i != centre) ++count;
+        }
+        if (n == 0 || count < 2) {
+            integrate(dt);
+            return;
+        }
+
+        WisdomHolman::System &system = wisdomHolman;
+        std::vector<size_t> &index = wisdomHolmanIndex;
+        const bool fixed = !moving[centre];
+        const auto coordinates =
+                useHybridEncounters ? WisdomHolman::Coordinates::DEMOCRATIC_HELIOCENTRIC : wisdomHolmanCoordinates;
+        const bool corrector = useWisdomHolmanCorrector && !useHybridEncounters &&
+                               (fixed || coordinates == WisdomHolman::Coordinates::JACOBI);
+
+        bool resume = wisdomHolmanBodies.size() == count && system.fixedCentre == fixed &&
+                      system.coordinates == coordinates && wisdomHolmanStep == dt;
+        for (size_t k = 0; resume && k < count; ++k) {
+            size_t i = index[k];
+            resume = i < n && store.handle(i).get() == wisdomHolmanBodies[k] && (k == 0 ? i == centre : moving[i]) &&
+                     store.mass[i] == system.m[k] && store.pos(i) == system.r[k] && store.vel(i) == system.v[k];
+        }
+
+        auto loop = [this](size_t total, auto &&fn) {
+            pool->forRange(0, total, [&](size_t begin, size_t end, size_t) { fn(begin, end); }, 256);
+        };
+        wisdomHolmanTargets.assign(n, 0);
+        for (size_t k = 1; k < count && resume; ++k) wisdomHolmanTargets[index[k]] = 1;
+        auto evaluate = [&] {
+            for (size_t k = 0; k < count; ++k) {
+                store.setPos(index[k], system.r[k]);
+                store.setVel(index[k], system.v[k]);
+            }
+            double centralMass = store.mass[centre];
+            store.mass[centre] = 0;
+            evaluateForces(wisdomHolmanTargets.data());
+            store.mass[centre] = centralMass;
+
+            for (size_t k = 1; k < count; ++k) system.acc[k] = forces[index[k]] / store.mass[index[k]];
+            system.acc[0] = Vec3(0, 0, 0);
+            system.splitEncounterForces();
+            if (fixed) return;
+            for (size_t i = 0; i < n; ++i) {
+                if (i == centre || moving[i] || store.mass[i] <= 0) continue;
+                Vec3 d = store.pos(i) - system.r[0];
+                double d2 = d.lengthSq();
+                if (d2 > 0) system.acc[0] += d * (Physics::G * store.mass[i] / (d2 * std::sqrt(d2)));
+            }
+        };
+
+        if (resume) {
+            if (corrector) std::swap(system, wisdomHolmanMap);
+        } else {
+            index.assign(1, centre);
+            for (size_t i = 0; i < n; ++i) {
+                if (moving[i] && i != centre) index.push_back(i);
+            }
+            Vec3 origin = store.pos(centre);
+            std::sort(index.begin() + 1, index.end(), [&](size_t a, size_t b) {
+                double da = (store.pos(a) - origin).lengthSq(), db = (store.pos(b) - origin).lengthSq();
+                return da != db ? da < db : a < b;
+            });
+
+            std::vector<double> masses(count);
+            for (size_t k = 0; k < count; ++k) masses[k] = store.mass[index[k]];
+            system.coordinates = coordinates;
+            system.fixedCentre = fixed;
+            system.setup(masses, Physics::G);
+            for (size_t k = 0; k < count; ++k) {
+                system.r[k] = store.pos(index[k]);
+                system.v[k] = store.vel(index[k]);
+                wisdomHolmanTargets[index[k]] = k > 0;
+            }
+            system.fromInertial();
+            if (corrector) WisdomHolman::correct(system, dt, 1, evaluate, loop);
+
+            wisdomHolmanBodies.resize(count);
+            for (size_t k = 0; k < count; ++k) wisdomHolmanBodies[k] = store.handle(index[k]).get();
+            wisdomHolmanStep = dt;
+        }
+
+        if (useHybridEncounters) {
+            findEncounters(dt);
+        } else if (!system.groups.empty()) {
+            system.setEncounters({});
+        }
+        WisdomHolman::step(system, dt, evaluate, loop);
+        if (useHybridEncounters) {
+            encounterStats.groups = system.groups.size();
+            encounterStats.bodies = std::count(system.grouped.begin(), system.grouped.end(), uint8_t(1));
+            encounterStats.substeps = system.substeps;
+            encounterStats.contacts += system.contacts.size();
+            for (const auto &contact: system.contacts) {
+                encounterContacts.push_back({index[contact.a], index[contact.b], contact.dq, contact.du});
+            }
+        }
+        if (corrector) {
+            wisdomHolmanMap = system;
+            WisdomHolman::correct(system, dt, -1, evaluate, loop);
+        }
+        system.toInertial();
+
+        // Przyspieszenie: oddziaływanie z ostatniego kicku plus centrum w końcowych położeniach
+        Vec3 centralAcc = system.acc[0];
+        for (size_t k = 0; k < count; ++k) {
+            size_t i = index[k];
+            store.setPos(i, system.r[k]);
+            store.setVel(i, system.v[k]);
+            if (k == 0) continue;
+            Vec3 d = system.r[k] - system.r[0];
+            double d2 = d.lengthSq();
+            Vec3 pull = d * (Physics::G / (d2 * std::sqrt(d2)));
+            store.setAcc(i, system.acc[k] - pull * system.m[0]);
+            centralAcc += pull * system.m[k];
+        }
+        if (!fixed) store.setAcc(centre, centralAcc);
+    }
+
+    // Pary układu WH, które w kroku dt mogą wejść w promień przejścia; wiersze trójkąta
+    // równolegle, listy sklejone w kolejności wierszy
+    void findEncounters(double dt) {
+        WisdomHolman::System &system = wisdomHolman;
+        for (size_t k = 0; k < system.size(); ++k) system.radius[k] = store.radius[wisdomHolmanIndex[k]];
+        system.setCritical(dt, encounterHillRadii);
+
+        size_t count = system.size();
+        unsigned threads = pairThreads(count);
+        auto bounds = triangleBounds(count, threads);
+        std::vector<std::vector<std::pair<size_t, size_t> > > found(threads);
+        pool->run(threads, [&](unsigned t) {
+            for (size_t i = std::max<size_t>(bounds[t], 1); i < bounds[t + 1]; ++i) {
+                for (size_t j = i + 1; j < count; ++j) {
+                    if (system.approaches(i, j, dt)) found[t].push_back({i, j});
+                }
+            }
+        });
+        std::vector<std::pair<size_t, size_t> > pairs;
+        for (auto &list: found) pairs.insert(pairs.end(), list.begin(), list.end());
+        system.setEncounters(pairs);
+    }
+
+    // Krok dt hierarchicznymi blokami czasowymi. Czas liczony jest w tyknięciach dt / 2^levels,
+    // ciało i idzie krokiem blockTicks[i] (potęga dwójki) od chwili blockStart[i], gdzie ma stan
+    // blockPos/Vel/Acc. W każdej chwili wszystkie ciała są przewidywane szeregiem Taylora, siły
+    // liczone są tylko dla aktywnych (koniec ich kroku wypada teraz), a te dostają korektę.
+    // Krok może zmaleć dowolnie, a urosnąć dwukrotnie tylko w chwili podzielnej przez nowy
+    // krok - bloki zostają zsynchronizowane i na końcu dt wszystkie ciała są w tej samej chwili.
+    //
+    // Zwykle korekta to kick-drift-kick, a pochodna przyspieszenia to różnica a1 - a0 po kroku,
+    // więc kryterium eta * |a| / |da/dt| działa z każdym solverem grawitacji. Dla HERMITE4 siły
+    // idą z sumy bezpośredniej razem z jerkiem, predykcja jest 3. rzędu, korekta Hermite'a
+    // 4. rzędu, a krok daje kryterium Aarsetha. levels = 0 to wspólny krok dt dla wszystkich.
+    void integrateBlocks(double dt, int levels) {
+        size_t n = store.size();
+        markMoving();
+        const bool hermite = integrator == IntegratorType::HERMITE4;
+        const uint64_t span = uint64_t(1) << levels;
+        const double tick = dt / double(span);
+
+        blockPos.resize(3 * n);
+        blockVel.resize(3 * n);
+        blockAcc.resize(3 * n);
+        blockStart.assign(n, 0);
+        blockTicks.assign(n, span);
+        blockActive.resize(n);
+
+        auto loop = [this](size_t count, auto &&fn) {
+            pool->forRange(0, count, [&](size_t begin, size_t end, size_t) { fn(begin, end); }, 4096);
+        };
+        auto evaluate = [&](const uint8_t *targets) {
+            if (hermite) {
+                evaluateForcesWithJerk(targets);
+            } else {
+                evaluateForces(targets);
+            }
+        };
+        // Najdłuższy krok (potęga dwójki tyknięć, najwyżej dt) nie większy od crit
+        auto ticksFor = [&](double crit) {
+            uint64_t ticks = span;
+            while (ticks > 1 && double(ticks) * tick > crit) ticks >>= 1;
+            return ticks;
+        };
+        auto level = [&](uint64_t ticks) {
+            int k = 0;
+            while ((span >> k) > ticks) ++k;
+            return k;
+        };
+        auto save = [&](size_t i) {
+            blockPos[3 * i] = store.px[i];
+            blockPos[3 * i + 1] = store.py[i];
+            blockPos[3 * i + 2] = store.pz[i];
+            blockVel[3 * i] = store.vx[i];
+            blockVel[3 * i + 1] = store.vy[i];
+            blockVel[3 * i + 2] = store.vz[i];
+            blockAcc[3 * i] = store.ax[i];
+            blockAcc[3 * i + 1] = store.ay[i];
+            blockAcc[3 * i + 2] = store.az[i];
+        };
+
+        // Start: na końcu poprzedniego dt każde ciało dostało siły w swoim ostatecznym położeniu,
+        // więc liczymy je tylko dla ciał bez oszacowania kroku (nowe lub zmienione przez kolizję).
+        // Ich krok startowy jest jak w computeAdaptiveTimestep, a dla HERMITE4 0.01 * |a| / |j|.
+        for (size_t i = 0; i < n; ++i) {
+            if (!moving[i]) store.timestep[i] = 0;
+            blockActive[i] = moving[i] && store.timestep[i] <= 0;
+        }
+        evaluate(blockActive.data());
+        loop(n, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                if (!moving[i]) continue;
+                double crit = store.timestep[i];
+                if (blockActive[i]) {
+                    Vec3 a = forces[i] / store.mass[i];
+                    store.setAcc(i, a);
+                    double acc = a.length();
+                    if (hermite) {
+                        store.jerk[i] = jerks[i];
+                        double jerk = jerks[i].length();
+                        crit = jerk > 0 ? 0.01 * acc / jerk : dt;
+                    } else {
+                        crit = acc > 1e-10 ? std::sqrt(store.radius[i] / acc) * 0.1 : dt;
+                    }
+                }
+                save(i);
+                blockTicks[i] = ticksFor(crit);
+            }
+        });
+
+        uint64_t now = 0;
+        while (now < span) {
+            uint64_t next = span;
+            for (size_t i = 0; i < n; ++i) {
+                if (moving[i]) next = std::min(next, blockStart[i] + blockTicks[i]);
+            }
+            now = next;
+
+            // Predykcja wszystkich ruchomych ciał na chwilę now
+            loop(n, [&](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; ++i) {
+                    blockActive[i] = moving[i] && blockStart[i] + blockTicks[i] == now;
+                    if (!moving[i]) continue;
+                    double tau = double(now - blockStart[i]) * tick;
+                    Vec3 x(blockPos[3 * i], blockPos[3 * i + 1], blockPos[3 * i + 2]);
+                    Vec3 v(blockVel[3 * i], blockVel[3 * i + 1], blockVel[3 * i + 2]);
+                    Vec3 a(blockAcc[3 * i], blockAcc[3 * i + 1], blockAcc[3 * i + 2]);
+                    Vec3 j = hermite ? store.jerk[i] : Vec3(0, 0, 0);
+                    store.setPos(i, x + (v + (a * 0.5 + j * (tau / 6.0)) * tau) * tau);
+                    store.setVel(i, v + (a + j * (0.5 * tau)) * tau);
+                }
+            });
+
+            evaluate(blockActive.data());
+
+            // Korekta aktywnych i nowe kroki
+            loop(n, [&](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; ++i) {
+                    if (!blockActive[i]) continue;
+                    double h = double(blockTicks[i]) * tick;
+                    Vec3 x0(blockPos[3 * i], blockPos[3 * i + 1], blockPos[3 * i + 2]);
+                    Vec3 v0(blockVel[3 * i], blockVel[3 * i + 1], blockVel[3 * i + 2]);
+                    Vec3 a0(blockAcc[3 * i], blockAcc[3 * i + 1], blockAcc[3 * i + 2]);
+                    Vec3 a1 = forces[i] / store.mass[i];
+                    double crit = dt;
+
+                    if (hermite) {
+                        Vec3 j0 = store.jerk[i], j1 = jerks[i];
+                        Vec3 v1 = v0 + (a0 + a1) * (0.5 * h) + (j0 - j1) * (h * h / 12.0);
+                        store.setPos(i, x0 + (v0 + v1) * (0.5 * h) + (a0 - a1) * (h * h / 12.0));
+                        store.setVel(i, v1);
+                        store.jerk[i] = j1;
+
+                        // Druga i trzecia pochodna przyspieszenia z interpolacji Hermite'a
+                        Vec3 a3 = ((a0 - a1) * 12.0 + (j0 + j1) * (6.0 * h)) / (h * h * h);
+                        Vec3 a2 = ((a0 - a1) * -6.0 - (j0 * 4.0 + j1 * 2.0) * h) / (h * h) + a3 * h;
+                        double acc = a1.length(), jerk = j1.length();
+                        double snap = a2.length(), crackle = a3.length();
+                        double denominator = jerk * crackle + snap * snap;
+                        if (denominator > 0) {
+                            crit = std::sqrt(hermiteAccuracy * (acc * snap + jerk * jerk) / denominator);
+                        }
+                    } else {
+                        store.setVel(i, v0 + (a0 + a1) * (0.5 * h));
+                        double jerk = (a1 - a0).length() / h;
+                        if (jerk > 0) crit = blockAccuracy * a1.length() / jerk;
+                    }
+                    store.setAcc(i, a1);
+                    save(i);
+                    store.timestep[i] = crit;
+
+                    uint64_t ticks = std::min(blockTicks[i], ticksFor(crit));
+                    if (ticks == blockTicks[i] && 2 * ticks <= span && now % (2 * ticks) == 0 &&
+                        double(2 * ticks) * tick <= crit) {
+                        ticks *= 2;
+                    }
+                    blockStart[i] = now;
+                    blockTicks[i] = ticks;
+                }
+            });
+
+            ++blockStats.substeps;
+            for (size_t i = 0; i < n; ++i) {
+                if (!blockActive[i]) continue;
+                ++blockStats.activeBodies;
+                blockStats.deepestLevel = std::max(blockStats.deepestLevel, level(blockTicks[i]));
+            }
         }
 
-        bodies.erase(std::remove_if(bodies.begin(), bodies.end(),
-                                    [](const BodyPtr &b) { return !b || b->destroyed; }),
-                     bodies.end());
+    }
+
+    // Zaburzenie pary od reszty układu: tensor pływowy w środku masy ze stanu na początku kroku
+    KS::Tidal pairTidalTensor(size_t ia, size_t ib) const {
+        double total = store.mass[ia] + store.mass[ib];
+        Vec3 cm = (store.pos(ia) * store.mass[ia] + store.pos(ib) * store.mass[ib]) / total;
+        KS::Tidal tidal;
+        for (size_t k = 0; k < store.size(); ++k) {
+            if (k == ia || k == ib || !store.alive[k]) continue;
+            tidal.add(store.pos(k) - cm, Physics::G * store.mass[k]);
+        }
+        return tidal;
+    }
 
-        if (bodies.size() != forces.size()) {
-            forces.resize(bodies.size());
+    // Górne oszacowanie |P| / |a| pary w ciągu kroku dt: para sięga najwyżej apocentrum 2a, a
+    // ciało k w odległości r zbliża się nie szybciej niż sqrt(v^2 + 2 G M' / r) (zasada
+    // zachowania energii), więc w dt dochodzi najwyżej do x, dla którego całka dr / v z x do d
+    // to dt. Zaburzenie od k to 2 (m_k / M) (2a / x)^3.
+    double pairPerturbation(size_t ia, size_t ib, double dt) const {
+        double total = store.mass[ia] + store.mass[ib], gm = Physics::G * total;
+        Vec3 cm = (store.pos(ia) * store.mass[ia] + store.pos(ib) * store.mass[ib]) / total;
+        Vec3 vcm = (store.vel(ia) * store.mass[ia] + store.vel(ib) * store.mass[ib]) / total;
+        double energy = pairEnergy(ia, ib);
+        double reach = energy < 0 ? -gm / energy : (store.pos(ib) - store.pos(ia)).length();
+
+        double gamma = 0;
+        for (size_t k = 0; k < store.size(); ++k) {
+            if (k == ia || k == ib || !store.alive[k] || store.mass[k] <= 0) continue;
+            double d = (store.pos(k) - cm).length();
+            double v2 = (store.vel(k) - vcm).lengthSq();
+            double gmk = Physics::G * (total + store.mass[k]);
+            if (d <= reach) return INFINITY;
+
+            // Odcinki geometryczne od d do 2a, każdy z prędkością z bliższego końca
+            double q = std::pow(reach / d, 1.0 / 64), r = d, time = 0, x = 0;
+            for (int it = 0; it < 64 && x == 0; ++it) {
+                double next = r * q;
+                time += (r - next) / std::sqrt(v2 + 2 * gmk / next);
+                if (time > dt) x = r;
+                r = next;
+            }
+            if (x == 0) return INFINITY;
+            double ratio = reach / x;
+            gamma += 2 * store.mass[k] / total * ratio * ratio * ratio;
+        }
+        return gamma;
+    }
+
+    // Energia ruchu względnego na jednostkę masy zredukowanej
+    double pairEnergy(size_t ia, size_t ib) const {
+        double r = (store.pos(ib) - store.pos(ia)).length();
+        return 0.5 * (store.vel(ib) - store.vel(ia)).lengthSq() - Physics::G * (store.mass[ia] + store.mass[ib]) / r;
+    }
+
+    // Przegląd par na początku kroku: rozpad par, które przestały być związane lub są zbyt
+    // zaburzone, wyszukanie nowych i złożenie każdej pary w jedną cząstkę w środku masy
+    void formRegularizedPairs(double dt) {
+        size_t n = store.size();
+        std::vector<uint8_t> paired(n, 0);
+        auto eligible = [&](size_t i) { return store.alive[i] && !(store.flags[i] & 3) && store.mass[i] > 0; };
+        auto release = [&](size_t ia, size_t ib) {
+            store.timestep[ia] = store.timestep[ib] = 0;
+            ++regularizationStats.released;
+        };
+
+        std::unordered_map<const Body *, size_t> index;
+        if (!regularizedPairs.empty()) {
+            for (size_t i = 0; i < n; ++i) index[store.handle(i).get()] = i;
+        }
+        size_t kept = 0;
+        for (auto &pair: regularizedPairs) {
+            auto a = index.find(pair.a.get()), b = index.find(pair.b.get());
+            if (a == index.end() || b == index.end()) {
+                ++regularizationStats.released;
+                continue;
+            }
+            size_t ia = a->second, ib = b->second;
+            if (!eligible(ia) || !eligible(ib)) {
+                release(ia, ib);
+                continue;
+            }
+            pair.tidal = pairTidalTensor(ia, ib);
+            pair.perturbation = pairPerturbation(ia, ib, dt);
+            if (pairEnergy(ia, ib) >= 0 || pair.perturbation > regularizationReleasePerturbation) {
+                release(ia, ib);
+                continue;
+            }
+            pair.ia = ia;
+            pair.ib = ib;
+            paired[ia] = paired[ib] = 1;
+            regularizedPairs[kept++] = pair;
+        }
+        regularizedPairs.resize(kept);
+
+        // Kandydaci: pary związane o czasie dynamicznym sqrt(r^3 / GM) krótszym od kroku;
+        // wiersze równolegle jak w checkCollisions, najciaśniejsze pary biorą pierwszeństwo
+        struct Candidate {
+            double tdyn2;
+            size_t i, j;
+        };
+        unsigned threads = pairThreads(n);
+        auto bounds = triangleBounds(n, threads);
+        std::vector<std::vector<Candidate> > found(threads);
+        pool->run(threads, [&](unsigned t) {
+            for (size_t i = bounds[t]; i < bounds[t + 1]; ++i) {
+                if (paired[i] || !eligible(i)) continue;
+                for (size_t j = i + 1; j < n; ++j) {
+                    if (paired[j] || !eligible(j)) continue;
+                    double gm = Physics::G * (store.mass[i] + store.mass[j]);
+                    double r2 = (store.pos(j) - store.pos(i)).lengthSq();
+                    double tdyn2 = r2 * std::sqrt(r2) / gm;
+                    if (tdyn2 < dt * dt && pairEnergy(i, j) < 0) found[t].push_back({tdyn2, i, j});
+                }
+            }
+        });
+        std::vector<Candidate> candidates;
+        for (auto &list: found) candidates.insert(candidates.end(), list.begin(), list.end());
+        std::sort(candidates.begin(), candidates.end(), [](const Candidate &x, const Candidate &y) {
+            return x.tdyn2 < y.tdyn2 || (x.tdyn2 == y.tdyn2 && (x.i < y.i || (x.i == y.i && x.j < y.j)));
+        });
+
+        for (const auto &c: candidates) {
+            if (paired[c.i] || paired[c.j]) continue;
+            RegularizedPair pair;
+            pair.perturbation = pairPerturbation(c.i, c.j, dt);
+            if (pair.perturbation > regularizationFormPerturbation) continue;
+            pair.tidal = pairTidalTensor(c.i, c.j);
+            pair.a = store.handle(c.i);
+            pair.b = store.handle(c.j);
+            pair.ia = c.i;
+            pair.ib = c.j;
+            paired[c.i] = paired[c.j] = 1;
+            store.timestep[c.i] = store.timestep[c.j] = 0;
+            regularizedPairs.push_back(pair);
+            ++regularizationStats.formed;
+        }
+
+        for (auto &pair: regularizedPairs) {
+            size_t ia = pair.ia, ib = pair.ib;
+            pair.massA = store.mass[ia];
+            pair.massB = store.mass[ib];
+            pair.flagsB = store.flags[ib];
+            double total = pair.massA + pair.massB;
+            pair.state = KS::fromCartesian(store.pos(ib) - store.pos(ia), store.vel(ib) - store.vel(ia),
+                                           Physics::G * total);
+
+            store.setPos(ia, (store.pos(ia) * pair.massA + store.pos(ib) * pair.massB) / total);
+            store.setVel(ia, (store.vel(ia) * pair.massA + store.vel(ib) * pair.massB) / total);
+            store.setAcc(ia, (store.acc(ia) * pair.massA + store.acc(ib) * pair.massB) / total);
+            store.mass[ia] = total;
+            store.mass[ib] = 0;
+            store.flags[ib] |= static_cast<int>(BodyFlags::NO_INTEGRATION);
+        }
+        regularizationStats.active = regularizedPairs.size();
+    }
+
+    // Ruch względny par o dt (środki mas przesunął już krok globalny) i rozkład z powrotem
+    // na dwa ciała. Prawie niezaburzone pary idą analitycznie, pozostałe RK4 w czasie KS.
+    void advanceRegularizedPairs(double dt) {
+        for (auto &pair: regularizedPairs) {
+            size_t ia = pair.ia, ib = pair.ib;
+            double total = pair.massA + pair.massB, gm = Physics::G * total;
+            if (pair.perturbation < 1e-6) {
+                KS::advanceKepler(pair.state, dt);
+            } else {
+                KS::advance(pair.state, gm, dt, [&](Vec3 r) { return pair.tidal.apply(r); });
+            }
+
+            Vec3 r, v;
+            KS::toCartesian(pair.state, r, v);
+            double d = r.length();
+            Vec3 relAcc = r * (-gm / (d * d * d)) + pair.tidal.apply(r);
+            double fa = pair.massB / total, fb = pair.massA / total;
+            Vec3 cm = store.pos(ia), vcm = store.vel(ia), acm = store.acc(ia);
+            store.setPos(ia, cm - r * fa);
+            store.setPos(ib, cm + r * fb);
+            store.setVel(ia, vcm - v * fa);
+            store.setVel(ib, vcm + v * fb);
+            store.setAcc(ia, acm - relAcc * fa);
+            store.setAcc(ib, acm + relAcc * fb);
+            store.mass[ia] = pair.massA;
+            store.mass[ib] = pair.massB;
+            store.flags[ib] = pair.flagsB;
+            moving[ib] = moving[ia];
         }
     }
 
     double computeAdaptiveTimestep(double dt) {
         double minDt = maxTimestep;
-        for (const auto &body: bodies) {
-            if (body->destroyed || body->flags & 3) continue;
-            double acc = body->acc.length();
+        for (size_t i = 0; i < store.size(); ++i) {
+            if (!store.alive[i] || store.flags[i] & 3) continue;
+            // Krok z kryterium Aarsetha z poprzedniego kroku HERMITE4
+            if (store.timestep[i] > 0) {
+                minDt = std::min(minDt, store.timestep[i]);
+                continue;
+            }
+            double acc = store.acc(i).length();
             if (acc > 1e-10) {
-                double suggestedDt = std::sqrt(body->radius / acc) * 0.1;
+                double suggestedDt = std::sqrt(store.radius[i] / acc) * 0.1;
                 minDt = std::min(minDt, suggestedDt);
             }
         }
         return std::clamp(minDt, minTimestep, maxTimestep);
     }
 
-    void checkCollisions() {
-        std::vector<std::pair<size_t, size_t> > collisions;
+    // Liczba par kandydatów z szerokiej fazy i przebudów listy od początku symulacji
+    size_t getCollisionCandidateCount() const { return collisionBroadphase.candidates(); }
+    size_t getCollisionRebuildCount() const { return collisionBroadphase.rebuildCount(); }
+    // Ciała z puli silnika w ostatnim kroku; heap == 0 oznacza krok bez alokacji ciał
+    const AllocationStats &getAllocationStats() const { return allocationStats; }
+    ObjectPool<Body>::Stats getBodyPoolStats() const { return bodyPool.stats(); }
+    // Sprawdzenia kolizji obsłużone przez drzewo grawitacji zamiast siatki
+    size_t getTreeCollisionCheckCount() const { return treeCollisionChecks; }
+    // Zderzenia znalezione tylko dzięki ruchowi po odcinkach (bez nakładania na końcu kroku)
+    size_t getSweptCollisionCount() const { return sweptCollisions; }
+
+    // Ciała poruszają się w kroku po odcinkach od położeń z początku kroku. Sfera wokół środka
+    // odcinka o promieniu r + L / 2 zawiera całą jego otoczkę, więc siatka na takich sferach daje
+    // kandydatów, a czas zetknięcia t to mniejszy pierwiastek |d0 + (d1 - d0) t| = r_a + r_b.
+    // Pary rozstrzygane po kolei w t: ciała wracają do położeń z chwili t, po zderzeniu dolatują
+    // resztę kroku z nowymi prędkościami. Ciało bierze udział w najwyżej jednym takim zderzeniu
+    // na krok; pary nakładające się na końcu kroku zostają dla zwykłego sprawdzenia.
+    void resolveSweptContacts(double dt) {
+        size_t n = std::min(store.size(), sweepX.size());
+        if (n < 2) return;
+        auto &midX = sweptMidX, &midY = sweptMidY, &midZ = sweptMidZ, &reach = sweptReach, &margins = sweptMargins;
+        midX.resize(n);
+        midY.resize(n);
+        midZ.resize(n);
+        reach.resize(n);
+        margins.assign(n, 0.0);
+        for (size_t i = 0; i < n; ++i) {
+            double dx = store.px[i] - sweepX[i], dy = store.py[i] - sweepY[i], dz = store.pz[i] - sweepZ[i];
+            midX[i] = sweepX[i] + 0.5 * dx;
+            midY[i] = sweepY[i] + 0.5 * dy;
+            midZ[i] = sweepZ[i] + 0.5 * dz;
+            reach[i] = store.radius[i] + 0.5 * std::sqrt(dx * dx + dy * dy + dz * dz);
+        }
+        SpatialHash::Spheres swept{midX.data(), midY.data(), midZ.data(), reach.data(), store.alive.data(), n};
+        sweepBroadphase.rebuild(swept, margins.data(), [this](size_t total, auto &&fn) {
+            pool->forRange(0, total, [&](size_t begin, size_t end, size_t) { fn(begin, end); }, 1);
+        });
+        auto &candidates = sweptCandidates;
+        candidates.clear();
+        sweepBroadphase.overlaps(swept, candidates);
+
+        auto &impacts = sweptImpacts;
+        impacts.clear();
+        for (auto [a, b]: candidates) {
+            Vec3 d0(sweepX[b] - sweepX[a], sweepY[b] - sweepY[a], sweepZ[b] - sweepZ[a]);
+            Vec3 d1 = store.pos(b) - store.pos(a);
+            double sum = store.radius[a] + store.radius[b];
+            if (d1.lengthSq() < sum * sum || d0.lengthSq() < sum * sum) continue;
+            Vec3 u = d1 - d0;
+            double A = u.lengthSq(), B = d0.dot(u), C = d0.lengthSq() - sum * sum;
+            double disc = B * B - A * C;
+            if (A <= 0 || B >= 0 || disc < 0) continue;
+            double t = (-B - std::sqrt(disc)) / A;
+            if (t >= 0 && t <= 1) impacts.push_back({t, a, b});
+        }
+        std::sort(impacts.begin(), impacts.end());
+
+        // Wybór par zależy tylko od kolejności t, więc wybrane pary są rozłączne
+        auto &touched = sweptTouched;
+        auto &pairs = sweptPairs;
+        auto &times = sweptTimes;
+        touched.assign(n, 0);
+        pairs.clear();
+        times.clear();
+        for (const auto &impact: impacts) {
+            size_t a = impact.a, b = impact.b;
+            if (touched[a] || touched[b] || !store.alive[a] || !store.alive[b]) continue;
+            touched[a] = touched[b] = 1;
+            pairs.push_back({a, b});
+            times.push_back(impact.t);
+        }
+        sweptCollisions += pairs.size();
 
-        for (size_t i = 0; i < bodies.size(); ++i) {
-            if (bodies[i]->destroyed) continue;
-            for (size_t j = i + 1; j < bodies.size(); ++j) {
-                if (bodies[j]->destroyed) continue;
+        resolveCollisions(pairs, [&](size_t k) {
+            for (size_t i: {pairs[k].first, pairs[k].second}) {
+                store.setPos(i, Vec3(sweepX[i], sweepY[i], sweepZ[i]) * (1 - times[k]) + store.pos(i) * times[k]);
+            }
+            return true;
+        }, [&](size_t k, BodyPtr *spawned, size_t count) {
+            double rest = (1 - times[k]) * dt;
+            for (size_t i: {pairs[k].first, pairs[k].second}) {
+                if (store.alive[i]) store.setPos(i, store.pos(i) + store.vel(i) * rest);
+            }
+            for (size_t s = 0; s < count; ++s) spawned[s]->pos += spawned[s]->vel * rest;
+        });
+    }
+
+    // Rozstrzyga pary etapami: składowe spójne grafu par (union-find), składowe równolegle - każda
+    // po kolei w kolejności swoich par - a nowe ciała z buforów składowych trafiają do magazynu
+    // w kolejności składowych. Składowe nie dzielą ciał, a losowość kolizji zależy tylko od pary,
+    // więc wynik jest bitowo ten sam przy dowolnej liczbie wątków. prepare(k) przed parą k
+    // (false - pomiń), finish(k, spawned, count) po niej, z ciałami, które właśnie powstały.
+    template<typename Prepare, typename Finish>
+    void resolveCollisions(const std::vector<std::pair<size_t, size_t> > &pairs, Prepare &&prepare, Finish &&finish) {
+        if (pairs.empty()) return;
+        size_t n = store.size();
+        auto &parent = collisionParent;
+        parent.resize(n);
+        for (size_t i = 0; i < n; ++i) parent[i] = i;
+        auto find = [&](size_t i) {
+            while (parent[i] != i) i = parent[i] = parent[parent[i]];
+            return i;
+        };
+        for (auto [a, b]: pairs) {
+            size_t ra = find(a), rb = find(b);
+            if (ra != rb) parent[std::max(ra, rb)] = std::min(ra, rb);
+        }
 
-                auto &a = bodies[i];
-                auto &b = bodies[j];
-                double dist = (a->pos - b->pos).length();
-                if (dist < a->radius + b->radius) {
-                    collisions.push_back({i, j});
+        // Składowe w kolejności pierwszej pary, pary składowej w kolejności listy
+        constexpr uint32_t NONE = UINT32_MAX;
+        auto &component = collisionComponent, &pairComponent = collisionPairComponent;
+        component.assign(n, NONE);
+        pairComponent.resize(pairs.size());
+        uint32_t components = 0;
+        for (size_t k = 0; k < pairs.size(); ++k) {
+            size_t root = find(pairs[k].first);
+            if (component[root] == NONE) component[root] = components++;
+            pairComponent[k] = component[root];
+        }
+        auto &begin = collisionBegin, &order = collisionOrder, &fill = collisionFill;
+        begin.assign(components + 1, 0);
+        order.resize(pairs.size());
+        for (uint32_t c: pairComponent) ++begin[c + 1];
+        for (uint32_t c = 0; c < components; ++c) begin[c + 1] += begin[c];
+        fill.assign(begin.begin(), begin.end() - 1);
+        for (size_t k = 0; k < pairs.size(); ++k) order[fill[pairComponent[k]]++] = uint32_t(k);
+
+        auto &spawned = spawnedBodies;
+        if (spawned.size() < components) spawned.resize(components);
+        pool->forRange(0, components, [&](size_t first, size_t last, size_t) {
+            for (size_t c = first; c < last; ++c) {
+                for (uint32_t e = begin[c]; e < begin[c + 1]; ++e) {
+                    size_t k = order[e];
+                    if (!prepare(k)) continue;
+                    size_t before = spawned[c].size();
+                    handleCollision(pairs[k].first, pairs[k].second, spawned[c]);
+                    finish(k, spawned[c].data() + before, spawned[c].size() - before);
                 }
             }
+        }, 16);
+
+        for (uint32_t c = 0; c < components; ++c) {
+            for (auto &body: spawned[c]) store.add(body);
+            spawned[c].clear();
         }
+    }
 
-        for (auto &collision: collisions) {
-            if (collision.first >= bodies.size() || collision.second >= bodies.size()) continue;
-            auto &a = bodies[collision.first];
-            auto &b = bodies[collision.second];
-            if (!a->destroyed && !b->destroyed) {
-                handleCollision(a, b);
-            }
+    void resolveCollisions(const std::vector<std::pair<size_t, size_t> > &pairs) {
+        resolveCollisions(pairs, [](size_t) { return true; }, [](size_t, BodyPtr *, size_t) {});
+    }
+
+    // Pojemność buforów etapów kolizji w bajtach (AllocationStats::scratch to jej przyrost w kroku)
+    size_t collisionScratchBytes() const {
+        auto bytes = [](const auto &v) { return v.capacity() * sizeof(v[0]); };
+        size_t total = bytes(collisionParent) + bytes(collisionComponent) + bytes(collisionPairComponent) +
+                       bytes(collisionBegin) + bytes(collisionOrder) + bytes(collisionFill) + bytes(spawnedBodies) +
+                       bytes(contactPairs) + bytes(collisionPairs) + bytes(treeContacts) + bytes(collisionMargins) +
+                       bytes(sweepX) + bytes(sweepY) + bytes(sweepZ) + bytes(sweptMidX) + bytes(sweptMidY) +
+                       bytes(sweptMidZ) + bytes(sweptReach) + bytes(sweptMargins) + bytes(sweptTimes) +
+                       bytes(sweptCandidates) + bytes(sweptPairs) + bytes(sweptImpacts) + bytes(sweptTouched);
+        for (auto &list: spawnedBodies) total += bytes(list);
+        for (auto &list: treeContacts) total += bytes(list);
+        total += bytes(deterministicSources) + bytes(deterministicHandles);
+        if (deterministicEngine) total += deterministicEngine->scratchBytes();
+        return total + collisionBroadphase.scratchBytes() + sweepBroadphase.scratchBytes();
+    }
+
+    // Alokacje ciał na stercie w obu pulach: Body silnika i PhysicsBody silnika deterministycznego
+    size_t bodyHeapAllocations() const {
+        return bodyPool.stats().heap + (deterministicEngine ? deterministicEngine->poolStats().heap : 0);
+    }
+
+    // Zetknięcia z drzewa liniowego z ostatniego liczenia sił w tym kroku: refit() poszerza węzły
+    // o promienie i ruch ciał od budowy, więc wystarcza jedno przejście po gotowym drzewie.
+    // false, gdy drzewa nie ma albo nie odpowiada bieżącemu magazynowi.
+    bool findTreeContacts(std::vector<std::pair<size_t, size_t> > &collisions) {
+        size_t n = store.size();
+        if (!useTreeCollisions || !collisionTreeCurrent || !linearOctree || linearOctree->getBodies().size() != n) {
+            return false;
         }
+        linearOctree->refit(store.px.data(), store.py.data(), store.pz.data(), store.radius.data());
+
+        constexpr size_t CHUNKS = 64;
+        auto &found = treeContacts;
+        found.resize(CHUNKS);
+        for (auto &list: found) list.clear();
+        pool->forRange(0, CHUNKS, [&](size_t begin, size_t end, size_t) {
+            for (size_t c = begin; c < end; ++c) {
+                linearOctree->contacts(n * c / CHUNKS, n * (c + 1) / CHUNKS, store.px.data(), store.py.data(),
+                                       store.pz.data(), store.radius.data(), store.alive.data(),
+                                       [&](size_t i, size_t j) { found[c].push_back({i, j}); });
+            }
+        }, 1);
+        for (auto &list: found) collisions.insert(collisions.end(), list.begin(), list.end());
+        std::sort(collisions.begin(), collisions.end());
+        ++treeCollisionChecks;
+        return true;
     }
 
-    void handleCollision(BodyPtr &a, BodyPtr &b) {
-        if (!a || !b || a->destroyed || b->destroyed) return;
+    // dt - krok, po którym następuje sprawdzenie; margines sfer w szerokiej fazie to pół promienia
+    // plus droga z dwóch takich kroków, więc wolne ciała zachowują listę kandydatów przez kilka kroków
+    void checkCollisions(double dt = 0) {
+        // Najpierw zetknięcia z podkroków bliskich spotkań: para wraca do stanu względnego z chwili
+        // zetknięcia wokół swojego środka masy na końcu kroku, żeby nie przeleciała przez siebie
+        contactPairs.clear();
+        for (const auto &contact: encounterContacts) contactPairs.push_back({contact.a, contact.b});
+        resolveCollisions(contactPairs, [&](size_t k) {
+            const auto &contact = encounterContacts[k];
+            size_t ia = contact.a, ib = contact.b;
+            if (!store.alive[ia] || !store.alive[ib]) return false;
+            double ma = store.mass[ia], mb = store.mass[ib], total = ma + mb;
+            if (total <= 0) return false;
+            Vec3 cm = (store.pos(ia) * ma + store.pos(ib) * mb) / total;
+            Vec3 cv = (store.vel(ia) * ma + store.vel(ib) * mb) / total;
+            store.setPos(ia, cm - contact.dq * (mb / total));
+            store.setPos(ib, cm + contact.dq * (ma / total));
+            store.setVel(ia, cv - contact.du * (mb / total));
+            store.setVel(ib, cv + contact.du * (ma / total));
+            return true;
+        }, [](size_t, BodyPtr *, size_t) {});
+        encounterContacts.clear();
+        if (useContinuousCollisions) resolveSweptContacts(dt);
+
+        auto &collisions = collisionPairs;
+        collisions.clear();
+        if (!findTreeContacts(collisions)) {
+            size_t n = store.size();
+            SpatialHash::Spheres spheres{store.px.data(), store.py.data(), store.pz.data(), store.radius.data(),
+                                         store.alive.data(), n};
+
+            if (store.revision() != collisionRevision || !collisionBroadphase.valid(spheres)) {
+                auto &margins = collisionMargins;
+                margins.resize(n);
+                for (size_t i = 0; i < n; ++i) margins[i] = 0.5 * store.radius[i] + 2 * store.vel(i).length() * dt;
+                collisionBroadphase.rebuild(spheres, margins.data(), [this](size_t total, auto &&fn) {
+                    pool->forRange(0, total, [&](size_t begin, size_t end, size_t) { fn(begin, end); }, 1);
+                });
+                collisionRevision = store.revision();
+            }
+            // Kandydaci są posortowani, więc pary idą w tej samej kolejności co pętla po trójkącie
+            collisionBroadphase.overlaps(spheres, collisions);
+        }
 
-        Vec3 totalMomentum = a->vel * a->mass + b->vel * b->mass;
-        double totalMass = a->mass + b->mass;
-        Vec3 collisionPos = (a->pos * a->mass + b->pos * b->mass) / totalMass;
-        Vec3 relativeVel = a->vel - b->vel;
+        // Nowe ciała trafiają na koniec magazynu dopiero po wszystkich parach
+        resolveCollisions(collisions);
+    }
+
+    // Zmienia tylko ciała ia i ib; nowe ciała dopisuje do spawned, a nie do magazynu, więc pary
+    // z rozłącznymi ciałami można rozstrzygać jednocześnie. Losowość ze stanu zależnego od kroku
+    // i pary zamiast rand().
+    void handleCollision(size_t ia, size_t ib, std::vector<BodyPtr> &spawned) {
+        if (!store.alive[ia] || !store.alive[ib]) return;
+        CollisionRandom random(stepCount, ia, ib, randomSeed);
+
+        // Stan z tablic, pola rzadko używane (sprężystość, typ kolizji) z obiektów Body
+        Body &a = *store.handle(ia);
+        Body &b = *store.handle(ib);
+        Vec3 posA = store.pos(ia), posB = store.pos(ib);
+        Vec3 velA = store.vel(ia), velB = store.vel(ib);
+        double massA = store.mass[ia], massB = store.mass[ib];
+        double radiusA = store.radius[ia], radiusB = store.radius[ib];
+
+        Vec3 totalMomentum = velA * massA + velB * massB;
+        double totalMass = massA + massB;
+        Vec3 collisionPos = (posA * massA + posB * massB) / totalMass;
+        Vec3 relativeVel = velA - velB;
         double relativeSpeed = relativeVel.length();
 
 
-        double reducedMass = (a->mass * b->mass) / totalMass;
+        double reducedMass = (massA * massB) / totalMass;
         double collisionEnergy = 0.5 * reducedMass * relativeSpeed * relativeSpeed;
 
 
@@ -311,89 +2138,85 @@ public:
         const double FRAGMENT_THRESHOLD = 1e30;
         const double ANNIHILATION_THRESHOLD = 1e35;
 
-        a->kineticEnergyAtCollision = collisionEnergy;
-        b->kineticEnergyAtCollision = collisionEnergy;
+        a.kineticEnergyAtCollision = collisionEnergy;
+        b.kineticEnergyAtCollision = collisionEnergy;
 
 
         if (collisionEnergy < ELASTIC_THRESHOLD) {
-            Vec3 normal = (b->pos - a->pos).normalized();
-            Vec3 relVel = a->vel - b->vel;
+            Vec3 normal = (posB - posA).normalized();
+            Vec3 relVel = velA - velB;
             double velAlongNormal = relVel.dot(normal);
 
-            if (velAlongNormal > 0) return;
+            if (velAlongNormal <= 0) return;
 
-            double restitution = (a->elasticity + b->elasticity) * 0.5;
+            double restitution = (a.elasticity + b.elasticity) * 0.5;
             double impulse = -(1 + restitution) * velAlongNormal;
-            impulse /= (1.0 / a->mass + 1.0 / b->mass);
+            impulse /= (1.0 / massA + 1.0 / massB);
 
             Vec3 impulseVec = normal * impulse;
-            a->vel += impulseVec / a->mass;
-            b->vel -= impulseVec / b->mass;
+            store.setVel(ia, velA + impulseVec / massA);
+            store.setVel(ib, velB - impulseVec / massB);
+            store.timestep[ia] = store.timestep[ib] = 0;
 
-            a->lastCollisionType = Body::CollisionType::ELASTIC_BOUNCE;
-            b->lastCollisionType = Body::CollisionType::ELASTIC_BOUNCE;
+            a.lastCollisionType = Body::CollisionType::ELASTIC_BOUNCE;
+            b.lastCollisionType = Body::CollisionType::ELASTIC_BOUNCE;
 
             // Rozdziel ciała
-            Vec3 separation = normal * ((a->radius + b->radius) * 1.01 - (b->pos - a->pos).length());
-            a->pos -= separation * 0.5;
-            b->pos += separation * 0.5;
+            Vec3 separation = normal * ((radiusA + radiusB) * 1.01 - (posB - posA).length());
+            store.setPos(ia, posA - separation * 0.5);
+            store.setPos(ib, posB + separation * 0.5);
             return;
         }
 
         // 2. ŚREDNIA ENERGIA - Połączenie (fuzja)
         if (collisionEnergy < MERGE_THRESHOLD) {
-            auto merged = std::make_shared<Body>(collisionPos, totalMomentum / totalMass, totalMass,
+            auto merged = bodyPool.make(collisionPos, totalMomentum / totalMass, totalMass,
                                                  std::pow(
-                                                     a->radius * a->radius * a->radius + b->radius * b->radius * b->
-                                                     radius, 1.0 / 3.0));
+                                                     radiusA * radiusA * radiusA + radiusB * radiusB * radiusB,
+                                                     1.0 / 3.0));
             merged->label = "MRG";
             merged->setColor(0.9f, 0.7f, 0.3f);
             merged->colorByVelocity = true;
             merged->maxVelocityForColor = relativeSpeed * 2;
             merged->lastCollisionType = Body::CollisionType::MERGE;
 
-            a->destroy();
-            b->destroy();
-            bodies.push_back(merged);
+            store.kill(ia);
+            store.kill(ib);
+            spawned.push_back(merged);
             return;
         }
 
         // 3. WYSOKA ENERGIA - Fragmentacja (powstawanie nowych cząstek)
         if (collisionEnergy < FRAGMENT_THRESHOLD) {
-            int numFragments = 3 + rand() % 5;
+            int numFragments = 3 + random.below(5);
             double fragmentMass = totalMass / numFragments;
-            double fragmentRadius = std::pow(fragmentMass / totalMass, 1.0 / 3.0) * std::max(a->radius, b->radius);
+            double fragmentRadius = std::pow(fragmentMass / totalMass, 1.0 / 3.0) * std::max(radiusA, radiusB);
 
             // Część energii zamienia się w masę nowych cząstek (E=mc²)
             double energyToMass = collisionEnergy * 0.01 / (Physics::C * Physics::C);
             fragmentMass += energyToMass / numFragments;
 
-            std::vector<BodyPtr> newFragments;
             for (int i = 0; i < numFragments; i++) {
-                double theta = 2.0 * M_PI * i / numFragments + (rand() / (double) RAND_MAX) * 0.5;
-                double phi = M_PI * (rand() / (double) RAND_MAX - 0.5);
-                double speed = relativeSpeed * 0.4 * (0.5 + rand() / (double) RAND_MAX);
+                double theta = 2.0 * M_PI * i / numFragments + random.uniform() * 0.5;
+                double phi = M_PI * (random.uniform() - 0.5);
+                double speed = relativeSpeed * 0.4 * (0.5 + random.uniform());
 
                 Vec3 dir(cos(theta) * cos(phi), sin(phi), sin(theta) * cos(phi));
                 Vec3 fragmentVel = totalMomentum / totalMass + dir * speed;
                 Vec3 fragmentPos = collisionPos + dir * (fragmentRadius * 3);
 
-                auto fragment = std::make_shared<Body>(fragmentPos, fragmentVel, fragmentMass, fragmentRadius);
+                auto fragment = bodyPool.make(fragmentPos, fragmentVel, fragmentMass, fragmentRadius);
                 fragment->label = "FRG";
                 fragment->isFragment = true;
                 fragment->colorByVelocity = true;
                 fragment->maxVelocityForColor = relativeSpeed * 2;
                 fragment->setColor(1.0f, 0.5f, 0.0f);
                 fragment->lastCollisionType = Body::CollisionType::FRAGMENTATION;
-                newFragments.push_back(fragment);
+                spawned.push_back(fragment);
             }
 
-            a->destroy();
-            b->destroy();
-
-            for (auto &frag: newFragments) {
-                bodies.push_back(frag);
-            }
+            store.kill(ia);
+            store.kill(ib);
             return;
         }
 
@@ -401,67 +2224,41 @@ public:
         if (collisionEnergy >= ANNIHILATION_THRESHOLD) {
             // Całkowita anihilacja - energia zamienia się w promieniowanie
             // Tworzymy kilka "fotonów" (małe szybkie cząstki)
-            int numPhotons = 4 + rand() % 4;
-            double photonEnergy = (a->mass + b->mass) * Physics::C * Physics::C / numPhotons;
+            int numPhotons = 4 + random.below(4);
+            double photonEnergy = (massA + massB) * Physics::C * Physics::C / numPhotons;
             double photonMass = photonEnergy / (Physics::C * Physics::C) * 0.001; // Bardzo małe
 
             for (int i = 0; i < numPhotons; i++) {
                 double theta = 2.0 * M_PI * i / numPhotons;
-                double phi = M_PI * (rand() / (double) RAND_MAX - 0.5);
+                double phi = M_PI * (random.uniform() - 0.5);
                 double speed = Physics::C * 0.1; // 10% prędkości światła
 
                 Vec3 dir(cos(theta) * cos(phi), sin(phi), sin(theta) * cos(phi));
                 Vec3 photonVel = dir * speed;
                 Vec3 photonPos = collisionPos + dir * 1e6;
 
-                auto photon = std::make_shared<Body>(photonPos, photonVel, photonMass, 1e5);
+                auto photon = bodyPool.make(photonPos, photonVel, photonMass, 1e5);
                 photon->label = "γ"; // Gamma ray
                 photon->setColor(1.0f, 1.0f, 0.0f);
                 photon->setEmissive(1.0f);
                 photon->showTrail = true;
                 photon->colorByVelocity = false;
                 photon->lastCollisionType = Body::CollisionType::ANNIHILATION;
-                bodies.push_back(photon);
+                spawned.push_back(photon);
             }
 
-            a->destroy();
-            b->destroy();
+            store.kill(ia);
+            store.kill(ib);
             return;
         }
     }
 
-    double totalEnergy() const {
-        double KE = 0, PE = 0;
-        for (const auto &b: bodies) {
-            if (!b->destroyed)
-                KE += b->kineticEnergy();
-        }
-        for (size_t i = 0; i < bodies.size(); ++i) {
-            for (size_t j = i + 1; j < bodies.size(); ++j) {
-                if (bodies[i]->destroyed || bodies[j]->destroyed) continue;
-                double r = (bodies[i]->pos - bodies[j]->pos).length();
-                if (r > 0) {
-                    PE -= Physics::G * bodies[i]->mass * bodies[j]->mass / r;
-                }
-            }
-        }
-        return KE + PE;
-    }
-
-    Vec3 centerOfMass() const {
-        Vec3 com(0, 0, 0);
-        double totalMass = 0;
-        for (const auto &b: bodies) {
-            if (!b->destroyed) {
-                com += b->pos * b->mass;
-                totalMass += b->mass;
-            }
-        }
-        return totalMass > 0 ? com / totalMass : Vec3();
-    }
+    double totalEnergy() const { return getDiagnostics().energy; }
+    Vec3 centerOfMass() const { return getDiagnostics().centerOfMass; }
 
     void clear() {
-        bodies.clear();
+        diagnosticsCurrent = false;
+        store.clear();
         forces.clear();
         stepCount = 0;
     }
@@ -473,8 +2270,7 @@ public:
     }
 
     Vec3 getMomentumError() const {
-        Vec3 currentMomentum = ConservationLaws::totalMomentum(bodies);
-        return currentMomentum - initialMomentum;
+        return getDiagnostics().momentum - initialMomentum;
     }
 
     void printConservationStats() const {
@@ -483,43 +2279,94 @@ public:
         std::cout << "Momentum error: (" << pErr.x << ", " << pErr.y << ", " << pErr.z << ")\n";
     }
 
+    void printGravityStats() const {
+        std::cout << "Tree build: " << gravityTimings.treeBuild * 1e3 << " ms\n";
+        std::cout << "Tree walk: " << gravityTimings.treeWalk * 1e3 << " ms\n";
+        const auto &balance = gravityTimings.walkBalance;
+        if (balance.idle.size() > 1) {
+            std::cout << "Walk idle per thread [ms]:";
+            for (double idle: balance.idle) std::cout << " " << idle * 1e3;
+            std::cout << " (" << balance.steals << " steals)\n";
+        }
+        if (gravitySolver == GravitySolver::FMM) {
+            const auto &stats = fmm.getStats();
+            std::cout << "FMM order " << fmm.getOrder() << ": upward " << stats.upwardTime * 1e3
+                    << " ms, traversal " << stats.traversalTime * 1e3 << " ms, downward "
+                    << stats.downwardTime * 1e3 << " ms (" << stats.m2l << " M2L, " << stats.p2p << " P2P, "
+                    << stats.heavy << " heavy)\n";
+        }
+        if (gravitySolver == GravitySolver::PM || gravitySolver == GravitySolver::TREEPM) {
+            const auto &stats = particleMesh.getStats();
+            std::cout << "PM grid " << particleMesh.getGridSize() << "^3: deposit " << stats.depositTime * 1e3
+                    << " ms, FFT " << stats.fftTime * 1e3 << " ms, interpolate " << stats.interpolateTime * 1e3
+                    << " ms, short range " << stats.shortRangeTime * 1e3 << " ms\n";
+        }
+    }
+
+    // Powyżej limitu jądra: sekwencyjny kick-drift-kick, ciało i widzi już przesunięte ciała 0..i-1
     void stepFast(double dt) {
+        diagnosticsCurrent = false;
         dt *= timeScale;
         stepCount++;
+        store.gather();
+        size_t n = store.size();
+
+        if (n <= directKernelLimit) {
+            // Kick-drift-kick całego układu naraz, pole z jądra wektorowego
+            computeDirectField();
+            for (size_t i = 0; i < n; ++i) {
+                if (store.flags[i] & 3) continue;
+                Vec3 vel = store.vel(i) + Vec3(fieldX[i], fieldY[i], fieldZ[i]) * (dt * 0.5);
+                store.setVel(i, vel);
+                store.setPos(i, store.pos(i) + vel * dt);
+            }
 
-        for (auto &body: bodies) {
-            if (!body || body->destroyed || body->flags & 3) continue;
-
-            Vec3 totalForce(0, 0, 0);
-            for (auto &other: bodies) {
-                if (!other || body == other || other->destroyed) continue;
-                totalForce += Forces::gravity(*body, *other);
+            computeDirectField();
+            for (size_t i = 0; i < n; ++i) {
+                if (store.flags[i] & 3) continue;
+                Vec3 acc(fieldX[i], fieldY[i], fieldZ[i]);
+                store.setVel(i, store.vel(i) + acc * (dt * 0.5));
+                store.setAcc(i, acc);
             }
 
-            Vec3 acc = totalForce / body->mass;
-            body->vel += acc * (dt * 0.5);
-            body->pos += body->vel * dt;
+            store.scatter();
+            return;
+        }
 
-            totalForce = Vec3(0, 0, 0);
-            for (auto &other: bodies) {
-                if (!other || body == other || other->destroyed) continue;
-                totalForce += Forces::gravity(*body, *other);
+        auto totalForce = [&](size_t i) {
+            Vec3 force(0, 0, 0);
+            for (size_t j = 0; j < n; ++j) {
+                if (j != i) force += pairGravity(i, j);
             }
-            acc = totalForce / body->mass;
-            body->vel += acc * (dt * 0.5);
-            body->acc = acc;
+            return force;
+        };
+
+        for (size_t i = 0; i < n; ++i) {
+            if (store.flags[i] & 3) continue;
+
+            Vec3 acc = totalForce(i) / store.mass[i];
+            Vec3 vel = store.vel(i) + acc * (dt * 0.5);
+            store.setPos(i, store.pos(i) + vel * dt);
+
+            acc = totalForce(i) / store.mass[i];
+            vel += acc * (dt * 0.5);
+            store.setVel(i, vel);
+            store.setAcc(i, acc);
         }
+
+        store.scatter();
     }
 
     void syncToDeterministic() {
         if (!deterministicEngine) return;
 
-        for (auto &body: bodies) {
-            if (!body || body->destroyed) continue;
+        deterministicSources.clear();
+        deterministicHandles.clear();
+        for (size_t i = 0; i < store.size(); ++i) {
+            const auto &body = store.handle(i);
+            if (!body || body->destroyed || !store.alive[i]) continue;
 
-            auto pb = std::make_shared<PhysicsBody>(
-                body->pos, body->vel, body->mass, body->radius, PhysicsBodyType::RIGID_BODY
-            );
+            auto pb = deterministicEngine->createBody(body->pos, body->vel, body->mass, body->radius);
             pb->name = body->name;
             pb->label = body->label;
             pb->angularVelocity = Vec3(0, 0, 0);
@@ -530,20 +2377,46 @@ public:
             pb->emissive = body->emissive;
             pb->showTrail = body->showTrail;
 
-            deterministicEngine->addBody(pb);
+            deterministicSources.push_back(pb.get());
+            deterministicHandles.push_back(store.handleOf(i));
         }
     }
 
+    // Silnik deterministyczny nie zmienia kolejności ciał: kompaktowanie usuwa tylko zniszczone,
+    // nowe trafiają na koniec listy. Ciała z mapy idą więc po kolei z jego listą - ciało, które
+    // zniknęło albo zostało zniszczone, staje się nagrobkiem, a nowe dostają obiekty z puli.
     void syncFromDeterministic() {
         if (!deterministicEngine) return;
 
-        bodies.clear();
         auto &detBodies = deterministicEngine->getBodies();
+        size_t k = 0, kept = 0;
+        for (size_t m = 0; m < deterministicSources.size(); ++m) {
+            // Zniszczone ciała spoza mapy (produkty zniszczone w tym samym kroku) pomijamy
+            while (k < detBodies.size() && detBodies[k].get() != deterministicSources[m] && detBodies[k]->destroyed) ++k;
+            const PhysicsBody *pb = nullptr;
+            if (k < detBodies.size() && detBodies[k].get() == deterministicSources[m]) pb = detBodies[k++].get();
+
+            BodyPtr body = store.find(deterministicHandles[m]);
+            if (!body) continue;
+            if (!pb || pb->destroyed) {
+                body->destroy();
+                continue;
+            }
+            body->pos = pb->position;
+            body->vel = pb->velocity;
+            body->mass = pb->mass;
+            body->radius = pb->radius;
+            deterministicSources[kept] = pb;
+            deterministicHandles[kept++] = deterministicHandles[m];
+        }
+        deterministicSources.resize(kept);
+        deterministicHandles.resize(kept);
 
-        for (auto &pb: detBodies) {
+        for (; k < detBodies.size(); ++k) {
+            auto &pb = detBodies[k];
             if (!pb || pb->destroyed) continue;
 
-            auto body = std::make_shared<Body>(pb->position, pb->velocity, pb->mass, pb->radius);
+            auto body = bodyPool.make(pb->position, pb->velocity, pb->mass, pb->radius);
             body->name = pb->name;
             body->label = pb->label;
             body->elasticity = pb->restitution;
@@ -551,21 +2424,23 @@ public:
             body->setColor(pb->color[0], pb->color[1], pb->color[2]);
             body->emissive = pb->emissive;
             body->showTrail = pb->showTrail;
-            body->trail = pb->trail;
 
-            bodies.push_back(body);
+            deterministicSources.push_back(pb.get());
+            deterministicHandles.push_back(store.handleOf(store.add(body)));
         }
+        // Stany z obiektów do tablic, zniszczone ciała -> nagrobki
+        store.gather();
     }
 
     void wakeAll() {
-        for (auto &body: bodies) {
+        for (auto &body: store.bodies()) {
             body->flags &= ~8;
         }
     }
 
     size_t countActive() const {
         size_t count = 0;
-        for (const auto &b: bodies) {
+        for (const auto &b: store.bodies()) {
             if (!b->destroyed && !(b->flags & 8)) count++;
         }
         return count;
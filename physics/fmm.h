@@ -0,0 +1,514 @@
+#pragma once
+#include "../core/vec3.h"
+#include "../core/constants.h"
+#include "../core/parallel.h"
+#include "linear_octree.h"
+#include <chrono>
+#include <complex>
+#include <cstdint>
+#include <vector>
+
+struct FmmStats {
+    size_t p2p = 0;
+    size_t m2l = 0;
+    size_t heavy = 0;
+    double upwardTime = 0;
+    double traversalTime = 0;
+    double downwardTime = 0;
+};
+
+// FMM na rozwinięciach w harmonikach sferycznych (solid harmonics) rzędu order,
+// oparte o podział przestrzeni z LinearOctree. Środkiem rozwinięcia jest środek masy
+// węzła (dipol znika, dominująca masa punktowa jest dokładna), R to odległość
+// najdalszego ciała, a kryterium akceptacji: |Xi - Xj| * theta > Ri + Rj.
+// Błąd rozwinięcia lokalnego skaluje się z polem źródła, więc ciała cięższe niż
+// heavyMassRatio * mediana mas (np. centralna czarna dziura) liczymy bezpośrednio.
+class FastMultipole {
+    using Complex = std::complex<double>;
+
+    // Domyślnie dokładność porównywalna z drzewem Barnesa-Huta przy theta = 0.5
+    int order = 4;
+    double theta = 0.7;
+    double heavyMassRatio = 100;
+    Parallel::Workers workers;
+    bool reproducible = false;
+    static constexpr unsigned REPRODUCIBLE_THREADS = 64;
+    // Zmiękczenie bliskiego pola (r_i + r_j) * 0.01 jak w sumie bezpośredniej; rozwinięcia są niezmiękczone
+    static constexpr double SOFTENING = 0.01;
+
+    size_t stride = 0;
+    std::vector<double> centerX, centerY, centerZ, lightMass;
+    std::vector<uint8_t> heavy;
+    std::vector<uint32_t> heavyBodies;
+    std::vector<Complex> multipoles;
+    std::vector<Complex> locals;
+    std::vector<double> radius;
+    std::vector<double> phi;
+    std::vector<Vec3> gradient;
+    FmmStats stats;
+
+    // std::complex * std::complex woła __muldc3 (obsługa NaN/inf) - tu niepotrzebne
+    static Complex mul(const Complex &a, const Complex &b) {
+        return Complex(a.real() * b.real() - a.imag() * b.imag(), a.real() * b.imag() + a.imag() * b.real());
+    }
+
+    static double oddOrEven(int n) { return (n & 1) ? -1.0 : 1.0; }
+    static double ipow2n(int n) { return n >= 0 ? 1.0 : oddOrEven(n); }
+
+    // Współrzędne sferyczne bez funkcji trygonometrycznych: cos/sin kąta biegunowego i e^{i*phi}
+    struct Spherical {
+        double r, cosT, sinT;
+        Complex ei;
+    };
+
+    static Spherical toSpherical(double dx, double dy, double dz) {
+        Spherical s;
+        double rxy = std::sqrt(dx * dx + dy * dy);
+        s.r = std::sqrt(rxy * rxy + dz * dz);
+        s.cosT = s.r > 0 ? dz / s.r : 1.0;
+        s.sinT = s.r > 0 ? rxy / s.r : 0.0;
+        s.ei = rxy > 0 ? Complex(dx / rxy, dy / rxy) : Complex(1, 0);
+        return s;
+    }
+
+    void evalMultipole(double rho, double x, double y, Complex ei, Complex *ynm, Complex *ynmTheta) const {
+        double invY = 1.0 / (std::abs(y) < 1e-12 ? 1e-12 : y);
+        double fact = 1;
+        double pn = 1;
+        double rhom = 1;
+        Complex eim = 1.0;
+        for (int m = 0; m < order; ++m) {
+            double p = pn;
+            int npn = m * m + 2 * m;
+            int nmn = m * m;
+            ynm[npn] = eim * (rhom * p);
+            ynm[nmn] = std::conj(ynm[npn]);
+            double p1 = p;
+            p = x * (2 * m + 1) * p1;
+            ynmTheta[npn] = eim * (rhom * (p - (m + 1) * x * p1) * invY);
+            rhom *= rho;
+            double rhon = rhom;
+            for (int n = m + 1; n < order; ++n) {
+                int npm = n * n + n + m;
+                int nmm = n * n + n - m;
+                rhon /= -(n + m);
+                ynm[npm] = eim * (rhon * p);
+                ynm[nmm] = std::conj(ynm[npm]);
+                double p2 = p1;
+                p1 = p;
+                p = (x * (2 * n + 1) * p1 - (n + m) * p2) / (n - m + 1);
+                ynmTheta[npm] = eim * (rhon * ((n - m + 1) * p - (n + 1) * x * p1) * invY);
+                rhon *= rho;
+            }
+            rhom /= -(2 * m + 2) * (2 * m + 1);
+            pn = -pn * fact * y;
+            fact += 2;
+            eim = mul(eim, ei);
+        }
+    }
+
+    void evalLocal(double rho, double x, double y, Complex ei, Complex *ynm) const {
+        double fact = 1;
+        double pn = 1;
+        double invR = -1.0 / rho;
+        double rhom = -invR;
+        Complex eim = 1.0;
+        for (int m = 0; m < order; ++m) {
+            double p = pn;
+            int npn = m * m + 2 * m;
+            int nmn = m * m;
+            ynm[npn] = eim * (rhom * p);
+            ynm[nmn] = std::conj(ynm[npn]);
+            double p1 = p;
+            p = x * (2 * m + 1) * p1;
+            rhom *= invR;
+            double rhon = rhom;
+            for (int n = m + 1; n < order; ++n) {
+                int npm = n * n + n + m;
+                int nmm = n * n + n - m;
+                ynm[npm] = eim * (rhon * p);
+                ynm[nmm] = std::conj(ynm[npm]);
+                double p2 = p1;
+                p1 = p;
+                p = (x * (2 * n + 1) * p1 - (n + m) * p2) / (n - m + 1);
+                rhon *= invR * (n - m + 1);
+            }
+            pn = -pn * fact * y;
+            fact += 2;
+            eim = mul(eim, ei);
+        }
+    }
+
+    void p2m(const LinearOctree &tree, size_t node) {
+        const auto &nodes = tree.getNodes();
+        const auto &bodies = tree.getBodies();
+        std::vector<Complex> ynm(order * order), ynmTheta(order * order);
+        Complex *M = &multipoles[node * stride];
+        for (uint32_t b = nodes.bodyBegin[node]; b < nodes.bodyEnd[node]; ++b) {
+            if (heavy[b]) continue;
+            Spherical sp = toSpherical(bodies.x[b] - centerX[node], bodies.y[b] - centerY[node],
+                                       bodies.z[b] - centerZ[node]);
+            evalMultipole(sp.r, sp.cosT, sp.sinT, std::conj(sp.ei), ynm.data(), ynmTheta.data());
+            for (int n = 0; n < order; ++n) {
+                for (int m = 0; m <= n; ++m) {
+                    M[n * (n + 1) / 2 + m] += bodies.mass[b] * ynm[n * n + n + m];
+                }
+            }
+        }
+    }
+
+    void m2m(const LinearOctree &tree, size_t node) {
+        const auto &nodes = tree.getNodes();
+        std::vector<Complex> ynm(order * order), ynmTheta(order * order);
+        Complex *Mi = &multipoles[node * stride];
+        for (uint32_t c = nodes.firstChild[node]; c < nodes.firstChild[node] + nodes.childCount[node]; ++c) {
+            const Complex *Mj = &multipoles[c * stride];
+            Spherical sp = toSpherical(centerX[node] - centerX[c], centerY[node] - centerY[c],
+                                       centerZ[node] - centerZ[c]);
+            evalMultipole(sp.r, sp.cosT, sp.sinT, sp.ei, ynm.data(), ynmTheta.data());
+            for (int j = 0; j < order; ++j) {
+                for (int k = 0; k <= j; ++k) {
+                    Complex M = 0;
+                    for (int n = 0; n <= j; ++n) {
+                        for (int m = std::max(-n, -j + k + n); m <= std::min(k - 1, n); ++m) {
+                            int jnkms = (j - n) * (j - n + 1) / 2 + k - m;
+                            M += mul(Mj[jnkms], ynm[n * n + n - m]) * (ipow2n(m) * oddOrEven(n));
+                        }
+                        for (int m = k; m <= std::min(n, j + k - n); ++m) {
+                            int jnkms = (j - n) * (j - n + 1) / 2 - k + m;
+                            M += mul(std::conj(Mj[jnkms]), ynm[n * n + n - m]) * oddOrEven(k + n + m);
+                        }
+                    }
+                    Mi[j * (j + 1) / 2 + k] += M;
+                }
+            }
+        }
+    }
+
+    void m2l(size_t ci, size_t cj, Complex *ynm) {
+        const Complex *Mj = &multipoles[cj * stride];
+        Complex *Li = &locals[ci * stride];
+        Spherical sp = toSpherical(centerX[ci] - centerX[cj], centerY[ci] - centerY[cj],
+                                   centerZ[ci] - centerZ[cj]);
+        evalLocal(sp.r, sp.cosT, sp.sinT, sp.ei, ynm);
+        for (int j = 0; j < order; ++j) {
+            double cnm = oddOrEven(j);
+            for (int k = 0; k <= j; ++k) {
+                Complex L = 0;
+                for (int n = 0; n < order - j; ++n) {
+                    for (int m = -n; m < 0; ++m) {
+                        int jnkm = (j + n) * (j + n) + j + n + m - k;
+                        L += mul(std::conj(Mj[n * (n + 1) / 2 - m]), ynm[jnkm]) * cnm;
+                    }
+                    for (int m = 0; m <= n; ++m) {
+                        int jnkm = (j + n) * (j + n) + j + n + m - k;
+                        double cnm2 = cnm * oddOrEven((k - m) * (k < m) + m);
+                        L += mul(Mj[n * (n + 1) / 2 + m], ynm[jnkm]) * cnm2;
+                    }
+                }
+                Li[j * (j + 1) / 2 + k] += L;
+            }
+        }
+    }
+
+    void l2l(const LinearOctree &tree, size_t node) {
+        const auto &nodes = tree.getNodes();
+        std::vector<Complex> ynm(order * order), ynmTheta(order * order);
+        const Complex *Lj = &locals[node * stride];
+        for (uint32_t c = nodes.firstChild[node]; c < nodes.firstChild[node] + nodes.childCount[node]; ++c) {
+            Complex *Li = &locals[c * stride];
+            Spherical sp = toSpherical(centerX[c] - centerX[node], centerY[c] - centerY[node],
+                                       centerZ[c] - centerZ[node]);
+            evalMultipole(sp.r, sp.cosT, sp.sinT, sp.ei, ynm.data(), ynmTheta.data());
+            for (int j = 0; j < order; ++j) {
+                for (int k = 0; k <= j; ++k) {
+                    Complex L = 0;
+                    for (int n = j; n < order; ++n) {
+                        for (int m = j + k - n; m < 0; ++m) {
+                            int jnkm = (n - j) * (n - j) + n - j + m - k;
+                            L += mul(std::conj(Lj[n * (n + 1) / 2 - m]), ynm[jnkm]) * oddOrEven(k);
+                        }
+                        for (int m = 0; m <= n; ++m) {
+                            if (n - j >= std::abs(m - k)) {
+                                int jnkm = (n - j) * (n - j) + n - j + m - k;
+                                L += mul(Lj[n * (n + 1) / 2 + m], ynm[jnkm]) * oddOrEven((m - k) * (m < k));
+                            }
+                        }
+                    }
+                    Li[j * (j + 1) / 2 + k] += L;
+                }
+            }
+        }
+    }
+
+    void l2p(const LinearOctree &tree, size_t node) {
+        const auto &nodes = tree.getNodes();
+        const auto &bodies = tree.getBodies();
+        std::vector<Complex> ynm(order * order), ynmTheta(order * order);
+        const Complex *L = &locals[node * stride];
+        for (uint32_t b = nodes.bodyBegin[node]; b < nodes.bodyEnd[node]; ++b) {
+            Spherical s = toSpherical(bodies.x[b] - centerX[node], bodies.y[b] - centerY[node],
+                                      bodies.z[b] - centerZ[node]);
+            if (s.r < 1e-12 * nodes.width[node]) {
+                // Ciało w środku rozwinięcia: gradient pochodzi tylko z wyrazów n = 1
+                phi[b] += L[0].real();
+                gradient[b] += Vec3(L[2].real(), -L[2].imag(), -L[1].real());
+                continue;
+            }
+            double r = s.r;
+            evalMultipole(r, s.cosT, s.sinT, s.ei, ynm.data(), ynmTheta.data());
+            double pot = 0, sr = 0, st = 0, sp = 0;
+            for (int n = 0; n < order; ++n) {
+                int nm = n * n + n;
+                int nms = n * (n + 1) / 2;
+                double re = mul(L[nms], ynm[nm]).real();
+                pot += re;
+                sr += re / r * n;
+                st += mul(L[nms], ynmTheta[nm]).real();
+                for (int m = 1; m <= n; ++m) {
+                    nm = n * n + n + m;
+                    nms = n * (n + 1) / 2 + m;
+                    Complex lm = mul(L[nms], ynm[nm]);
+                    pot += 2 * lm.real();
+                    sr += 2 * lm.real() / r * n;
+                    st += 2 * mul(L[nms], ynmTheta[nm]).real();
+                    sp -= 2 * lm.imag() * m;
+                }
+            }
+            double sinT = s.sinT < 1e-12 ? 1e-12 : s.sinT;
+            double cosP = s.ei.real(), sinP = s.ei.imag();
+            phi[b] += pot;
+            gradient[b] += Vec3(s.sinT * cosP * sr + s.cosT * cosP / r * st - sinP / r / sinT * sp,
+                                s.sinT * sinP * sr + s.cosT * sinP / r * st + cosP / r / sinT * sp,
+                                s.cosT * sr - s.sinT / r * st);
+        }
+    }
+
+    void p2p(const LinearOctree &tree, size_t ci, size_t cj) {
+        const auto &nodes = tree.getNodes();
+        const auto &bodies = tree.getBodies();
+        for (uint32_t i = nodes.bodyBegin[ci]; i < nodes.bodyEnd[ci]; ++i) {
+            double p = 0, gx = 0, gy = 0, gz = 0;
+            for (uint32_t j = nodes.bodyBegin[cj]; j < nodes.bodyEnd[cj]; ++j) {
+                if (heavy[j]) continue;
+                double dx = bodies.x[j] - bodies.x[i];
+                double dy = bodies.y[j] - bodies.y[i];
+                double dz = bodies.z[j] - bodies.z[i];
+                double r2 = dx * dx + dy * dy + dz * dz;
+                if (r2 == 0) continue;
+                double eps = (bodies.radius[i] + bodies.radius[j]) * SOFTENING;
+                double inv = 1.0 / std::sqrt(r2 + eps * eps);
+                double mInv = bodies.mass[j] * inv;
+                double mInv3 = mInv * inv * inv;
+                p += mInv;
+                gx += dx * mInv3;
+                gy += dy * mInv3;
+                gz += dz * mInv3;
+            }
+            phi[i] += p;
+            gradient[i] += Vec3(gx, gy, gz);
+        }
+    }
+
+    void traverse(const LinearOctree &tree, size_t ci, size_t cj, Complex *ynm, size_t &nP2P, size_t &nM2L) {
+        const auto &nodes = tree.getNodes();
+        double dx = centerX[ci] - centerX[cj];
+        double dy = centerY[ci] - centerY[cj];
+        double dz = centerZ[ci] - centerZ[cj];
+        double r2 = (dx * dx + dy * dy + dz * dz) * theta * theta;
+        double rr = radius[ci] + radius[cj];
+
+        if (r2 > rr * rr) {
+            m2l(ci, cj, ynm);
+            ++nM2L;
+        } else if (nodes.isLeaf(ci) && nodes.isLeaf(cj)) {
+            p2p(tree, ci, cj);
+            ++nP2P;
+        } else if (nodes.isLeaf(cj) || (!nodes.isLeaf(ci) && radius[ci] >= radius[cj])) {
+            for (uint32_t c = nodes.firstChild[ci]; c < nodes.firstChild[ci] + nodes.childCount[ci]; ++c) {
+                traverse(tree, c, cj, ynm, nP2P, nM2L);
+            }
+        } else {
+            for (uint32_t c = nodes.firstChild[cj]; c < nodes.firstChild[cj] + nodes.childCount[cj]; ++c) {
+                traverse(tree, ci, c, ynm, nP2P, nM2L);
+            }
+        }
+    }
+
+public:
+    void setOrder(int p) { order = std::clamp(p, 2, 20); }
+    int getOrder() const { return order; }
+    void setTheta(double t) { theta = t; }
+    double getTheta() const { return theta; }
+    void setThreads(unsigned n) { workers.threads = std::max(1u, n); }
+    void setPool(Parallel::ThreadPool *pool) { workers.pool = pool; }
+    // Wynik bitowo ten sam przy każdej liczbie wątków
+    void setReproducible(bool enable) { reproducible = enable; }
+    // 0 wyłącza wydzielanie ciężkich ciał
+    void setHeavyMassRatio(double ratio) { heavyMassRatio = ratio; }
+    double getHeavyMassRatio() const { return heavyMassRatio; }
+
+    const FmmStats &getStats() const { return stats; }
+
+    // Wyniki w kolejności posortowanej drzewa: potencjał Σm/r i jego gradient
+    const std::vector<double> &getPotentials() const { return phi; }
+    const std::vector<Vec3> &getGradients() const { return gradient; }
+
+    Vec3 acceleration(size_t sortedIndex) const { return gradient[sortedIndex] * Physics::G; }
+
+    void evaluate(const LinearOctree &tree) {
+        using Clock = std::chrono::high_resolution_clock;
+        const auto &nodes = tree.getNodes();
+        const auto &levels = tree.getLevels();
+        size_t numNodes = nodes.size();
+        size_t numBodies = tree.getBodies().size();
+
+        stats = FmmStats();
+        stride = static_cast<size_t>(order * (order + 1) / 2);
+        multipoles.assign(numNodes * stride, Complex(0, 0));
+        locals.assign(numNodes * stride, Complex(0, 0));
+        phi.assign(numBodies, 0.0);
+        gradient.assign(numBodies, Vec3(0, 0, 0));
+        radius.resize(numNodes);
+        centerX.resize(numNodes);
+        centerY.resize(numNodes);
+        centerZ.resize(numNodes);
+        lightMass.resize(numNodes);
+        if (numNodes == 0) return;
+
+        auto start = Clock::now();
+        const auto &bodies = tree.getBodies();
+        heavy.assign(numBodies, 0);
+        heavyBodies.clear();
+        if (heavyMassRatio > 0 && numBodies > 0) {
+            std::vector<double> masses(bodies.mass);
+            std::nth_element(masses.begin(), masses.begin() + numBodies / 2, masses.end());
+            double limit = masses[numBodies / 2] * heavyMassRatio;
+            for (size_t i = 0; i < numBodies; ++i) {
+                if (limit > 0 && bodies.mass[i] > limit) {
+                    heavy[i] = 1;
+                    heavyBodies.push_back(static_cast<uint32_t>(i));
+                }
+            }
+        }
+        stats.heavy = heavyBodies.size();
+
+        for (size_t level = levels.size() - 1; level-- > 0;) {
+            workers.forRange(levels[level], levels[level + 1], [&](size_t b, size_t e, size_t) {
+                for (size_t n = b; n < e; ++n) {
+                    // Środek rozwinięcia: środek masy lekkich ciał
+                    double m = 0, x = 0, y = 0, z = 0;
+                    if (nodes.isLeaf(n)) {
+                        for (uint32_t i = nodes.bodyBegin[n]; i < nodes.bodyEnd[n]; ++i) {
+                            if (heavy[i]) continue;
+                            m += bodies.mass[i];
+                            x += bodies.x[i] * bodies.mass[i];
+                            y += bodies.y[i] * bodies.mass[i];
+                            z += bodies.z[i] * bodies.mass[i];
+                        }
+                    } else {
+                        for (uint32_t c = nodes.firstChild[n]; c < nodes.firstChild[n] + nodes.childCount[n]; ++c) {
+                            m += lightMass[c];
+                            x += centerX[c] * lightMass[c];
+                            y += centerY[c] * lightMass[c];
+                            z += centerZ[c] * lightMass[c];
+                        }
+                    }
+                    lightMass[n] = m;
+                    centerX[n] = m > 0 ? x / m : nodes.centerX[n];
+                    centerY[n] = m > 0 ? y / m : nodes.centerY[n];
+                    centerZ[n] = m > 0 ? z / m : nodes.centerZ[n];
+
+                    // Promień ciasny: najdalsze ciało od środka rozwinięcia, a nie pół przekątnej sześcianu
+                    double r = 0;
+                    if (nodes.isLeaf(n)) {
+                        for (uint32_t i = nodes.bodyBegin[n]; i < nodes.bodyEnd[n]; ++i) {
+                            double dx = bodies.x[i] - centerX[n];
+                            double dy = bodies.y[i] - centerY[n];
+                            double dz = bodies.z[i] - centerZ[n];
+                            r = std::max(r, std::sqrt(dx * dx + dy * dy + dz * dz));
+                        }
+                        p2m(tree, n);
+                    } else {
+                        for (uint32_t c = nodes.firstChild[n]; c < nodes.firstChild[n] + nodes.childCount[n]; ++c) {
+                            double dx = centerX[c] - centerX[n];
+                            double dy = centerY[c] - centerY[n];
+                            double dz = centerZ[c] - centerZ[n];
+                            r = std::max(r, std::sqrt(dx * dx + dy * dy + dz * dz) + radius[c]);
+                        }
+                        m2m(tree, n);
+                    }
+                    radius[n] = r;
+                }
+            }, 64);
+        }
+        auto upward = Clock::now();
+
+        // Cele dzielimy na rozłączne poddrzewa, żeby wątki pisały do różnych węzłów. Podział zmienia
+        // kolejność przejścia par węzłów, więc w trybie powtarzalnym nie zależy od liczby wątków.
+        std::vector<size_t> targets{0};
+        size_t wanted = 8 * static_cast<size_t>(reproducible ? REPRODUCIBLE_THREADS : workers.threads);
+        while (targets.size() < wanted) {
+            std::vector<size_t> next;
+            bool split = false;
+            for (size_t t: targets) {
+                if (nodes.isLeaf(t)) {
+                    next.push_back(t);
+                } else {
+                    split = true;
+                    for (uint32_t c = nodes.firstChild[t]; c < nodes.firstChild[t] + nodes.childCount[t]; ++c) {
+                        next.push_back(c);
+                    }
+                }
+            }
+            targets.swap(next);
+            if (!split) break;
+        }
+
+        std::vector<size_t> p2pCount(workers.size(), 0), m2lCount(workers.size(), 0);
+        workers.forRange(0, targets.size(), [&](size_t b, size_t e, size_t chunk) {
+            std::vector<Complex> ynm(order * order);
+            for (size_t t = b; t < e; ++t) {
+                traverse(tree, targets[t], 0, ynm.data(), p2pCount[chunk], m2lCount[chunk]);
+            }
+        }, 1);
+        for (unsigned t = 0; t < workers.size(); ++t) {
+            stats.p2p += p2pCount[t];
+            stats.m2l += m2lCount[t];
+        }
+        auto traversed = Clock::now();
+
+        for (size_t level = 0; level + 1 < levels.size(); ++level) {
+            workers.forRange(levels[level], levels[level + 1], [&](size_t b, size_t e, size_t) {
+                for (size_t n = b; n < e; ++n) {
+                    if (nodes.isLeaf(n)) l2p(tree, n);
+                    else l2l(tree, n);
+                }
+            }, 64);
+        }
+
+        if (!heavyBodies.empty()) {
+            workers.forRange(0, numBodies, [&](size_t b, size_t e, size_t) {
+                for (size_t i = b; i < e; ++i) {
+                    for (uint32_t j: heavyBodies) {
+                        double dx = bodies.x[j] - bodies.x[i];
+                        double dy = bodies.y[j] - bodies.y[i];
+                        double dz = bodies.z[j] - bodies.z[i];
+                        double r2 = dx * dx + dy * dy + dz * dz;
+                        if (r2 == 0) continue;
+                        double eps = (bodies.radius[i] + bodies.radius[j]) * SOFTENING;
+                        double inv = 1.0 / std::sqrt(r2 + eps * eps);
+                        double mInv = bodies.mass[j] * inv;
+                        phi[i] += mInv;
+                        gradient[i] += Vec3(dx, dy, dz) * (mInv * inv * inv);
+                    }
+                }
+            });
+        }
+        auto downward = Clock::now();
+
+        stats.upwardTime = std::chrono::duration<double>(upward - start).count();
+        stats.traversalTime = std::chrono::duration<double>(traversed - upward).count();
+        stats.downwardTime = std::chrono::duration<double>(downward - traversed).count();
+    }
+};
@@ -0,0 +1,195 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <vector>
+
+// IAS15 (Rein & Spiegel 2015): przyspieszenie w kroku dt to wielomian 8. stopnia
+//   a(t) = a0 + b0 t + b1 t^2 + ... + b6 t^7,   t = czas / dt w [0, 1],
+// dopasowany w 7 węzłach Gaussa-Radaua iteracją predyktor-korektor (15. rząd dla położeń).
+// Współczynniki liczone są przez ilorazy różnicowe g w postaci Newtona; krok wynika z wielkości
+// b6 względem przyspieszenia, a przewidywanie b na następny krok skraca iterację zwykle do 1-2
+// przebiegów. Położenia i prędkości sumowane z kompensacją Kahana.
+namespace IAS15 {
+
+inline constexpr std::array<double, 8> SPACING = {
+    0.0,
+    0.0562625605369221464656521910318,
+    0.180240691736892364987579942780,
+    0.352624717113169637373907769648,
+    0.547153626330555383001448554766,
+    0.734210177215410531523210605558,
+    0.885320946839095768090359771030,
+    0.977520613561287501891174488626};
+
+inline constexpr int MAX_ITERATIONS = 12;
+inline constexpr double SAFETY = 0.25;
+
+// C[j][k] - współczynnik przy t^(k+1) w t (t - h1) ... (t - hj): wkład g_j do b_k
+inline constexpr auto C = [] {
+    std::array<std::array<double, 7>, 7> c{};
+    for (int j = 0; j < 7; ++j) {
+        std::array<double, 8> p{};
+        p[0] = 1;
+        for (int m = 1; m <= j; ++m) {
+            for (int d = m; d > 0; --d) p[d] = p[d - 1] - SPACING[m] * p[d];
+            p[0] = -SPACING[m] * p[0];
+        }
+        for (int k = 0; k <= j; ++k) c[j][k] = p[k];
+    }
+    return c;
+}();
+
+struct State {
+    std::array<std::vector<double>, 7> b, e, g;
+    std::vector<double> a0, csx, csv, xs, vs, at;
+    bool ready = false; // a0 odpowiada bieżącemu stanowi
+    double dt = 0;      // następny krok
+    double optimal = 0; // krok z kryterium błędu przed ograniczeniem wzrostu
+    size_t iterations = 0;
+
+    void reset(size_t dim) {
+        for (int k = 0; k < 7; ++k) {
+            b[k].assign(dim, 0);
+            e[k].assign(dim, 0);
+            g[k].assign(dim, 0);
+        }
+        for (auto *buffer: {&a0, &csx, &csv, &xs, &vs, &at}) buffer->assign(dim, 0);
+        ready = false;
+    }
+
+    // Zmienia następny krok, przeskalowując przewidziane b i e do nowej zmiennej t
+    void retime(double next) {
+        if (dt == 0) {
+            dt = next;
+            return;
+        }
+        double q = next / dt, scale = q;
+        for (int k = 0; k < 7; ++k, scale *= q) {
+            for (size_t i = 0; i < b[k].size(); ++i) {
+                b[k][i] *= scale;
+                e[k][i] *= scale;
+            }
+        }
+        dt = next;
+    }
+};
+
+// Kahan: x += dx z poprawką cs
+inline void add(double &x, double &cs, double dx) {
+    double y = dx - cs, t = x + y;
+    cs = (t - x) - y;
+    x = t;
+}
+
+// Jeden krok dt stanu (x, v); evaluate(x, v, a). Zwraca false, gdy krok odrzucono - stan bez
+// zmian, a s.dt to krótszy krok do ponowienia. Po przyjęciu s.dt to proponowany następny krok,
+// a s.at - przyspieszenie na końcu kroku z wielomianu.
+template<typename Evaluate>
+inline bool step(State &s, std::vector<double> &x, std::vector<double> &v, double dt, double epsilon,
+                 Evaluate &&evaluate) {
+    const size_t dim = x.size();
+    // b przewidziano dla kroku s.dt
+    if (dt != s.dt) s.retime(dt);
+    if (!s.ready) {
+        evaluate(x, v, s.a0);
+        s.ready = true;
+    }
+
+    // g z przewidzianych b (układ trójkątny z jedynkami na przekątnej)
+    for (size_t i = 0; i < dim; ++i) {
+        for (int j = 6; j >= 0; --j) {
+            double value = s.b[j][i];
+            for (int m = j + 1; m < 7; ++m) value -= C[m][j] * s.g[m][i];
+            s.g[j][i] = value;
+        }
+    }
+
+    double previous = std::numeric_limits<double>::infinity();
+    for (int iteration = 0; iteration < MAX_ITERATIONS; ++iteration) {
+        ++s.iterations;
+        double change = 0, scale = 0;
+        for (int n = 1; n < 8; ++n) {
+            const double h = SPACING[n];
+            for (size_t i = 0; i < dim; ++i) {
+                double dx = s.a0[i] / 2, dv = s.a0[i];
+                double power = h;
+                for (int k = 0; k < 7; ++k, power *= h) {
+                    dx += s.b[k][i] * power / ((k + 2) * (k + 3));
+                    dv += s.b[k][i] * power / (k + 2);
+                }
+                s.xs[i] = x[i] + dt * h * (v[i] + dt * h * dx);
+                s.vs[i] = v[i] + dt * h * dv;
+            }
+            evaluate(s.xs, s.vs, s.at);
+
+            for (size_t i = 0; i < dim; ++i) {
+                double value = (s.at[i] - s.a0[i]) / h;
+                for (int m = 1; m < n; ++m) value = (value - s.g[m - 1][i]) / (h - SPACING[m]);
+                double delta = value - s.g[n - 1][i];
+                s.g[n - 1][i] = value;
+                for (int k = 0; k < n; ++k) s.b[k][i] += delta * C[n - 1][k];
+                if (n == 7) {
+                    change = std::max(change, std::abs(delta));
+                    scale = std::max(scale, std::abs(s.at[i]));
+                }
+            }
+        }
+
+        // Zbieżność do błędu zaokrągleń; gdy przestaje maleć, dalsze przebiegi nic nie dają
+        double error = scale > 0 ? change / scale : 0;
+        if (error < 1e-16 || (iteration > 1 && error >= previous)) break;
+        previous = error;
+    }
+
+    double b6 = 0, scale = 0;
+    for (size_t i = 0; i < dim; ++i) {
+        b6 = std::max(b6, std::abs(s.b[6][i]));
+        scale = std::max(scale, std::abs(s.at[i]));
+    }
+    double error = scale > 0 ? b6 / scale : 0;
+    double ratio = error > 0 && std::isfinite(error) ? std::pow(epsilon / error, 1.0 / 7)
+                                                     : std::numeric_limits<double>::infinity();
+    s.optimal = dt * ratio;
+    ratio = std::min(ratio, 1 / SAFETY);
+    if (ratio < SAFETY) {
+        s.retime(dt * ratio);
+        return false;
+    }
+
+    for (size_t i = 0; i < dim; ++i) {
+        double dx = s.a0[i] / 2, dv = s.a0[i], end = s.a0[i];
+        for (int k = 0; k < 7; ++k) {
+            dx += s.b[k][i] / ((k + 2) * (k + 3));
+            dv += s.b[k][i] / (k + 2);
+            end += s.b[k][i];
+        }
+        s.at[i] = end;
+        add(x[i], s.csx[i], dt * (v[i] + dt * dx));
+        add(v[i], s.csv[i], dt * dv);
+    }
+    s.ready = false;
+
+    // Przewidywanie na krok q dt: a(1 + q t) rozwinięte w t, plus poprawka poprzedniej predykcji
+    const double q = ratio;
+    for (size_t i = 0; i < dim; ++i) {
+        double old[7];
+        for (int k = 0; k < 7; ++k) old[k] = s.b[k][i];
+        double power = q;
+        for (int m = 0; m < 7; ++m, power *= q) {
+            double sum = 0, binomial = 1; // C(k + 1, m + 1) dla k = m
+            for (int k = m; k < 7; ++k) {
+                sum += old[k] * binomial;
+                binomial = binomial * (k + 2) / (k + 1 - m);
+            }
+            double correction = old[m] - s.e[m][i];
+            s.e[m][i] = power * sum;
+            s.b[m][i] = s.e[m][i] + correction;
+        }
+    }
+    s.dt = dt * ratio;
+    return true;
+}
+}
@@ -1,78 +1,348 @@
 #pragma once
 #include "body.h"
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
 #include <functional>
+#include <utility>
+#include <vector>
 
 namespace Integrators {
 using ForceFunc = std::function<Vec3(const Body &)>;
 
-inline void euler(Body &body, double dt, const ForceFunc &force) {
-  Vec3 acc = force(body) / body.mass;
-  body.vel += acc * dt;
-  body.pos += body.vel * dt;
-  body.acc = acc;
+// Jądra na samym stanie (pos, vel, acc); force() zwraca siłę dla bieżącego stanu.
+// Wersje dla Body poniżej i pętle SoA w PhysicsEngine liczą dokładnie to samo.
+
+template<typename Force>
+inline void euler(Vec3 &pos, Vec3 &vel, Vec3 &acc, double mass, double dt, Force &&force) {
+  Vec3 a = force() / mass;
+  vel += a * dt;
+  pos += vel * dt;
+  acc = a;
 }
 
-inline void verlet(Body &body, double dt, const ForceFunc &force) {
-  Vec3 acc = force(body) / body.mass;
-  body.pos += body.vel * dt + acc * (0.5 * dt * dt);
-  Vec3 newAcc = force(body) / body.mass;
-  body.vel += (acc + newAcc) * (0.5 * dt);
-  body.acc = newAcc;
+template<typename Force>
+inline void verlet(Vec3 &pos, Vec3 &vel, Vec3 &acc, double mass, double dt, Force &&force) {
+  Vec3 a = force() / mass;
+  pos += vel * dt + a * (0.5 * dt * dt);
+  Vec3 newAcc = force() / mass;
+  vel += (a + newAcc) * (0.5 * dt);
+  acc = newAcc;
 }
 
-inline void rk4(Body &body, double dt, const ForceFunc &force) {
-  Vec3 p0 = body.pos, v0 = body.vel;
+template<typename Force>
+inline void rk4(Vec3 &pos, Vec3 &vel, Vec3 &acc, double mass, double dt, Force &&force) {
+  Vec3 p0 = pos, v0 = vel;
 
-  Vec3 k1v = force(body) / body.mass;
+  Vec3 k1v = force() / mass;
   Vec3 k1p = v0;
 
-  body.pos = p0 + k1p * (dt * 0.5);
-  body.vel = v0 + k1v * (dt * 0.5);
-  Vec3 k2v = force(body) / body.mass;
-  Vec3 k2p = body.vel;
+  pos = p0 + k1p * (dt * 0.5);
+  vel = v0 + k1v * (dt * 0.5);
+  Vec3 k2v = force() / mass;
+  Vec3 k2p = vel;
 
-  body.pos = p0 + k2p * (dt * 0.5);
-  body.vel = v0 + k2v * (dt * 0.5);
-  Vec3 k3v = force(body) / body.mass;
-  Vec3 k3p = body.vel;
+  pos = p0 + k2p * (dt * 0.5);
+  vel = v0 + k2v * (dt * 0.5);
+  Vec3 k3v = force() / mass;
+  Vec3 k3p = vel;
 
-  body.pos = p0 + k3p * dt;
-  body.vel = v0 + k3v * dt;
-  Vec3 k4v = force(body) / body.mass;
-  Vec3 k4p = body.vel;
+  pos = p0 + k3p * dt;
+  vel = v0 + k3v * dt;
+  Vec3 k4v = force() / mass;
+  Vec3 k4p = vel;
 
-  body.pos = p0 + (k1p + k2p * 2.0 + k3p * 2.0 + k4p) * (dt / 6.0);
-  body.vel = v0 + (k1v + k2v * 2.0 + k3v * 2.0 + k4v) * (dt / 6.0);
-  body.acc = k4v;
+  pos = p0 + (k1p + k2p * 2.0 + k3p * 2.0 + k4p) * (dt / 6.0);
+  vel = v0 + (k1v + k2v * 2.0 + k3v * 2.0 + k4v) * (dt / 6.0);
+  acc = k4v;
 }
 
-inline void leapfrog(Body &body, double dt, const ForceFunc &force) {
-  Vec3 acc = force(body) / body.mass;
-  body.vel += acc * (dt * 0.5);
-  body.pos += body.vel * dt;
-  Vec3 newAcc = force(body) / body.mass;
-  body.vel += newAcc * (dt * 0.5);
-  body.acc = newAcc;
+template<typename Force>
+inline void leapfrog(Vec3 &pos, Vec3 &vel, Vec3 &acc, double mass, double dt, Force &&force) {
+  Vec3 a = force() / mass;
+  vel += a * (dt * 0.5);
+  pos += vel * dt;
+  Vec3 newAcc = force() / mass;
+  vel += newAcc * (dt * 0.5);
+  acc = newAcc;
 }
 
-inline void yoshida4(Body &body, double dt, const ForceFunc &force) {
+template<typename Force>
+inline void yoshida4(Vec3 &pos, Vec3 &vel, Vec3 &acc, double mass, double dt, Force &&force) {
   const double w0 = -1.702414383919315;
   const double w1 = 1.351207191959658;
   const double c1 = w1 / 2.0;
   const double c2 = (w0 + w1) / 2.0;
   const double d1 = w1;
   const double d2 = w0;
-  
-  body.pos += body.vel * (c1 * dt);
-  Vec3 acc = force(body) / body.mass;
-  body.vel += acc * (d1 * dt);
-  body.pos += body.vel * (c2 * dt);
-  acc = force(body) / body.mass;
-  body.vel += acc * (d2 * dt);
-  body.pos += body.vel * (c2 * dt);
-  acc = force(body) / body.mass;
-  body.vel += acc * (d1 * dt);
-  body.pos += body.vel * (c1 * dt);
-  body.acc = acc;
+
+  pos += vel * (c1 * dt);
+  Vec3 a = force() / mass;
+  vel += a * (d1 * dt);
+  pos += vel * (c2 * dt);
+  a = force() / mass;
+  vel += a * (d2 * dt);
+  pos += vel * (c2 * dt);
+  a = force() / mass;
+  vel += a * (d1 * dt);
+  pos += vel * (c1 * dt);
+  acc = a;
+}
+
+template<typename Force>
+inline void euler(Body &body, double dt, Force &&force) {
+  euler(body.pos, body.vel, body.acc, body.mass, dt, [&] { return force(body); });
+}
+
+template<typename Force>
+inline void verlet(Body &body, double dt, Force &&force) {
+  verlet(body.pos, body.vel, body.acc, body.mass, dt, [&] { return force(body); });
+}
+
+template<typename Force>
+inline void rk4(Body &body, double dt, Force &&force) {
+  rk4(body.pos, body.vel, body.acc, body.mass, dt, [&] { return force(body); });
+}
+
+template<typename Force>
+inline void leapfrog(Body &body, double dt, Force &&force) {
+  leapfrog(body.pos, body.vel, body.acc, body.mass, dt, [&] { return force(body); });
+}
+
+template<typename Force>
+inline void yoshida4(Body &body, double dt, Force &&force) {
+  yoshida4(body.pos, body.vel, body.acc, body.mass, dt, [&] { return force(body); });
+}
+
+// Całkowanie całego układu naraz. Wersje powyżej dostają siłę dla jednego ciała, więc przy
+// sile policzonej raz na krok ich dodatkowe etapy nic nie wnoszą. Tutaj każdy etap przesuwa
+// wszystkie ciała, a evaluate() przelicza przyspieszenia ax/ay/az całego układu z bieżących
+// pozycji i prędkości - jedno obliczenie sił na etap. Ciała z move[i] == 0 stoją w miejscu,
+// ale dalej działają na inne. loop(n, fn) wykonuje fn(begin, end) na kawałkach [0, n).
+struct SystemState {
+  double *px, *py, *pz;
+  double *vx, *vy, *vz;
+  double *ax, *ay, *az;
+  const uint8_t *move;
+  size_t n;
+};
+
+struct SerialLoop {
+  template<typename Fn>
+  void operator()(size_t n, Fn &&fn) const { fn(size_t(0), n); }
+};
+
+// Bufory stanu pośredniego RK4 (pozycje i prędkości startowe, sumy etapów)
+struct SystemScratch {
+  std::vector<double> data;
+  size_t n = 0;
+
+  void resize(size_t count) {
+    n = count;
+    data.resize(12 * count);
+  }
+
+  double *operator[](int k) { return data.data() + size_t(k) * n; }
+};
+
+template<typename Loop>
+inline void drift(SystemState &s, double h, Loop &&loop) {
+  loop(s.n, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+      if (!s.move[i]) continue;
+      s.px[i] += s.vx[i] * h;
+      s.py[i] += s.vy[i] * h;
+      s.pz[i] += s.vz[i] * h;
+    }
+  });
+}
+
+template<typename Loop>
+inline void kick(SystemState &s, double h, Loop &&loop) {
+  loop(s.n, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+      if (!s.move[i]) continue;
+      s.vx[i] += s.ax[i] * h;
+      s.vy[i] += s.ay[i] * h;
+      s.vz[i] += s.az[i] * h;
+    }
+  });
+}
+
+// Półjawny Euler: 1 obliczenie sił
+template<typename Eval, typename Loop = SerialLoop>
+inline void euler(SystemState &s, double dt, Eval &&evaluate, Loop &&loop = Loop()) {
+  evaluate();
+  kick(s, dt, loop);
+  drift(s, dt, loop);
+}
+
+// Kick-drift-kick: 2 obliczenia sił. Prędkościowy Verlet to ten sam schemat
+// (x += v dt + a dt^2 / 2 == x += (v + a dt / 2) dt). Przyspieszenia z końca kroku pasują do
+// początku następnego - gdy stan się nie zmienił, accelerationReady pomija pierwsze obliczenie.
+template<typename Eval, typename Loop = SerialLoop>
+inline void leapfrog(SystemState &s, double dt, Eval &&evaluate, Loop &&loop = Loop(),
+                     bool accelerationReady = false) {
+  if (!accelerationReady) evaluate();
+  kick(s, dt * 0.5, loop);
+  drift(s, dt, loop);
+  evaluate();
+  kick(s, dt * 0.5, loop);
+}
+
+template<typename Eval, typename Loop = SerialLoop>
+inline void verlet(SystemState &s, double dt, Eval &&evaluate, Loop &&loop = Loop(),
+                   bool accelerationReady = false) {
+  leapfrog(s, dt, evaluate, loop, accelerationReady);
+}
+
+// Klasyczny RK4 dla x' = v, v' = a(x, v): 4 obliczenia sił
+template<typename Eval, typename Loop = SerialLoop>
+inline void rk4(SystemState &s, double dt, SystemScratch &scratch, Eval &&evaluate, Loop &&loop = Loop()) {
+  scratch.resize(s.n);
+  double *pos[3] = {s.px, s.py, s.pz};
+  double *vel[3] = {s.vx, s.vy, s.vz};
+  double *acc[3] = {s.ax, s.ay, s.az};
+  double *pos0[3], *vel0[3], *sumPos[3], *sumVel[3];
+  for (int c = 0; c < 3; ++c) {
+    pos0[c] = scratch[c];
+    vel0[c] = scratch[3 + c];
+    sumPos[c] = scratch[6 + c];
+    sumVel[c] = scratch[9 + c];
+  }
+
+  loop(s.n, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+      for (int c = 0; c < 3; ++c) {
+        pos0[c][i] = pos[c][i];
+        vel0[c][i] = vel[c][i];
+        sumPos[c][i] = 0;
+        sumVel[c][i] = 0;
+      }
+    }
+  });
+
+  const double weight[4] = {1, 2, 2, 1};
+  const double advance[3] = {dt * 0.5, dt * 0.5, dt};
+  for (int k = 0; k < 4; ++k) {
+    evaluate();
+    loop(s.n, [&](size_t begin, size_t end) {
+      for (size_t i = begin; i < end; ++i) {
+        if (!s.move[i]) continue;
+        for (int c = 0; c < 3; ++c) {
+          double kPos = vel[c][i], kVel = acc[c][i];
+          sumPos[c][i] += weight[k] * kPos;
+          sumVel[c][i] += weight[k] * kVel;
+          if (k < 3) {
+            pos[c][i] = pos0[c][i] + kPos * advance[k];
+            vel[c][i] = vel0[c][i] + kVel * advance[k];
+          }
+        }
+      }
+    });
+  }
+
+  loop(s.n, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+      if (!s.move[i]) continue;
+      for (int c = 0; c < 3; ++c) {
+        pos[c][i] = pos0[c][i] + sumPos[c][i] * (dt / 6.0);
+        vel[c][i] = vel0[c][i] + sumVel[c][i] * (dt / 6.0);
+      }
+    }
+  });
+}
+
+// Schemat rozszczepienia drift-kick-drift: x += c_0 dt v, v += d_0 dt a, x += c_1 dt v, ...,
+// v += d_{N-1} dt a, x += c_N dt v. N kicków to N obliczeń sił na krok.
+template<size_t Stages>
+struct Splitting {
+  std::array<double, Stages + 1> drift{};
+  std::array<double, Stages> kick{};
+
+  // Zgodność schematu: współczynniki drift i kick sumują się do 1
+  constexpr bool consistent() const {
+    double c = 0, d = 0;
+    for (double x: drift) c += x;
+    for (double x: kick) d += x;
+    return (c - 1) * (c - 1) < 1e-24 && (d - 1) * (d - 1) < 1e-24;
+  }
+};
+
+// Kompozycja symetryczna S(w_m dt) ... S(w_1 dt) S(w_0 dt) S(w_1 dt) ... S(w_m dt) leapfrogu
+// S(h) = D(h/2) K(h) D(h/2) z wag {w_0, w_1, ..., w_m} (numeracja Yoshidy); sąsiednie drifty
+// się sklejają, więc zostaje 2m + 1 kicków
+template<size_t M>
+constexpr Splitting<2 * M - 1> symmetric(const std::array<double, M> &w) {
+  constexpr size_t stages = 2 * M - 1;
+  std::array<double, stages> weight{};
+  for (size_t k = 0; k < M; ++k) {
+    weight[M - 1 - k] = w[k];
+    weight[M - 1 + k] = w[k];
+  }
+  Splitting<stages> s;
+  s.drift[0] = weight[0] / 2;
+  for (size_t k = 0; k < stages; ++k) {
+    s.kick[k] = weight[k];
+    s.drift[k + 1] = (weight[k] + (k + 1 < stages ? weight[k + 1] : 0)) / 2;
+  }
+  return s;
+}
+
+// Gotowe schematy do compose<Scheme>(); własny to typ ze statycznym constexpr coefficients
+namespace Compositions {
+struct Leapfrog {
+  static constexpr auto coefficients = symmetric<1>({1.0});
+};
+
+// Yoshida 1990, 4. rząd (potrójny skok): 3 obliczenia sił
+struct Yoshida4 {
+  static constexpr auto coefficients = symmetric<2>({-1.702414383919315, 1.351207191959658});
+};
+
+// Suzuki 1990, 4. rząd z 5 etapów: p = 1 / (4 - 4^(1/3)), mniejsza stała błędu niż Yoshida4
+struct Suzuki4 {
+  static constexpr auto coefficients =
+      symmetric<3>({-0.6579630871775028, 0.4144907717943757, 0.4144907717943757});
+};
+
+// Yoshida 1990, 6. rząd, rozwiązanie A: 7 obliczeń sił
+struct Yoshida6 {
+  static constexpr auto coefficients =
+      symmetric<4>({1.31518632068391, -1.17767998417887, 0.235573213359357, 0.784513610477560});
+};
+
+// Yoshida 1990, 8. rząd, rozwiązanie D: 15 obliczeń sił
+struct Yoshida8 {
+  static constexpr auto coefficients =
+      symmetric<8>({1.70845307078700, 0.102799849391985, -1.96061023297549, 1.93813913762276,
+                    -0.158240635368243, -1.44485223686048, 0.253693336566229, 0.914844246229740});
+};
+
+// Omelyan, Mryglod, Folk 2002 (PEFRL): 4. rząd z 4 obliczeń sił, stała błędu o rząd mniejsza niż Yoshida4
+struct OmelyanPEFRL {
+  static constexpr double xi = 0.1786178958448091, lambda = -0.2123418310626054, chi = -0.06626458266981849;
+  static constexpr Splitting<4> coefficients = {
+      {xi, chi, 1 - 2 * (chi + xi), chi, xi},
+      {(1 - 2 * lambda) / 2, lambda, lambda, (1 - 2 * lambda) / 2}};
+};
+}
+
+// Krok schematem Scheme: etapy rozwinięte w czasie kompilacji, bez pętli i rozgałęzień po etapach
+template<typename Scheme, typename Eval, typename Loop = SerialLoop>
+inline void compose(SystemState &s, double dt, Eval &&evaluate, Loop &&loop = Loop()) {
+  constexpr auto &c = Scheme::coefficients;
+  static_assert(c.consistent(), "drift and kick coefficients must each sum to 1");
+  [&]<size_t... K>(std::index_sequence<K...>) {
+    ((drift(s, c.drift[K] * dt, loop), evaluate(), kick(s, c.kick[K] * dt, loop)), ...);
+  }(std::make_index_sequence<c.kick.size()>());
+  drift(s, c.drift.back() * dt, loop);
+}
+
+// Kompozycja Yoshidy 4. rzędu (drift-kick-drift): 3 obliczenia sił
+template<typename Eval, typename Loop = SerialLoop>
+inline void yoshida4(SystemState &s, double dt, Eval &&evaluate, Loop &&loop = Loop()) {
+  compose<Compositions::Yoshida4>(s, dt, evaluate, loop);
 }
 }
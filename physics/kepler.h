@@ -0,0 +1,117 @@
+#pragma once
+#include "../core/vec3.h"
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+// Ruch keplerowski w zmiennych uniwersalnych (Danby, rozdz. 6.9): jedno sformułowanie dla orbit
+// eliptycznych, parabolicznych i hiperbolicznych. Anomalia uniwersalna X spełnia
+//   t(X) = r0 G1 + eta0 G2 + GM G3,   dt/dX = r(X) = r0 G0 + eta0 G1 + GM G2,
+// gdzie G_k = X^k c_k(beta X^2), c_k - funkcje Stumpffa, eta0 = r0 . v0, beta = 2 GM / r0 - v0^2.
+namespace Kepler {
+
+struct Stumpff {
+    double c0, c1, c2, c3;
+};
+
+// Szereg dla |z| <= 0.1, potem powrót do z przez c_k(4z) wyrażone przez c_k(z)
+inline Stumpff stumpff(double z) {
+    int quarters = 0;
+    while (std::abs(z) > 0.1) {
+        z *= 0.25;
+        ++quarters;
+    }
+    Stumpff s;
+    s.c2 = (1 - z / 12 * (1 - z / 30 * (1 - z / 56 * (1 - z / 90 * (1 - z / 132 * (1 - z / 182)))))) / 2;
+    s.c3 = (1 - z / 20 * (1 - z / 42 * (1 - z / 72 * (1 - z / 110 * (1 - z / 156 * (1 - z / 210)))))) / 6;
+    s.c1 = 1 - z * s.c3;
+    s.c0 = 1 - z * s.c2;
+    for (; quarters > 0; --quarters) {
+        s.c3 = 0.25 * (s.c2 + s.c0 * s.c3);
+        s.c2 = 0.5 * s.c1 * s.c1;
+        s.c1 = s.c0 * s.c1;
+        s.c0 = 2 * s.c0 * s.c0 - 1;
+    }
+    return s;
+}
+
+// Przesuwa (r, v) względem masy gm = G * M o czas dt (także ujemny). Równanie Keplera
+// rozwiązuje Newton w przedziale, który zawsze zawiera pierwiastek (t(X) jest rosnąca),
+// z bisekcją, gdy krok Newtona wychodzi poza przedział.
+inline void drift(Vec3 &r, Vec3 &v, double gm, double dt) {
+    double r0 = r.length();
+    if (dt == 0 || r0 <= 0) return;
+    if (gm <= 0) {
+        r += v * dt;
+        return;
+    }
+    double eta = r.dot(v), beta = 2 * gm / r0 - v.lengthSq();
+
+    double lo, hi;
+    if (beta > 0) {
+        // Po pełnym okresie stan się powtarza; dla |dt| <= P / 2 pierwiastek leży w |X| < 2 pi / sqrt(beta)
+        double root = std::sqrt(beta), period = 2 * M_PI * gm / (beta * root);
+        dt = std::remainder(dt, period);
+        hi = 2 * M_PI / root;
+        lo = -hi;
+    } else {
+        lo = hi = 0;
+    }
+
+    double x = dt / r0 - eta * dt * dt / (2 * r0 * r0 * r0), g0, g1, g2, g3;
+    auto evaluate = [&](double at) {
+        Stumpff s = stumpff(beta * at * at);
+        g0 = s.c0;
+        g1 = at * s.c1;
+        g2 = at * at * s.c2;
+        g3 = at * at * at * s.c3;
+        return r0 * g1 + eta * g2 + gm * g3 - dt;
+    };
+
+    if (beta <= 0) {
+        // Orbita otwarta: przedział rośnie od X = 0 w stronę dt, aż obejmie pierwiastek
+        double step = std::abs(x) > 0 ? std::abs(x) : std::abs(dt) / r0;
+        double &far = dt > 0 ? hi : lo;
+        far = dt > 0 ? step : -step;
+        while ((dt > 0) == (evaluate(far) < 0)) far *= 2;
+    }
+    if (!(x > lo && x < hi)) x = 0.5 * (lo + hi);
+
+    for (int it = 0; it < 60; ++it) {
+        double f = evaluate(x);
+        if (f == 0) break;
+        if (f > 0) hi = x;
+        else lo = x;
+        double rx = r0 * g0 + eta * g1 + gm * g2;
+        double next = x - f / rx;
+        if (!(next > lo && next < hi)) next = 0.5 * (lo + hi);
+        double change = std::abs(next - x);
+        x = next;
+        if (change <= 1e-15 * std::abs(x) || hi - lo <= 1e-15 * std::abs(x)) break;
+    }
+    evaluate(x);
+
+    double radius = r0 * g0 + eta * g1 + gm * g2;
+    double f = 1 - gm * g2 / r0, g = r0 * g1 + eta * g2;
+    double fd = -gm * g1 / (r0 * radius), gd = 1 - gm * g2 / radius;
+    Vec3 r1 = r * f + v * g;
+    v = r * fd + v * gd;
+    r = r1;
+}
+
+// drift() dla ciał [begin, end) w tablicach SoA, każde z własnym gm[i]; ciała ze skip[i] != 0 stoją
+inline void drift(double *x, double *y, double *z, double *vx, double *vy, double *vz, const double *gm,
+                  size_t begin, size_t end, double dt, const uint8_t *skip = nullptr) {
+    for (size_t i = begin; i < end; ++i) {
+        if (skip && skip[i]) continue;
+        Vec3 r(x[i], y[i], z[i]), v(vx[i], vy[i], vz[i]);
+        drift(r, v, gm[i], dt);
+        x[i] = r.x;
+        y[i] = r.y;
+        z[i] = r.z;
+        vx[i] = v.x;
+        vy[i] = v.y;
+        vz[i] = v.z;
+    }
+}
+}
@@ -0,0 +1,188 @@
+#pragma once
+#include "../core/vec3.h"
+#include <array>
+#include <cmath>
+
+// Regularyzacja Kustaanheimo-Stiefela ruchu względnego ciasnej pary. Wektor względny r (3D)
+// zastępuje u (4D) z r = L(u) u, a czas fikcyjny s spełnia dt = |r| ds. W tych zmiennych ruch
+// keplerowski to oscylator harmoniczny u'' = (h / 2) u bez osobliwości przy r -> 0, więc
+// perycentrum nie wymaga krótkich kroków. h = v^2 / 2 - GM / r (energia na jednostkę masy
+// zredukowanej), P - zaburzające przyspieszenie względne od reszty układu:
+//   u'' = (h / 2) u + (r / 2) L^T(u) P,   h' = 2 u' . L^T(u) P,   t' = r
+namespace KS {
+
+using Vec4 = std::array<double, 4>;
+
+struct State {
+    Vec4 u, up; // u i du/ds
+    double h;
+};
+
+// Tensor pływowy reszty układu w środku masy pary: P(r) = T r
+struct Tidal {
+    double xx = 0, xy = 0, xz = 0, yy = 0, yz = 0, zz = 0;
+
+    Vec3 apply(Vec3 r) const {
+        return Vec3(xx * r.x + xy * r.y + xz * r.z, xy * r.x + yy * r.y + yz * r.z, xz * r.x + yz * r.y + zz * r.z);
+    }
+
+    // Wkład masy gm (G * m) w punkcie odległym o d od środka pary
+    void add(Vec3 d, double gm) {
+        double d2 = d.lengthSq();
+        if (d2 <= 0) return;
+        double inv2 = 1.0 / d2;
+        double w = gm * inv2 * inv2 * std::sqrt(inv2);
+        xx += w * (3 * d.x * d.x - d2);
+        yy += w * (3 * d.y * d.y - d2);
+        zz += w * (3 * d.z * d.z - d2);
+        xy += w * 3 * d.x * d.y;
+        xz += w * 3 * d.x * d.z;
+        yz += w * 3 * d.y * d.z;
+    }
+};
+
+inline double dot(const Vec4 &a, const Vec4 &b) { return a[0] * b[0] + a[1] * b[1] + a[2] * b[2] + a[3] * b[3]; }
+
+// r = L(u) u
+inline Vec3 position(const Vec4 &u) {
+    return Vec3(u[0] * u[0] - u[1] * u[1] - u[2] * u[2] + u[3] * u[3], 2 * (u[0] * u[1] - u[2] * u[3]),
+                2 * (u[0] * u[2] + u[1] * u[3]));
+}
+
+// L^T(u) (v, 0)
+inline Vec4 transposed(const Vec4 &u, Vec3 v) {
+    return {u[0] * v.x + u[1] * v.y + u[2] * v.z, -u[1] * v.x + u[0] * v.y + u[3] * v.z,
+            -u[2] * v.x - u[3] * v.y + u[0] * v.z, u[3] * v.x - u[2] * v.y + u[1] * v.z};
+}
+
+// Pierwsze trzy wiersze L(u) w
+inline Vec3 applied(const Vec4 &u, const Vec4 &w) {
+    return Vec3(u[0] * w[0] - u[1] * w[1] - u[2] * w[2] + u[3] * w[3],
+                u[1] * w[0] + u[0] * w[1] - u[3] * w[2] - u[2] * w[3],
+                u[2] * w[0] + u[3] * w[1] + u[0] * w[2] + u[1] * w[3]);
+}
+
+// gm = G * (m1 + m2); r, v - położenie i prędkość drugiego ciała względem pierwszego
+inline State fromCartesian(Vec3 r, Vec3 v, double gm) {
+    State s;
+    double len = r.length();
+    if (r.x >= 0) {
+        double u0 = std::sqrt(0.5 * (len + r.x));
+        s.u = {u0, r.y / (2 * u0), r.z / (2 * u0), 0};
+    } else {
+        double u1 = std::sqrt(0.5 * (len - r.x));
+        s.u = {r.y / (2 * u1), u1, 0, r.z / (2 * u1)};
+    }
+    Vec4 lv = transposed(s.u, v);
+    for (int k = 0; k < 4; ++k) s.up[k] = 0.5 * lv[k];
+    s.h = 0.5 * v.lengthSq() - gm / len;
+    return s;
+}
+
+inline void toCartesian(const State &s, Vec3 &r, Vec3 &v) {
+    r = position(s.u);
+    v = applied(s.u, s.up) * (2.0 / dot(s.u, s.u));
+}
+
+// Niezaburzony ruch o czas dt (h < 0): u(s) = u0 cos ws + u0'/w sin ws, w^2 = -h/2, a czas
+// t(s) = A s + B sin(2ws) / 4w + C (1 - cos 2ws) / 2w^2 rozwiązujemy Newtonem z bisekcją
+inline void advanceKepler(State &s, double dt) {
+    double w = std::sqrt(-0.5 * s.h);
+    double uu = dot(s.u, s.u), pp = dot(s.up, s.up) / (w * w), up = dot(s.u, s.up);
+    double a = 0.5 * (uu + pp), b = uu - pp, c = up;
+    auto time = [&](double x) {
+        return a * x + b * std::sin(2 * w * x) / (4 * w) + c * (1 - std::cos(2 * w * x)) / (2 * w * w);
+    };
+    auto radius = [&](double x) {
+        double cs = std::cos(w * x), sn = std::sin(w * x);
+        return uu * cs * cs + pp * sn * sn + 2 * c / w * sn * cs;
+    };
+
+    double wiggle = std::abs(b) / (4 * w) + std::abs(c) / (w * w);
+    double lo = std::max(0.0, (dt - wiggle) / a), hi = (dt + wiggle) / a;
+    double x = dt / a;
+    for (int it = 0; it < 100; ++it) {
+        double f = time(x) - dt;
+        if (f > 0) hi = x;
+        else lo = x;
+        double next = x - f / radius(x);
+        x = next > lo && next < hi ? next : 0.5 * (lo + hi);
+        if (std::abs(f) <= 1e-15 * dt || hi - lo <= 1e-15 * hi) break;
+    }
+
+    double cs = std::cos(w * x), sn = std::sin(w * x);
+    Vec4 u, p;
+    for (int k = 0; k < 4; ++k) {
+        u[k] = s.u[k] * cs + s.up[k] / w * sn;
+        p[k] = -s.u[k] * w * sn + s.up[k] * cs;
+    }
+    s.u = u;
+    s.up = p;
+}
+
+// Zaburzony ruch o czas dt: RK4 w czasie fikcyjnym, stepsPerOrbit kroków na okres oscylatora.
+// Ostatni krok jest docinany Newtonem (dt/ds = r), żeby trafić dokładnie w dt.
+template<typename Perturbation>
+inline void advance(State &s, double gm, double dt, Perturbation &&perturbation, int stepsPerOrbit = 128) {
+    struct Y {
+        Vec4 u, up;
+        double h, t;
+    };
+    auto derivative = [&](const Y &y) {
+        double r = dot(y.u, y.u);
+        Vec4 lp = transposed(y.u, perturbation(position(y.u)));
+        Y d;
+        d.u = y.up;
+        for (int k = 0; k < 4; ++k) d.up[k] = 0.5 * y.h * y.u[k] + 0.5 * r * lp[k];
+        d.h = 2 * dot(y.up, lp);
+        d.t = r;
+        return d;
+    };
+    auto axpy = [](const Y &y, const Y &d, double f) {
+        Y out;
+        for (int k = 0; k < 4; ++k) {
+            out.u[k] = y.u[k] + d.u[k] * f;
+            out.up[k] = y.up[k] + d.up[k] * f;
+        }
+        out.h = y.h + d.h * f;
+        out.t = y.t + d.t * f;
+        return out;
+    };
+    auto rk4 = [&](const Y &y, double ds) {
+        Y k1 = derivative(y), k2 = derivative(axpy(y, k1, 0.5 * ds));
+        Y k3 = derivative(axpy(y, k2, 0.5 * ds)), k4 = derivative(axpy(y, k3, ds));
+        Y out;
+        for (int k = 0; k < 4; ++k) {
+            out.u[k] = y.u[k] + (k1.u[k] + 2 * k2.u[k] + 2 * k3.u[k] + k4.u[k]) * (ds / 6);
+            out.up[k] = y.up[k] + (k1.up[k] + 2 * k2.up[k] + 2 * k3.up[k] + k4.up[k]) * (ds / 6);
+        }
+        out.h = y.h + (k1.h + 2 * k2.h + 2 * k3.h + k4.h) * (ds / 6);
+        out.t = y.t + (k1.t + 2 * k2.t + 2 * k3.t + k4.t) * (ds / 6);
+        return out;
+    };
+
+    Y y{s.u, s.up, s.h, 0};
+    while (true) {
+        // Częstość oscylatora; przy h >= 0 skala z bieżącej odległości
+        double r = dot(y.u, y.u);
+        double w = std::sqrt(std::max(-0.5 * y.h, gm / (4 * r)));
+        double ds = 2 * M_PI / (w * stepsPerOrbit);
+        Y next = rk4(y, ds);
+        if (next.t < dt) {
+            y = next;
+            continue;
+        }
+
+        double x = (dt - y.t) / r;
+        for (int it = 0; it < 4; ++it) {
+            next = rk4(y, x);
+            x += (dt - next.t) / dot(next.u, next.u);
+        }
+        y = rk4(y, x);
+        break;
+    }
+    s.u = y.u;
+    s.up = y.up;
+    s.h = y.h;
+}
+}
@@ -0,0 +1,465 @@
+#pragma once
+#include "../core/vec3.h"
+#include "../core/constants.h"
+#include "../core/parallel.h"
+#include "../physics/body.h"
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+// Węzły w tablicach ciągłych (układ BFS); dzieci węzła leżą obok siebie od firstChild
+struct LinearOctreeNodes {
+    std::vector<double> centerX, centerY, centerZ, width;
+    std::vector<double> comX, comY, comZ, mass;
+    std::vector<double> reach; // z refit(): największe (promień + przesunięcie od budowy) w poddrzewie
+    std::vector<double> meanRadius; // średni promień ciał ważony masą - zmiękczenie oddziaływania z węzłem
+    std::vector<uint32_t> firstChild, bodyBegin, bodyEnd;
+    std::vector<uint8_t> childCount, depth;
+
+    size_t size() const { return mass.size(); }
+    bool isLeaf(size_t n) const { return childCount[n] == 0; }
+
+    void clear() {
+        for (auto *v: {&centerX, &centerY, &centerZ, &width, &comX, &comY, &comZ, &mass, &reach, &meanRadius}) v->clear();
+        firstChild.clear();
+        bodyBegin.clear();
+        bodyEnd.clear();
+        childCount.clear();
+        depth.clear();
+    }
+
+    void resize(size_t n) {
+        for (auto *v: {&centerX, &centerY, &centerZ, &width, &comX, &comY, &comZ, &mass, &reach, &meanRadius}) v->resize(n);
+        firstChild.resize(n);
+        bodyBegin.resize(n);
+        bodyEnd.resize(n);
+        childCount.resize(n);
+        depth.resize(n);
+    }
+};
+
+// Ciała posortowane według klucza Mortona; index wskazuje pozycję w wektorze wejściowym.
+// Promienie dają zmiękczenie Plummera (r_i + r_j) * 0.01 jak w Forces::gravity.
+struct LinearOctreeBodies {
+    std::vector<double> x, y, z, mass, radius;
+    std::vector<uint32_t> index;
+
+    size_t size() const { return mass.size(); }
+};
+
+class LinearOctree {
+    static constexpr int MAX_DEPTH = 21;
+    static constexpr double SOFTENING = 0.01;
+
+    LinearOctreeNodes nodes;
+    LinearOctreeBodies sorted;
+    std::vector<size_t> levelBegin;
+    std::vector<std::pair<uint64_t, uint32_t> > keys;
+    double theta = 0.5;
+    size_t bucketSize = 8;
+    Parallel::Workers workers;
+
+    static uint64_t spreadBits(uint64_t v) {
+        v &= 0x1fffff;
+        v = (v | v << 32) & 0x1f00000000ffffULL;
+        v = (v | v << 16) & 0x1f0000ff0000ffULL;
+        v = (v | v << 8) & 0x100f00f00f00f00fULL;
+        v = (v | v << 4) & 0x10c30c30c30c30c3ULL;
+        v = (v | v << 2) & 0x1249249249249249ULL;
+        return v;
+    }
+
+    static int octantAt(uint64_t key, int depth) {
+        return static_cast<int>((key >> (3 * (MAX_DEPTH - 1 - depth))) & 7);
+    }
+
+public:
+    LinearOctree() = default;
+
+    void setTheta(double t) { theta = t; }
+    double getTheta() const { return theta; }
+    void setBucketSize(size_t n) { bucketSize = std::max<size_t>(1, n); }
+    size_t getBucketSize() const { return bucketSize; }
+    void setThreads(unsigned n) { workers.threads = std::max(1u, n); }
+    // Budowa i odświeżanie na trwałych wątkach puli (np. puli silnika) zamiast nowych przy każdym wywołaniu
+    void setPool(Parallel::ThreadPool *pool) { workers.pool = pool; }
+
+    const LinearOctreeNodes &getNodes() const { return nodes; }
+    const LinearOctreeBodies &getBodies() const { return sorted; }
+    const std::vector<size_t> &getLevels() const { return levelBegin; }
+
+    void build(const std::vector<BodyPtr> &bodies) {
+        sorted.x.clear();
+        sorted.y.clear();
+        sorted.z.clear();
+        sorted.mass.clear();
+        sorted.radius.clear();
+        sorted.index.clear();
+        for (size_t i = 0; i < bodies.size(); ++i) {
+            const auto &b = bodies[i];
+            if (!b || b->destroyed) continue;
+            sorted.x.push_back(b->pos.x);
+            sorted.y.push_back(b->pos.y);
+            sorted.z.push_back(b->pos.z);
+            sorted.mass.push_back(b->mass);
+            sorted.radius.push_back(b->radius);
+            sorted.index.push_back(static_cast<uint32_t>(i));
+        }
+        buildSorted();
+    }
+
+    // radius == nullptr - bez zmiękczenia
+    void build(const double *x, const double *y, const double *z, const double *m, size_t n,
+               const double *radius = nullptr) {
+        sorted.x.assign(x, x + n);
+        sorted.y.assign(y, y + n);
+        sorted.z.assign(z, z + n);
+        sorted.mass.assign(m, m + n);
+        if (radius) sorted.radius.assign(radius, radius + n);
+        else sorted.radius.assign(n, 0.0);
+        sorted.index.resize(n);
+        for (size_t i = 0; i < n; ++i) sorted.index[i] = static_cast<uint32_t>(i);
+        buildSorted();
+    }
+
+    // Siła na ciało o masie mass i promieniu radius - ze zmiękczeniem jak w sumie bezpośredniej;
+    // interactions (opcjonalnie) zlicza oddziaływania ciało-ciało i ciało-węzeł
+    Vec3 computeForce(Vec3 pos, double mass, double radius, size_t *interactions = nullptr) const {
+        if (nodes.size() == 0) return Vec3(0, 0, 0);
+
+        double fx = 0, fy = 0, fz = 0;
+        uint32_t stack[8 * MAX_DEPTH + 8];
+        int top = 0;
+        stack[top++] = 0;
+
+        while (top > 0) {
+            uint32_t n = stack[--top];
+            if (nodes.mass[n] <= 0) continue;
+
+            if (nodes.isLeaf(n)) {
+                if (interactions) *interactions += nodes.bodyEnd[n] - nodes.bodyBegin[n];
+                for (uint32_t b = nodes.bodyBegin[n]; b < nodes.bodyEnd[n]; ++b) {
+                    double dx = sorted.x[b] - pos.x;
+                    double dy = sorted.y[b] - pos.y;
+                    double dz = sorted.z[b] - pos.z;
+                    double r2 = dx * dx + dy * dy + dz * dz;
+                    if (r2 < 1e-20) continue;
+                    double eps = (radius + sorted.radius[b]) * SOFTENING;
+                    double inv = 1.0 / std::sqrt(r2 + eps * eps);
+                    double s = sorted.mass[b] * inv * inv * inv;
+                    fx += dx * s;
+                    fy += dy * s;
+                    fz += dz * s;
+                }
+                continue;
+            }
+
+            double dx = nodes.comX[n] - pos.x;
+            double dy = nodes.comY[n] - pos.y;
+            double dz = nodes.comZ[n] - pos.z;
+            double r2 = dx * dx + dy * dy + dz * dz;
+            double w = nodes.width[n];
+            if (w * w < theta * theta * r2) {
+                if (interactions) ++*interactions;
+                double eps = (radius + nodes.meanRadius[n]) * SOFTENING;
+                double inv = 1.0 / std::sqrt(r2 + eps * eps);
+                double s = nodes.mass[n] * inv * inv * inv;
+                fx += dx * s;
+                fy += dy * s;
+                fz += dz * s;
+                continue;
+            }
+
+            for (uint32_t c = 0; c < nodes.childCount[n]; ++c) {
+                stack[top++] = nodes.firstChild[n] + c;
+            }
+        }
+
+        double k = Physics::G * mass;
+        return Vec3(fx * k, fy * k, fz * k);
+    }
+
+    // Potencjał grawitacyjny w pos z tym samym kryterium otwarcia i zmiękczeniem co computeForce
+    // (monopole węzłów); ciała w odległości poniżej 1e-10 - w tym ciało leżące w pos - są pomijane
+    double potential(Vec3 pos, double radius = 0) const {
+        if (nodes.size() == 0) return 0;
+
+        double sum = 0;
+        uint32_t stack[8 * MAX_DEPTH + 8];
+        int top = 0;
+        stack[top++] = 0;
+
+        while (top > 0) {
+            uint32_t n = stack[--top];
+            if (nodes.mass[n] <= 0) continue;
+
+            if (nodes.isLeaf(n)) {
+                for (uint32_t b = nodes.bodyBegin[n]; b < nodes.bodyEnd[n]; ++b) {
+                    double dx = sorted.x[b] - pos.x;
+                    double dy = sorted.y[b] - pos.y;
+                    double dz = sorted.z[b] - pos.z;
+                    double r2 = dx * dx + dy * dy + dz * dz;
+                    if (r2 < 1e-20) continue;
+                    double eps = (radius + sorted.radius[b]) * SOFTENING;
+                    sum += sorted.mass[b] / std::sqrt(r2 + eps * eps);
+                }
+                continue;
+            }
+
+            double dx = nodes.comX[n] - pos.x;
+            double dy = nodes.comY[n] - pos.y;
+            double dz = nodes.comZ[n] - pos.z;
+            double r2 = dx * dx + dy * dy + dz * dz;
+            double w = nodes.width[n];
+            if (w * w < theta * theta * r2) {
+                double eps = (radius + nodes.meanRadius[n]) * SOFTENING;
+                sum += nodes.mass[n] / std::sqrt(r2 + eps * eps);
+                continue;
+            }
+
+            for (uint32_t c = 0; c < nodes.childCount[n]; ++c) {
+                stack[top++] = nodes.firstChild[n] + c;
+            }
+        }
+
+        return -Physics::G * sum;
+    }
+
+    // Zasięgi węzłów dla contacts(): x, y, z, radius to bieżący stan indeksowany jak wejście build().
+    // Ciało leży w komórce węzła z chwili budowy, więc przesunięcie dopisane do promienia wystarcza,
+    // żeby drzewo z ostatniego liczenia sił obejmowało ciała także po ich ruchu.
+    void refit(const double *x, const double *y, const double *z, const double *radius) {
+        for (size_t level = levelBegin.size() - 1; level-- > 0;) {
+            workers.forRange(levelBegin[level], levelBegin[level + 1], [&](size_t b, size_t e, size_t) {
+                for (size_t node = b; node < e; ++node) {
+                    double r = 0;
+                    if (nodes.isLeaf(node)) {
+                        for (uint32_t i = nodes.bodyBegin[node]; i < nodes.bodyEnd[node]; ++i) {
+                            uint32_t j = sorted.index[i];
+                            double dx = x[j] - sorted.x[i], dy = y[j] - sorted.y[i], dz = z[j] - sorted.z[i];
+                            r = std::max(r, radius[j] + std::sqrt(dx * dx + dy * dy + dz * dz));
+                        }
+                    } else {
+                        for (uint32_t c = nodes.firstChild[node]; c < nodes.firstChild[node] + nodes.childCount[node]; ++c) {
+                            r = std::max(r, nodes.reach[c]);
+                        }
+                    }
+                    nodes.reach[node] = r;
+                }
+            }, 256);
+        }
+    }
+
+    // Zetknięcia ciał z pozycji [begin, end) kolejności Mortona: found(i, j) dla i < j (indeksy
+    // wejścia), gdy oba alive i dx^2 + dy^2 + dz^2 < (r_i + r_j)^2 - ten sam test co pętla po parach.
+    // Węzły odrzucane po odległości od komórki z małym zapasem na zaokrąglenia. Wymaga refit().
+    template<typename Found>
+    void contacts(size_t begin, size_t end, const double *x, const double *y, const double *z,
+                  const double *radius, const uint8_t *alive, Found &&found) const {
+        if (nodes.size() == 0) return;
+        const double pad = nodes.width[0] * 1e-12;
+        uint32_t stack[8 * MAX_DEPTH + 8];
+
+        for (size_t k = begin; k < end; ++k) {
+            uint32_t i = sorted.index[k];
+            if (!alive[i]) continue;
+            const double xi = x[i], yi = y[i], zi = z[i], ri = radius[i];
+            int top = 0;
+            stack[top++] = 0;
+
+            while (top > 0) {
+                uint32_t n = stack[--top];
+                double half = nodes.width[n] * 0.5 + pad;
+                double gx = std::max(std::abs(xi - nodes.centerX[n]) - half, 0.0);
+                double gy = std::max(std::abs(yi - nodes.centerY[n]) - half, 0.0);
+                double gz = std::max(std::abs(zi - nodes.centerZ[n]) - half, 0.0);
+                double limit = (ri + nodes.reach[n]) * (1 + 1e-12);
+                if (gx * gx + gy * gy + gz * gz >= limit * limit) continue;
+
+                if (nodes.isLeaf(n)) {
+                    for (uint32_t b = nodes.bodyBegin[n]; b < nodes.bodyEnd[n]; ++b) {
+                        uint32_t j = sorted.index[b];
+                        if (j <= i || !alive[j]) continue;
+                        double dx = xi - x[j], dy = yi - y[j], dz = zi - z[j];
+                        double sum = ri + radius[j];
+                        if (dx * dx + dy * dy + dz * dz < sum * sum) found(size_t(i), size_t(j));
+                    }
+                    continue;
+                }
+                for (uint32_t c = 0; c < nodes.childCount[n]; ++c) {
+                    stack[top++] = nodes.firstChild[n] + c;
+                }
+            }
+        }
+    }
+
+private:
+    void buildSorted() {
+        nodes.clear();
+        levelBegin.clear();
+        size_t n = sorted.size();
+        if (n == 0) return;
+
+        double minX = sorted.x[0], minY = sorted.y[0], minZ = sorted.z[0];
+        double maxX = minX, maxY = minY, maxZ = minZ;
+        for (size_t i = 1; i < n; ++i) {
+            minX = std::min(minX, sorted.x[i]);
+            minY = std::min(minY, sorted.y[i]);
+            minZ = std::min(minZ, sorted.z[i]);
+            maxX = std::max(maxX, sorted.x[i]);
+            maxY = std::max(maxY, sorted.y[i]);
+            maxZ = std::max(maxZ, sorted.z[i]);
+        }
+        double rootWidth = std::max({maxX - minX, maxY - minY, maxZ - minZ}) * 1.001 + 1.0;
+        double scale = double(1u << MAX_DEPTH) / rootWidth;
+
+        keys.resize(n);
+        workers.forRange(0, n, [&](size_t b, size_t e, size_t) {
+            for (size_t i = b; i < e; ++i) {
+                auto q = [scale](double v, double lo) {
+                    double s = (v - lo) * scale;
+                    return static_cast<uint64_t>(std::clamp(s, 0.0, double((1u << MAX_DEPTH) - 1)));
+                };
+                uint64_t key = spreadBits(q(sorted.x[i], minX)) |
+                               spreadBits(q(sorted.y[i], minY)) << 1 |
+                               spreadBits(q(sorted.z[i], minZ)) << 2;
+                keys[i] = {key, static_cast<uint32_t>(i)};
+            }
+        });
+        Parallel::sort(keys.begin(), keys.end(), workers,
+                       [](const auto &a, const auto &b) {
+                           return a.first < b.first || (a.first == b.first && a.second < b.second);
+                       });
+
+        LinearOctreeBodies unsorted;
+        std::swap(unsorted, sorted);
+        sorted.x.resize(n);
+        sorted.y.resize(n);
+        sorted.z.resize(n);
+        sorted.mass.resize(n);
+        sorted.radius.resize(n);
+        sorted.index.resize(n);
+        workers.forRange(0, n, [&](size_t b, size_t e, size_t) {
+            for (size_t i = b; i < e; ++i) {
+                uint32_t src = keys[i].second;
+                sorted.x[i] = unsorted.x[src];
+                sorted.y[i] = unsorted.y[src];
+                sorted.z[i] = unsorted.z[src];
+                sorted.mass[i] = unsorted.mass[src];
+                sorted.radius[i] = unsorted.radius[src];
+                sorted.index[i] = unsorted.index[src];
+            }
+        });
+
+        // Topologia poziomami z góry na dół: zakresy kluczy dzielone według kolejnych 3 bitów
+        nodes.resize(1);
+        nodes.centerX[0] = minX + rootWidth * 0.5;
+        nodes.centerY[0] = minY + rootWidth * 0.5;
+        nodes.centerZ[0] = minZ + rootWidth * 0.5;
+        nodes.width[0] = rootWidth;
+        nodes.bodyBegin[0] = 0;
+        nodes.bodyEnd[0] = static_cast<uint32_t>(n);
+        nodes.depth[0] = 0;
+        nodes.childCount[0] = 0;
+        nodes.firstChild[0] = 0;
+
+        levelBegin.push_back(0);
+        std::vector<uint32_t> childOffset;
+        for (int depth = 0; depth < MAX_DEPTH; ++depth) {
+            size_t lb = levelBegin.back();
+            size_t le = nodes.size();
+
+            childOffset.assign(le - lb + 1, 0);
+            workers.forRange(lb, le, [&](size_t b, size_t e, size_t) {
+                for (size_t node = b; node < e; ++node) {
+                    uint32_t count = 0;
+                    if (nodes.bodyEnd[node] - nodes.bodyBegin[node] > bucketSize) {
+                        int last = -1;
+                        for (uint32_t i = nodes.bodyBegin[node]; i < nodes.bodyEnd[node]; ++i) {
+                            int oct = octantAt(keys[i].first, depth);
+                            if (oct != last) {
+                                ++count;
+                                last = oct;
+                            }
+                        }
+                    }
+                    nodes.childCount[node] = static_cast<uint8_t>(count);
+                    childOffset[node - lb + 1] = count;
+                }
+            }, 256);
+
+            for (size_t i = 1; i < childOffset.size(); ++i) childOffset[i] += childOffset[i - 1];
+            if (childOffset.back() == 0) break;
+
+            size_t childBegin = le;
+            nodes.resize(le + childOffset.back());
+            levelBegin.push_back(childBegin);
+
+            workers.forRange(lb, le, [&](size_t b, size_t e, size_t) {
+                for (size_t node = b; node < e; ++node) {
+                    if (nodes.childCount[node] == 0) continue;
+                    uint32_t child = static_cast<uint32_t>(childBegin + childOffset[node - lb]);
+                    nodes.firstChild[node] = child;
+
+                    double quarter = nodes.width[node] * 0.25;
+                    uint32_t i = nodes.bodyBegin[node];
+                    while (i < nodes.bodyEnd[node]) {
+                        int oct = octantAt(keys[i].first, depth);
+                        uint32_t j = i;
+                        while (j < nodes.bodyEnd[node] && octantAt(keys[j].first, depth) == oct) ++j;
+
+                        nodes.centerX[child] = nodes.centerX[node] + ((oct & 1) ? quarter : -quarter);
+                        nodes.centerY[child] = nodes.centerY[node] + ((oct & 2) ? quarter : -quarter);
+                        nodes.centerZ[child] = nodes.centerZ[node] + ((oct & 4) ? quarter : -quarter);
+                        nodes.width[child] = nodes.width[node] * 0.5;
+                        nodes.bodyBegin[child] = i;
+                        nodes.bodyEnd[child] = j;
+                        nodes.depth[child] = static_cast<uint8_t>(depth + 1);
+                        nodes.childCount[child] = 0;
+                        nodes.firstChild[child] = 0;
+                        ++child;
+                        i = j;
+                    }
+                }
+            }, 256);
+        }
+        levelBegin.push_back(nodes.size());
+
+        // Momenty od liści w górę, poziom po poziomie
+        for (size_t level = levelBegin.size() - 1; level-- > 0;) {
+            workers.forRange(levelBegin[level], levelBegin[level + 1], [&](size_t b, size_t e, size_t) {
+                for (size_t node = b; node < e; ++node) {
+                    double m = 0, cx = 0, cy = 0, cz = 0, r = 0;
+                    if (nodes.isLeaf(node)) {
+                        for (uint32_t i = nodes.bodyBegin[node]; i < nodes.bodyEnd[node]; ++i) {
+                            m += sorted.mass[i];
+                            cx += sorted.x[i] * sorted.mass[i];
+                            cy += sorted.y[i] * sorted.mass[i];
+                            cz += sorted.z[i] * sorted.mass[i];
+                            r += sorted.radius[i] * sorted.mass[i];
+                        }
+                    } else {
+                        for (uint32_t c = nodes.firstChild[node]; c < nodes.firstChild[node] + nodes.childCount[node]; ++c) {
+                            m += nodes.mass[c];
+                            cx += nodes.comX[c] * nodes.mass[c];
+                            cy += nodes.comY[c] * nodes.mass[c];
+                            cz += nodes.comZ[c] * nodes.mass[c];
+                            r += nodes.meanRadius[c] * nodes.mass[c];
+                        }
+                    }
+                    nodes.mass[node] = m;
+                    nodes.meanRadius[node] = m > 0 ? r / m : 0;
+                    if (m > 0) {
+                        nodes.comX[node] = cx / m;
+                        nodes.comY[node] = cy / m;
+                        nodes.comZ[node] = cz / m;
+                    } else {
+                        nodes.comX[node] = nodes.centerX[node];
+                        nodes.comY[node] = nodes.centerY[node];
+                        nodes.comZ[node] = nodes.centerZ[node];
+                    }
+                }
+            }, 256);
+        }
+    }
+};
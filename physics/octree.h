@@ -9,14 +9,16 @@ struct OctreeNode {
     double size;
     Vec3 centerOfMass;
     double totalMass;
+    double meanRadius; // średni promień ważony masą - zmiękczenie oddziaływania z węzłem
     std::vector<BodyPtr> bodies;
     std::unique_ptr<OctreeNode> children[8];
     bool isLeaf;
     
-    OctreeNode(Vec3 c, double s) : center(c), size(s), centerOfMass(0,0,0), totalMass(0), isLeaf(true) {}
+    OctreeNode(Vec3 c, double s) : center(c), size(s), centerOfMass(0,0,0), totalMass(0), meanRadius(0), isLeaf(true) {}
     
     void insert(BodyPtr body) {
-        if(isLeaf && bodies.size() < 1) {
+        // Ciała w tym samym punkcie nie dają się rozdzielić - zostają w jednym liściu
+        if(isLeaf && (bodies.size() < 1 || size < 1e-6)) {
             bodies.push_back(body);
             updateMass();
             return;
@@ -60,14 +62,15 @@ struct OctreeNode {
     }
     
     void updateMass() {
+        double radiusSum = 0;
         if(isLeaf) {
             totalMass = 0;
             centerOfMass = Vec3(0,0,0);
             for(auto& body : bodies) {
                 totalMass += body->mass;
                 centerOfMass += body->pos * body->mass;
+                radiusSum += body->radius * body->mass;
             }
-            if(totalMass > 0) centerOfMass = centerOfMass / totalMass;
         } else {
             totalMass = 0;
             centerOfMass = Vec3(0,0,0);
@@ -75,27 +78,51 @@ struct OctreeNode {
                 if(children[i]) {
                     totalMass += children[i]->totalMass;
                     centerOfMass += children[i]->centerOfMass * children[i]->totalMass;
+                    radiusSum += children[i]->meanRadius * children[i]->totalMass;
                 }
             }
-            if(totalMass > 0) centerOfMass = centerOfMass / totalMass;
+        }
+        if(totalMass > 0) {
+            centerOfMass = centerOfMass / totalMass;
+            meanRadius = radiusSum / totalMass;
         }
     }
     
-    Vec3 computeForce(Vec3 pos, double mass, double theta = 0.5) {
+    // Zmiękczenie Plummera (r_i + r_j) * 0.01 jak w Forces::gravity - dla węzła z meanRadius;
+    // interactions (opcjonalnie) zlicza oddziaływania ciało-ciało i ciało-węzeł
+    Vec3 computeForce(Vec3 pos, double mass, double radius, double theta = 0.5, size_t* interactions = nullptr) const {
         if(totalMass < 1e-10) return Vec3(0,0,0);
         
+        if(isLeaf) {
+            // Liść liczymy dokładnie z pozycji ciał - środek masy (pos*m)/m nie jest
+            // bitowo równy pos, więc ciało oddziaływałoby samo ze sobą
+            Vec3 force(0,0,0);
+            if(interactions) *interactions += bodies.size();
+            for(auto& body : bodies) {
+                Vec3 r = body->pos - pos;
+                double dist = r.length();
+                if(dist < 1e-10) continue;
+                double softening = (radius + body->radius) * 0.01;
+                double distSoft = std::sqrt(dist * dist + softening * softening);
+                force += r * (Physics::G * mass * body->mass / (distSoft * distSoft * distSoft));
+            }
+            return force;
+        }
+        
         Vec3 r = centerOfMass - pos;
         double dist = r.length();
         
-        if(isLeaf || (size / dist) < theta) {
-            if(dist < 1e-10) return Vec3(0,0,0);
-            return r * (Physics::G * mass * totalMass / (dist * dist * dist));
+        if((2.0 * size / dist) < theta) {
+            if(interactions) ++*interactions;
+            double softening = (radius + meanRadius) * 0.01;
+            double distSoft = std::sqrt(dist * dist + softening * softening);
+            return r * (Physics::G * mass * totalMass / (distSoft * distSoft * distSoft));
         }
         
         Vec3 force(0,0,0);
         for(int i = 0; i < 8; i++) {
             if(children[i]) {
-                force += children[i]->computeForce(pos, mass, theta);
+                force += children[i]->computeForce(pos, mass, radius, theta, interactions);
             }
         }
         return force;
@@ -104,12 +131,20 @@ struct OctreeNode {
 
 class Octree {
     std::unique_ptr<OctreeNode> root;
+    double theta = 0.5;
     
 public:
     Octree(Vec3 center, double size) {
         root = std::make_unique<OctreeNode>(center, size);
     }
     
+    void setTheta(double t) { theta = t; }
+    double getTheta() const { return theta; }
+    
+    void setBounds(Vec3 center, double size) {
+        root = std::make_unique<OctreeNode>(center, size);
+    }
+    
     void build(const std::vector<BodyPtr>& bodies) {
         root = std::make_unique<OctreeNode>(root->center, root->size);
         for(auto& body : bodies) {
@@ -119,7 +154,7 @@ public:
         }
     }
     
-    Vec3 computeForce(Vec3 pos, double mass) {
-        return root->computeForce(pos, mass);
+    Vec3 computeForce(Vec3 pos, double mass, double radius, size_t* interactions = nullptr) const {
+        return root->computeForce(pos, mass, radius, theta, interactions);
     }
 };
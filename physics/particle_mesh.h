@@ -0,0 +1,501 @@
+#pragma once
+#include "../core/vec3.h"
+#include "../core/constants.h"
+#include "../core/parallel.h"
+#include "../core/fft.h"
+#include "body.h"
+#include "linear_octree.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+enum class MeshBoundary { ISOLATED, PERIODIC };
+
+struct PmStats {
+    double depositTime = 0;
+    double fftTime = 0;
+    double interpolateTime = 0;
+    double shortRangeTime = 0;
+};
+
+// Particle-mesh: masy rozkładane metodą CIC na siatkę gridSize^3, równanie Poissona
+// rozwiązywane przez FFT, siła interpolowana z powrotem tym samym jądrem CIC.
+//  - PERIODIC: pudło [boxMin, boxMin + boxSize)^3, funkcja Greena -4piG/k^2
+//  - ISOLATED: metoda Hockneya-Eastwooda, siatka 2N z zerowym wypełnieniem, jądro -G/r
+// TreePM dzieli potencjał na część dalekozasięgową (filtr exp(-k^2 rs^2) na siatce) i
+// krótkozasięgową (erfc(r / 2rs), sumowaną drzewem do promienia cutoff * rs).
+class ParticleMesh {
+    using Complex = Fft::Complex;
+
+    size_t gridSize = 64;
+    MeshBoundary boundary = MeshBoundary::ISOLATED;
+    Vec3 boxMin;
+    double boxSize = 0;
+    bool treePM = false;
+    double splitCells = 1.25;
+    double cutoff = 4.5;
+    double theta = 0.5;
+    Parallel::Workers workers;
+
+    // Geometria bieżącego rozwiązania
+    Vec3 origin;
+    double period = 0;
+    double cell = 0;
+    size_t padded = 0;
+    double splitScale = 0;
+
+    Fft::Plan plan;
+    std::vector<Complex> grid;
+    std::vector<Complex> green;
+    size_t greenPadded = 0;
+    double greenCell = 0, greenSplit = 0;
+    bool greenPeriodic = false;
+
+    std::vector<double> potential;
+    std::vector<double> meshX, meshY, meshZ;
+    std::vector<double> posX, posY, posZ, mass;
+    std::vector<uint32_t> index;
+    std::vector<Vec3> accel;
+    LinearOctree tree;
+    PmStats stats;
+
+    size_t at(size_t i, size_t j, size_t k) const { return (i * gridSize + j) * gridSize + k; }
+
+    size_t wrap(long i) const {
+        long n = static_cast<long>(gridSize);
+        i %= n;
+        return static_cast<size_t>(i < 0 ? i + n : i);
+    }
+
+    double wrapCoord(double u) const {
+        double n = double(gridSize);
+        u = std::fmod(u, n);
+        if (u < 0) u += n;
+        return u < n ? u : 0.0;
+    }
+
+    double periodicDelta(double d) const {
+        if (boundary != MeshBoundary::PERIODIC) return d;
+        if (d > 0.5 * period) return d - period;
+        if (d < -0.5 * period) return d + period;
+        return d;
+    }
+
+    void setupGeometry(size_t n) {
+        if (boundary == MeshBoundary::PERIODIC && boxSize > 0) {
+            origin = boxMin;
+            period = boxSize;
+            cell = period / double(gridSize);
+            padded = gridSize;
+        } else {
+            Vec3 lo(1e300, 1e300, 1e300), hi(-1e300, -1e300, -1e300);
+            for (size_t i = 0; i < n; ++i) {
+                lo = Vec3(std::min(lo.x, posX[i]), std::min(lo.y, posY[i]), std::min(lo.z, posZ[i]));
+                hi = Vec3(std::max(hi.x, posX[i]), std::max(hi.y, posY[i]), std::max(hi.z, posZ[i]));
+            }
+            Vec3 extent = hi - lo;
+            double side = std::max({extent.x, extent.y, extent.z}) * 1.001 + 1.0;
+            Vec3 center = (lo + hi) * 0.5;
+            if (boundary == MeshBoundary::PERIODIC) {
+                // Brak zadanego pudła - okres równy obwiedni ciał
+                period = side;
+                origin = center - Vec3(side, side, side) * 0.5;
+                cell = side / double(gridSize);
+                padded = gridSize;
+            } else {
+                // Ciała w komórkach [2, N - 3): zostaje miejsce na CIC i 4-punktowy gradient.
+                // Rozmiar komórki zmieniamy skokowo, żeby funkcja Greena nie była liczona co krok.
+                double capacity = cell * double(gridSize - 5);
+                if (padded != 2 * gridSize || side > capacity || side < 0.8 * capacity) {
+                    cell = 1.05 * side / double(gridSize - 5);
+                }
+                double half = 0.5 * double(gridSize - 1) * cell;
+                origin = center - Vec3(half, half, half);
+                padded = 2 * gridSize;
+            }
+        }
+        splitScale = splitCells * cell;
+    }
+
+    void buildGreen() {
+        bool periodic = boundary == MeshBoundary::PERIODIC;
+        double rs = treePM ? splitScale : 0;
+        if (greenPadded == padded && greenCell == cell && greenSplit == rs && greenPeriodic == periodic) return;
+        greenPadded = padded;
+        greenCell = cell;
+        greenSplit = rs;
+        greenPeriodic = periodic;
+
+        size_t m = padded;
+        green.assign(m * m * m, Complex(0, 0));
+        if (periodic) {
+            // Widmo gotowe od razu: -4piG/k^2 * exp(-k^2 rs^2)
+            double kf = 2.0 * M_PI / (double(m) * cell);
+            double volume = cell * cell * cell;
+            workers.forRange(0, m, [&](size_t b, size_t e, size_t) {
+                for (size_t i = b; i < e; ++i) {
+                    for (size_t j = 0; j < m; ++j) {
+                        for (size_t k = 0; k < m; ++k) {
+                            if (i == 0 && j == 0 && k == 0) continue;
+                            long fi = i <= m / 2 ? long(i) : long(i) - long(m);
+                            long fj = j <= m / 2 ? long(j) : long(j) - long(m);
+                            long fk = k <= m / 2 ? long(k) : long(k) - long(m);
+                            double k2 = kf * kf * double(fi * fi + fj * fj + fk * fk);
+                            double g = -4.0 * M_PI * Physics::G / k2;
+                            if (rs > 0) g *= std::exp(-k2 * rs * rs);
+                            // Gęstość = masa / objętość komórki
+                            green[(i * m + j) * m + k] = Complex(g / volume, 0);
+                        }
+                    }
+                }
+            }, 1);
+            if (rs > 0) deconvolve(m);
+        } else {
+            // Jądro w przestrzeni rzeczywistej na siatce 2N (odległości z zawinięciem), potem FFT.
+            // Czysty PM wygładza jądro na pół komórki, TreePM bierze część erf(r / 2rs) / r.
+            size_t n = gridSize;
+            workers.forRange(0, m, [&](size_t b, size_t e, size_t) {
+                for (size_t i = b; i < e; ++i) {
+                    double di = double(i <= n ? i : m - i);
+                    for (size_t j = 0; j < m; ++j) {
+                        double dj = double(j <= n ? j : m - j);
+                        for (size_t k = 0; k < m; ++k) {
+                            double dk = double(k <= n ? k : m - k);
+                            double r = cell * std::sqrt(di * di + dj * dj + dk * dk);
+                            double g;
+                            if (rs > 0) {
+                                g = r > 0 ? -std::erf(r / (2 * rs)) / r : -1.0 / (rs * std::sqrt(M_PI));
+                            } else {
+                                g = -1.0 / std::sqrt(r * r + 0.25 * cell * cell);
+                            }
+                            green[(i * m + j) * m + k] = Complex(Physics::G * g, 0);
+                        }
+                    }
+                }
+            }, 1);
+            Fft::transform3d(green, m, plan, false, m, workers);
+            if (rs > 0) deconvolve(m);
+        }
+    }
+
+    // Dzielenie widma przez W(k)^2 (W = iloczyn sinc^2) kompensuje wygładzenie CIC przy rozkładaniu
+    // i interpolacji. Tylko z filtrem TreePM - bez niego wzmacnia szum przy częstości Nyquista.
+    void deconvolve(size_t m) {
+        std::vector<double> sinc2(m);
+        for (size_t i = 0; i < m; ++i) {
+            long f = i <= m / 2 ? long(i) : long(i) - long(m);
+            double x = M_PI * double(f) / double(m);
+            double s = f == 0 ? 1.0 : std::sin(x) / x;
+            sinc2[i] = s * s;
+        }
+        workers.forRange(0, m, [&](size_t b, size_t e, size_t) {
+            for (size_t i = b; i < e; ++i) {
+                for (size_t j = 0; j < m; ++j) {
+                    for (size_t k = 0; k < m; ++k) {
+                        double w = sinc2[i] * sinc2[j] * sinc2[k];
+                        green[(i * m + j) * m + k] /= w * w;
+                    }
+                }
+            }
+        }, 1);
+    }
+
+    void deposit(size_t n) {
+        size_t m = padded;
+        grid.assign(m * m * m, Complex(0, 0));
+        bool periodic = boundary == MeshBoundary::PERIODIC;
+        for (size_t b = 0; b < n; ++b) {
+            double u = (posX[b] - origin.x) / cell;
+            double v = (posY[b] - origin.y) / cell;
+            double w = (posZ[b] - origin.z) / cell;
+            if (periodic) {
+                u = wrapCoord(u);
+                v = wrapCoord(v);
+                w = wrapCoord(w);
+            }
+            long i = long(std::floor(u)), j = long(std::floor(v)), k = long(std::floor(w));
+            double fx = u - double(i), fy = v - double(j), fz = w - double(k);
+            for (int a = 0; a < 2; ++a) {
+                double wa = a ? fx : 1 - fx;
+                size_t ia = periodic ? wrap(i + a) : size_t(i + a);
+                for (int c = 0; c < 2; ++c) {
+                    double wc = c ? fy : 1 - fy;
+                    size_t jc = periodic ? wrap(j + c) : size_t(j + c);
+                    for (int d = 0; d < 2; ++d) {
+                        double wd = d ? fz : 1 - fz;
+                        size_t kd = periodic ? wrap(k + d) : size_t(k + d);
+                        grid[(ia * m + jc) * m + kd] += mass[b] * wa * wc * wd;
+                    }
+                }
+            }
+        }
+    }
+
+    void solvePotential() {
+        size_t m = padded;
+        size_t n = gridSize;
+        plan.resize(m);
+        Fft::transform3d(grid, m, plan, false, n, workers);
+        workers.forRange(0, grid.size(), [&](size_t b, size_t e, size_t) {
+            for (size_t i = b; i < e; ++i) grid[i] *= green[i];
+        });
+        Fft::transform3d(grid, m, plan, true, n, workers);
+
+        double norm = 1.0 / (double(m) * double(m) * double(m));
+        potential.resize(n * n * n);
+        workers.forRange(0, n, [&](size_t b, size_t e, size_t) {
+            for (size_t i = b; i < e; ++i) {
+                for (size_t j = 0; j < n; ++j) {
+                    for (size_t k = 0; k < n; ++k) potential[at(i, j, k)] = grid[(i * m + j) * m + k].real() * norm;
+                }
+            }
+        }, 1);
+    }
+
+    // a = -grad(phi), różnice skończone 4. rzędu
+    void meshAcceleration() {
+        size_t n = gridSize;
+        bool periodic = boundary == MeshBoundary::PERIODIC;
+        meshX.assign(n * n * n, 0.0);
+        meshY.assign(n * n * n, 0.0);
+        meshZ.assign(n * n * n, 0.0);
+        double c1 = 2.0 / (3.0 * cell), c2 = 1.0 / (12.0 * cell);
+        size_t lo = periodic ? 0 : 2, hi = periodic ? n : n - 2;
+        workers.forRange(lo, hi, [&](size_t b, size_t e, size_t) {
+            for (size_t i = b; i < e; ++i) {
+                for (size_t j = lo; j < hi; ++j) {
+                    for (size_t k = lo; k < hi; ++k) {
+                        auto phi = [&](long di, long dj, long dk) {
+                            return potential[at(wrap(long(i) + di), wrap(long(j) + dj), wrap(long(k) + dk))];
+                        };
+                        size_t c = at(i, j, k);
+                        meshX[c] = -(c1 * (phi(1, 0, 0) - phi(-1, 0, 0)) - c2 * (phi(2, 0, 0) - phi(-2, 0, 0)));
+                        meshY[c] = -(c1 * (phi(0, 1, 0) - phi(0, -1, 0)) - c2 * (phi(0, 2, 0) - phi(0, -2, 0)));
+                        meshZ[c] = -(c1 * (phi(0, 0, 1) - phi(0, 0, -1)) - c2 * (phi(0, 0, 2) - phi(0, 0, -2)));
+                    }
+                }
+            }
+        }, 1);
+    }
+
+    void interpolate(size_t n) {
+        bool periodic = boundary == MeshBoundary::PERIODIC;
+        workers.forRange(0, n, [&](size_t begin, size_t end, size_t) {
+            for (size_t b = begin; b < end; ++b) {
+                double u = (posX[b] - origin.x) / cell;
+                double v = (posY[b] - origin.y) / cell;
+                double w = (posZ[b] - origin.z) / cell;
+                if (periodic) {
+                    u = wrapCoord(u);
+                    v = wrapCoord(v);
+                    w = wrapCoord(w);
+                }
+                long i = long(std::floor(u)), j = long(std::floor(v)), k = long(std::floor(w));
+                double fx = u - double(i), fy = v - double(j), fz = w - double(k);
+                double ax = 0, ay = 0, az = 0;
+                for (int a = 0; a < 2; ++a) {
+                    double wa = a ? fx : 1 - fx;
+                    size_t ia = periodic ? wrap(i + a) : size_t(i + a);
+                    for (int c = 0; c < 2; ++c) {
+                        double wc = c ? fy : 1 - fy;
+                        size_t jc = periodic ? wrap(j + c) : size_t(j + c);
+                        for (int d = 0; d < 2; ++d) {
+                            double wd = d ? fz : 1 - fz;
+                            size_t kd = periodic ? wrap(k + d) : size_t(k + d);
+                            size_t g = at(ia, jc, kd);
+                            double weight = wa * wc * wd;
+                            ax += meshX[g] * weight;
+                            ay += meshY[g] * weight;
+                            az += meshZ[g] * weight;
+                        }
+                    }
+                }
+                accel[index[b]] += Vec3(ax, ay, az);
+            }
+        });
+    }
+
+    // Czynnik krótkozasięgowy erfc(x) + 2x / sqrt(pi) * exp(-x^2), x = r / 2rs, stablicowany
+    // do x = 4 (dalej < 1e-6) - erfc i exp na każdą parę kosztowałyby więcej niż samo drzewo
+    static constexpr int SPLIT_TABLE = 2048;
+    static constexpr double SPLIT_MAX_X = 4.0;
+
+    static const std::vector<double> &splitTable() {
+        static const std::vector<double> table = [] {
+            std::vector<double> t(SPLIT_TABLE + 2);
+            for (int i = 0; i < SPLIT_TABLE + 2; ++i) {
+                double x = SPLIT_MAX_X * i / SPLIT_TABLE;
+                t[i] = std::erfc(x) + 2.0 * x / std::sqrt(M_PI) * std::exp(-x * x);
+            }
+            return t;
+        }();
+        return table;
+    }
+
+    // Część krótkozasięgowa: Newton * [erfc(r / 2rs) + r / (rs sqrt(pi)) exp(-r^2 / 4rs^2)]
+    Vec3 shortRange(double px, double py, double pz) const {
+        const auto &nodes = tree.getNodes();
+        const auto &sorted = tree.getBodies();
+        if (nodes.size() == 0) return Vec3(0, 0, 0);
+
+        double rs = splitScale;
+        double rcut = std::min(cutoff, 2 * SPLIT_MAX_X) * rs;
+        double toTable = SPLIT_TABLE / (SPLIT_MAX_X * 2.0 * rs);
+        const double *table = splitTable().data();
+
+        auto kernel = [&](double dx, double dy, double dz, double m, double &fx, double &fy, double &fz) {
+            double r2 = dx * dx + dy * dy + dz * dz;
+            if (r2 < 1e-20 || r2 >= rcut * rcut) return;
+            double r = std::sqrt(r2);
+            double u = r * toTable;
+            int i = static_cast<int>(u);
+            double f = u - i;
+            double s = m / (r2 * r) * (table[i] + f * (table[i + 1] - table[i]));
+            fx += dx * s;
+            fy += dy * s;
+            fz += dz * s;
+        };
+
+        double fx = 0, fy = 0, fz = 0;
+        uint32_t stack[8 * 22 + 8];
+        int top = 0;
+        stack[top++] = 0;
+        while (top > 0) {
+            uint32_t n = stack[--top];
+            if (nodes.mass[n] <= 0) continue;
+
+            // Najbliższy punkt sześcianu węzła dalej niż rcut - cały węzeł pomijamy
+            double half = 0.5 * nodes.width[n];
+            double bx = std::max(0.0, std::abs(periodicDelta(nodes.centerX[n] - px)) - half);
+            double by = std::max(0.0, std::abs(periodicDelta(nodes.centerY[n] - py)) - half);
+            double bz = std::max(0.0, std::abs(periodicDelta(nodes.centerZ[n] - pz)) - half);
+            if (bx * bx + by * by + bz * bz > rcut * rcut) continue;
+
+            if (nodes.isLeaf(n)) {
+                for (uint32_t b = nodes.bodyBegin[n]; b < nodes.bodyEnd[n]; ++b) {
+                    kernel(periodicDelta(sorted.x[b] - px), periodicDelta(sorted.y[b] - py),
+                           periodicDelta(sorted.z[b] - pz), sorted.mass[b], fx, fy, fz);
+                }
+                continue;
+            }
+
+            double dx = periodicDelta(nodes.comX[n] - px);
+            double dy = periodicDelta(nodes.comY[n] - py);
+            double dz = periodicDelta(nodes.comZ[n] - pz);
+            double r2 = dx * dx + dy * dy + dz * dz;
+            double w = nodes.width[n];
+            if (w * w < theta * theta * r2) {
+                kernel(dx, dy, dz, nodes.mass[n], fx, fy, fz);
+                continue;
+            }
+            for (uint32_t c = 0; c < nodes.childCount[n]; ++c) stack[top++] = nodes.firstChild[n] + c;
+        }
+        return Vec3(fx, fy, fz) * Physics::G;
+    }
+
+    void solve() {
+        using Clock = std::chrono::high_resolution_clock;
+        stats = PmStats();
+        size_t n = mass.size();
+        if (n == 0) return;
+
+        auto start = Clock::now();
+        setupGeometry(n);
+        plan.resize(padded);
+        buildGreen();
+        deposit(n);
+        auto deposited = Clock::now();
+
+        solvePotential();
+        meshAcceleration();
+        auto solved = Clock::now();
+
+        interpolate(n);
+        auto interpolated = Clock::now();
+
+        if (treePM) {
+            if (boundary == MeshBoundary::PERIODIC) {
+                // Drzewo na pozycjach zawiniętych do pudła
+                for (size_t i = 0; i < n; ++i) {
+                    posX[i] = origin.x + wrapCoord((posX[i] - origin.x) / cell) * cell;
+                    posY[i] = origin.y + wrapCoord((posY[i] - origin.y) / cell) * cell;
+                    posZ[i] = origin.z + wrapCoord((posZ[i] - origin.z) / cell) * cell;
+                }
+            }
+            tree.build(posX.data(), posY.data(), posZ.data(), mass.data(), n);
+            workers.forRange(0, n, [&](size_t b, size_t e, size_t) {
+                for (size_t i = b; i < e; ++i) accel[index[i]] += shortRange(posX[i], posY[i], posZ[i]);
+            }, 256);
+        }
+        auto done = Clock::now();
+
+        stats.depositTime = std::chrono::duration<double>(deposited - start).count();
+        stats.fftTime = std::chrono::duration<double>(solved - deposited).count();
+        stats.interpolateTime = std::chrono::duration<double>(interpolated - solved).count();
+        stats.shortRangeTime = std::chrono::duration<double>(done - interpolated).count();
+    }
+
+public:
+    void setGridSize(size_t n) { gridSize = Fft::nextPowerOfTwo(std::max<size_t>(n, 8)); }
+    size_t getGridSize() const { return gridSize; }
+    void setBoundary(MeshBoundary b) { boundary = b; }
+    MeshBoundary getBoundary() const { return boundary; }
+    // Pudło okresowe; przy boxSize <= 0 okres wyznaczany z obwiedni ciał
+    void setPeriodicBox(Vec3 min, double size) {
+        boxMin = min;
+        boxSize = size;
+    }
+    void enableTreePM(bool enable) { treePM = enable; }
+    bool isTreePM() const { return treePM; }
+    // Skala podziału rs w komórkach siatki i promień obcięcia części krótkozasięgowej w rs
+    void setSplitScale(double cells) { splitCells = std::max(0.1, cells); }
+    void setCutoff(double radiusInSplitScales) { cutoff = std::max(1.0, radiusInSplitScales); }
+    void setTheta(double t) { theta = t; }
+    void setThreads(unsigned n) {
+        workers.threads = std::max(1u, n);
+        tree.setThreads(workers.threads);
+    }
+    void setPool(Parallel::ThreadPool *pool) {
+        workers.pool = pool;
+        tree.setPool(pool);
+    }
+
+    const PmStats &getStats() const { return stats; }
+    double getCellSize() const { return cell; }
+
+    // Przyspieszenia (z G) w kolejności wejściowej
+    const std::vector<Vec3> &getAccelerations() const { return accel; }
+    Vec3 acceleration(size_t i) const { return accel[i]; }
+
+    void compute(const std::vector<BodyPtr> &bodies) {
+        posX.clear();
+        posY.clear();
+        posZ.clear();
+        mass.clear();
+        index.clear();
+        for (size_t i = 0; i < bodies.size(); ++i) {
+            const auto &b = bodies[i];
+            if (!b || b->destroyed) continue;
+            posX.push_back(b->pos.x);
+            posY.push_back(b->pos.y);
+            posZ.push_back(b->pos.z);
+            mass.push_back(b->mass);
+            index.push_back(static_cast<uint32_t>(i));
+        }
+        accel.assign(bodies.size(), Vec3(0, 0, 0));
+        solve();
+    }
+
+    void compute(const double *x, const double *y, const double *z, const double *m, size_t n) {
+        posX.assign(x, x + n);
+        posY.assign(y, y + n);
+        posZ.assign(z, z + n);
+        mass.assign(m, m + n);
+        index.resize(n);
+        for (size_t i = 0; i < n; ++i) index[i] = static_cast<uint32_t>(i);
+        accel.assign(n, Vec3(0, 0, 0));
+        solve();
+    }
+};
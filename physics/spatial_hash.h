@@ -0,0 +1,271 @@
+#pragma once
+#include "direct_gravity.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Szeroka faza kolizji na wielopoziomowej siatce haszowanej. Sfera ciała to promień plus margines;
+// poziom L ma komórki base * 2^L, a ciało trafia na najniższy poziom, na którym komórka mieści
+// średnicę sfery. Ciało pyta swój poziom i wyższe - najwyżej 27 komórek na poziom - więc każda
+// para jest znajdowana raz, przez ciało mniejsze (przy równych poziomach przez niższy indeks).
+// Para z przecinającymi się sferami zostaje kandydatem, dopóki żadne ciało nie przesunie się
+// o więcej niż swój margines ani nie urośnie: wtedy odległość pary spoza listy nie mogła spaść
+// poniżej sumy promieni.
+namespace SpatialHash {
+
+struct Spheres {
+    const double *x, *y, *z, *radius;
+    const uint8_t *alive;
+    size_t n;
+};
+
+class Broadphase {
+public:
+    // Liczba kawałków, na które dzielona jest budowa listy (kolejność wyniku od nich nie zależy)
+    static constexpr size_t CHUNKS = 64;
+
+    // Czy lista kandydatów nadal obejmuje wszystkie możliwe zetknięcia
+    bool valid(const Spheres &s) const {
+        if (anchorX.size() != s.n) return false;
+        for (size_t i = 0; i < s.n; ++i) {
+            if (!s.alive[i]) continue;
+            double dx = s.x[i] - anchorX[i], dy = s.y[i] - anchorY[i], dz = s.z[i] - anchorZ[i];
+            if (s.radius[i] > built[i] || dx * dx + dy * dy + dz * dz > margin[i] * margin[i]) return false;
+        }
+        return true;
+    }
+
+    // Buduje siatkę i listę kandydatów; loop(total, fn(begin, end)) może dzielić kawałki między wątki
+    template<typename Loop>
+    void rebuild(const Spheres &s, const double *margins, Loop &&loop) {
+        size_t n = s.n;
+        anchorX.assign(s.x, s.x + n);
+        anchorY.assign(s.y, s.y + n);
+        anchorZ.assign(s.z, s.z + n);
+        built.assign(s.radius, s.radius + n);
+        margin.assign(margins, margins + n);
+        insert(s);
+
+        found.resize(CHUNKS);
+        for (auto &list: found) list.clear();
+        loop(CHUNKS, [&](size_t begin, size_t end) {
+            for (size_t c = begin; c < end; ++c) {
+                for (size_t i = n * c / CHUNKS; i < n * (c + 1) / CHUNKS; ++i) {
+                    if (s.alive[i]) query(s, i, found[c]);
+                }
+            }
+        });
+
+        size_t total = 0;
+        for (auto &list: found) total += list.size();
+        pairs.clear();
+        pairs.reserve(total);
+        for (auto &list: found) pairs.insert(pairs.end(), list.begin(), list.end());
+        std::sort(pairs.begin(), pairs.end());
+        first.resize(pairs.size());
+        second.resize(pairs.size());
+        for (size_t k = 0; k < pairs.size(); ++k) {
+            first[k] = pairs[k].first;
+            second[k] = pairs[k].second;
+        }
+        ++rebuilds;
+    }
+
+    // Wąska faza: kandydaci z odległością mniejszą niż suma promieni, oboje żywi, w kolejności
+    // (a, b) rosnąco - jak pętla po trójkącie par
+    void overlaps(const Spheres &s, std::vector<std::pair<size_t, size_t> > &out,
+                  DirectGravity::Isa isa = DirectGravity::bestIsa()) const {
+        hits.assign(first.size(), 0);
+#ifdef PHYSPP_X86_DISPATCH
+        if (isa != DirectGravity::Isa::SCALAR && DirectGravity::isaSupported(DirectGravity::Isa::AVX2)) {
+            narrowAvx2(s, 0, first.size());
+        } else
+#endif
+        {
+            narrowScalar(s, 0, first.size());
+        }
+        for (size_t k = 0; k < first.size(); ++k) {
+            if (hits[k] && s.alive[first[k]] && s.alive[second[k]]) out.push_back({first[k], second[k]});
+        }
+    }
+
+    size_t candidates() const { return first.size(); }
+    // Kandydat k jako para (a, b), a < b; pary rosnąco po k - dla własnej wąskiej fazy
+    std::pair<size_t, size_t> candidate(size_t k) const { return {first[k], second[k]}; }
+    size_t rebuildCount() const { return rebuilds; }
+
+    // Pojemność buforów w bajtach - bufory żyją między przebudowami i rosną tylko z liczbą ciał i par
+    size_t scratchBytes() const {
+        auto bytes = [](const auto &v) { return v.capacity() * sizeof(v[0]); };
+        size_t total = bytes(anchorX) + bytes(anchorY) + bytes(anchorZ) + bytes(built) + bytes(margin) + bytes(first) +
+                       bytes(second) + bytes(hits) + bytes(reach) + bytes(level) + bytes(cellX) + bytes(cellY) +
+                       bytes(cellZ) + bytes(bucketStart) + bytes(entries) + bytes(slot) + bytes(bucketFill) + bytes(pairs) +
+                       bytes(found);
+        for (auto &list: found) total += bytes(list);
+        return total;
+    }
+
+private:
+    std::vector<double> anchorX, anchorY, anchorZ, built, margin;
+    std::vector<uint32_t> first, second;
+    mutable std::vector<uint8_t> hits;
+    size_t rebuilds = 0;
+
+    // Siatka: poziom i komórka ciała, kubełki hasza jako posortowane indeksy z początkami
+    static constexpr int MAX_LEVEL = 62;
+    double base = 0;
+    std::vector<double> reach;
+    std::vector<uint8_t> level;
+    std::vector<int64_t> cellX, cellY, cellZ;
+    std::array<double, MAX_LEVEL + 1> levelReach{};
+    std::array<size_t, MAX_LEVEL + 1> levelCount{};
+    std::vector<uint32_t> bucketStart, entries, slot, bucketFill;
+    std::vector<std::vector<std::pair<uint32_t, uint32_t> > > found;
+    std::vector<std::pair<uint32_t, uint32_t> > pairs;
+    uint64_t mask = 0;
+
+    static int64_t cell(double p, double size) {
+        double c = std::floor(p / size);
+        return int64_t(std::clamp(c, -4.0e18, 4.0e18));
+    }
+
+    uint64_t bucket(int l, int64_t ix, int64_t iy, int64_t iz) const {
+        uint64_t h = uint64_t(ix) * 0x9E3779B97F4A7C15ull ^ uint64_t(iy) * 0xC2B2AE3D27D4EB4Full ^
+                     uint64_t(iz) * 0x165667B19E3779F9ull ^ uint64_t(l) * 0x27D4EB2F165667C5ull;
+        h ^= h >> 29;
+        return h & mask;
+    }
+
+    double cellSize(int l) const { return std::ldexp(base, l); }
+
+    void insert(const Spheres &s) {
+        size_t n = s.n;
+        reach.resize(n);
+        level.assign(n, 0);
+        cellX.resize(n);
+        cellY.resize(n);
+        cellZ.resize(n);
+        levelReach.fill(0);
+        levelCount.fill(0);
+
+        base = 0;
+        for (size_t i = 0; i < n; ++i) {
+            reach[i] = s.radius[i] + margin[i];
+            if (s.alive[i] && reach[i] > 0 && (base == 0 || 2 * reach[i] < base)) base = 2 * reach[i];
+        }
+        if (base == 0) base = 1;
+        // Bardzo różne promienie: najmniejsze ciała dzielą poziom 0, ale największe mieszczą się w MAX_LEVEL
+        double largest = 0;
+        for (size_t i = 0; i < n; ++i) {
+            if (s.alive[i]) largest = std::max(largest, 2 * reach[i]);
+        }
+        base = std::max(base, std::ldexp(largest, -MAX_LEVEL));
+
+        size_t live = 0;
+        for (size_t i = 0; i < n; ++i) {
+            if (!s.alive[i]) continue;
+            ++live;
+            int l = 0;
+            double ratio = 2 * reach[i] / base;
+            if (ratio > 1) {
+                int exponent;
+                double fraction = std::frexp(ratio, &exponent); // ratio = fraction * 2^exponent, 0.5 <= fraction < 1
+                l = std::min(fraction == 0.5 ? exponent - 1 : exponent, MAX_LEVEL);
+            }
+            level[i] = uint8_t(l);
+            levelReach[l] = std::max(levelReach[l], reach[i]);
+            ++levelCount[l];
+            double size = cellSize(l);
+            cellX[i] = cell(s.x[i], size);
+            cellY[i] = cell(s.y[i], size);
+            cellZ[i] = cell(s.z[i], size);
+        }
+
+        size_t buckets = 16;
+        while (buckets < 2 * live) buckets *= 2;
+        mask = buckets - 1;
+        bucketStart.assign(buckets + 1, 0);
+        slot.resize(n);
+        for (size_t i = 0; i < n; ++i) {
+            if (!s.alive[i]) continue;
+            slot[i] = uint32_t(bucket(level[i], cellX[i], cellY[i], cellZ[i]));
+            ++bucketStart[slot[i] + 1];
+        }
+        for (size_t b = 0; b < buckets; ++b) bucketStart[b + 1] += bucketStart[b];
+        entries.resize(live);
+        bucketFill.assign(bucketStart.begin(), bucketStart.end() - 1);
+        for (size_t i = 0; i < n; ++i) {
+            if (s.alive[i]) entries[bucketFill[slot[i]]++] = uint32_t(i);
+        }
+    }
+
+    void query(const Spheres &s, size_t i, std::vector<std::pair<uint32_t, uint32_t> > &out) const {
+        const double xi = s.x[i], yi = s.y[i], zi = s.z[i], ri = reach[i];
+        for (int l = level[i]; l <= MAX_LEVEL; ++l) {
+            if (!levelCount[l]) continue;
+            double size = cellSize(l), range = ri + levelReach[l];
+            int64_t lo[3] = {cell(xi - range, size), cell(yi - range, size), cell(zi - range, size)};
+            int64_t hi[3] = {cell(xi + range, size), cell(yi + range, size), cell(zi + range, size)};
+
+            // Różne komórki mogą trafić do jednego kubełka - ciało liczy się tylko przy swojej komórce
+            for (int64_t cx = lo[0]; cx <= hi[0]; ++cx) {
+                for (int64_t cy = lo[1]; cy <= hi[1]; ++cy) {
+                    for (int64_t cz = lo[2]; cz <= hi[2]; ++cz) {
+                        uint64_t b = bucket(l, cx, cy, cz);
+                        for (uint32_t e = bucketStart[b]; e < bucketStart[b + 1]; ++e) {
+                            uint32_t j = entries[e];
+                            if (level[j] != l || cellX[j] != cx || cellY[j] != cy || cellZ[j] != cz) continue;
+                            if (l == level[i] && j <= i) continue;
+                            double dx = s.x[j] - xi, dy = s.y[j] - yi, dz = s.z[j] - zi;
+                            double sum = ri + reach[j];
+                            if (dx * dx + dy * dy + dz * dz < sum * sum) {
+                                out.push_back({uint32_t(std::min<size_t>(i, j)), uint32_t(std::max<size_t>(i, j))});
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    // Ten sam test co dotychczasowa pętla po parach: dx^2 + dy^2 + dz^2 < (r_a + r_b)^2
+    void narrowScalar(const Spheres &s, size_t begin, size_t end) const {
+        for (size_t k = begin; k < end; ++k) {
+            size_t a = first[k], b = second[k];
+            double dx = s.x[a] - s.x[b], dy = s.y[a] - s.y[b], dz = s.z[a] - s.z[b];
+            double sum = s.radius[a] + s.radius[b];
+            hits[k] = dx * dx + dy * dy + dz * dz < sum * sum;
+        }
+    }
+
+#ifdef PHYSPP_X86_DISPATCH
+    __attribute__((target("avx2")))
+    static __m256d gather(const double *base, __m128i index) {
+        return _mm256_mask_i32gather_pd(_mm256_setzero_pd(), base, index, _mm256_castsi256_pd(_mm256_set1_epi64x(-1)), 8);
+    }
+
+    // Po 4 pary: indeksy zbierane gatherem; bez FMA, żeby wynik był identyczny ze skalarnym
+    __attribute__((target("avx2")))
+    void narrowAvx2(const Spheres &s, size_t begin, size_t end) const {
+        size_t k = begin;
+        for (; k + 4 <= end; k += 4) {
+            __m128i ia = _mm_loadu_si128(reinterpret_cast<const __m128i *>(first.data() + k));
+            __m128i ib = _mm_loadu_si128(reinterpret_cast<const __m128i *>(second.data() + k));
+            __m256d dx = _mm256_sub_pd(gather(s.x, ia), gather(s.x, ib));
+            __m256d dy = _mm256_sub_pd(gather(s.y, ia), gather(s.y, ib));
+            __m256d dz = _mm256_sub_pd(gather(s.z, ia), gather(s.z, ib));
+            __m256d sum = _mm256_add_pd(gather(s.radius, ia), gather(s.radius, ib));
+            __m256d d2 = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy)),
+                                       _mm256_mul_pd(dz, dz));
+            int bits = _mm256_movemask_pd(_mm256_cmp_pd(d2, _mm256_mul_pd(sum, sum), _CMP_LT_OQ));
+            for (int lane = 0; lane < 4; ++lane) hits[k + lane] = (bits >> lane) & 1;
+        }
+        narrowScalar(s, k, end);
+    }
+#endif
+};
+}
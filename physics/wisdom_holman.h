@@ -0,0 +1,430 @@
+#pragma once
+#include "bulirsch_stoer.h"
+#include "kepler.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <numeric>
+#include <vector>
+
+// Odwzorowanie Wisdoma-Holmana dla układów z dominującą masą centralną. Hamiltonian dzieli się
+// na ruch keplerowski wokół centrum (rozwiązywany dokładnie w kepler.h) i małe oddziaływanie
+// między pozostałymi ciałami; krok to drift(dt / 2) - kick(dt) - drift(dt / 2), a błąd jest
+// rzędu (m / M) dt^2 zamiast dt^2.
+namespace WisdomHolman {
+
+enum class Coordinates { JACOBI, DEMOCRATIC_HELIOCENTRIC };
+
+// Ciało centralne ma indeks 0. W układzie Jacobiego ciało i porusza się względem środka masy
+// ciał 0..i-1 (kolejność od środka), w demokratyczno-heliocentrycznym (DH) - względem centrum,
+// z prędkością barycentryczną. q/u[0] to środek masy całości. Przy nieruchomym centrum
+// (fixedCentre) oba przypadki to zwykłe współrzędne heliocentryczne, a q/u[0] to samo centrum.
+//
+// r, v - stan inercjalny po toInertial(). acc - przyspieszenie od oddziaływań poza
+// hamiltonianem Keplera: dla i >= 1 od wszystkich ciał poza centrum, dla 0 - od ciał spoza
+// układu (np. nieruchomych).
+//
+// Tryb hybrydowy (Chambers 1999, jak w MERCURY; współrzędne DH albo nieruchome centrum): pary
+// z groups dzielą oddziaływanie funkcją przejścia K(d) z promieniem crit. Część K zostaje
+// w kicku, część 1 - K idzie razem z ruchem keplerowskim w drifcie grupy, całkowanym
+// Bulirschem-Stoerem. Pary spoza grup mają w całym kroku K = 1.
+struct System {
+    // Stan b względem a w chwili pierwszego zetknięcia (odległość < suma promieni)
+    struct Contact {
+        size_t a, b;
+        Vec3 dq, du;
+    };
+
+    Coordinates coordinates = Coordinates::JACOBI;
+    bool fixedCentre = false;
+    double G = 0;
+    std::vector<double> m, mu, eta;
+    std::vector<double> qx, qy, qz, ux, uy, uz;
+    std::vector<Vec3> r, v, acc;
+    std::vector<double> radius, crit;
+    std::vector<std::vector<size_t> > groups;
+    std::vector<uint8_t> grouped;
+    std::vector<Contact> contacts;
+    double tolerance = 1e-12;
+    size_t substeps = 0;
+
+    size_t size() const { return m.size(); }
+
+    bool jacobi() const { return coordinates == Coordinates::JACOBI && !fixedCentre; }
+
+    // masses[0] - centrum; mu[i] to GM ruchu keplerowskiego ciała i
+    void setup(const std::vector<double> &masses, double gravity) {
+        G = gravity;
+        m = masses;
+        size_t n = m.size();
+        mu.assign(n, 0);
+        eta.assign(n, m[0]);
+        for (size_t i = 1; i < n; ++i) {
+            eta[i] = eta[i - 1] + m[i];
+            mu[i] = jacobi() ? G * eta[i] : G * m[0];
+        }
+        for (auto *a: {&qx, &qy, &qz, &ux, &uy, &uz}) a->assign(n, 0);
+        r.assign(n, Vec3(0, 0, 0));
+        v.assign(n, Vec3(0, 0, 0));
+        acc.assign(n, Vec3(0, 0, 0));
+        radius.assign(n, 0);
+        crit.assign(n, 0);
+        grouped.assign(n, 0);
+        groups.clear();
+    }
+
+    Vec3 q(size_t i) const { return Vec3(qx[i], qy[i], qz[i]); }
+    Vec3 u(size_t i) const { return Vec3(ux[i], uy[i], uz[i]); }
+
+    void set(size_t i, Vec3 pos, Vec3 vel) {
+        qx[i] = pos.x;
+        qy[i] = pos.y;
+        qz[i] = pos.z;
+        ux[i] = vel.x;
+        uy[i] = vel.y;
+        uz[i] = vel.z;
+    }
+
+    // Transformacja Jacobiego wektorów w (położenia, prędkości albo przyspieszenia):
+    // w'[i] = w[i] - (średnia ważona masą z w[0..i-1]), w'[0] - średnia z całości
+    std::vector<Vec3> toJacobi(const std::vector<Vec3> &w) const {
+        std::vector<Vec3> out(size());
+        Vec3 centre = w[0];
+        for (size_t i = 1; i < size(); ++i) {
+            out[i] = w[i] - centre;
+            centre += out[i] * (m[i] / eta[i]);
+        }
+        out[0] = centre;
+        return out;
+    }
+
+    void fromInertial() {
+        size_t n = size();
+        if (fixedCentre) {
+            for (size_t i = 1; i < n; ++i) set(i, r[i] - r[0], v[i]);
+            set(0, r[0], v[0]);
+            return;
+        }
+        if (jacobi()) {
+            std::vector<Vec3> pos = toJacobi(r), vel = toJacobi(v);
+            for (size_t i = 0; i < n; ++i) set(i, pos[i], vel[i]);
+            return;
+        }
+
+        Vec3 centre(0, 0, 0), momentum(0, 0, 0);
+        for (size_t i = 0; i < n; ++i) {
+            centre += r[i] * m[i];
+            momentum += v[i] * m[i];
+        }
+        Vec3 velocity = momentum / eta[n - 1];
+        for (size_t i = 1; i < n; ++i) set(i, r[i] - r[0], v[i] - velocity);
+        set(0, centre / eta[n - 1], velocity);
+    }
+
+    void toInertial() {
+        size_t n = size();
+        if (fixedCentre) {
+            r[0] = q(0);
+            v[0] = u(0);
+            for (size_t i = 1; i < n; ++i) {
+                r[i] = q(i) + r[0];
+                v[i] = u(i);
+            }
+            return;
+        }
+        if (jacobi()) {
+            Vec3 centre = q(0), velocity = u(0);
+            for (size_t i = n - 1; i >= 1; --i) {
+                centre -= q(i) * (m[i] / eta[i]);
+                velocity -= u(i) * (m[i] / eta[i]);
+                r[i] = q(i) + centre;
+                v[i] = u(i) + velocity;
+            }
+            r[0] = centre;
+            v[0] = velocity;
+            return;
+        }
+
+        Vec3 offset(0, 0, 0), momentum(0, 0, 0);
+        for (size_t i = 1; i < n; ++i) {
+            offset += q(i) * m[i];
+            momentum += u(i) * m[i];
+        }
+        r[0] = q(0) - offset / eta[n - 1];
+        v[0] = u(0) - momentum / m[0];
+        for (size_t i = 1; i < n; ++i) {
+            r[i] = q(i) + r[0];
+            v[i] = u(i) + u(0);
+        }
+    }
+
+    // Ruch keplerowski ciał 1..n-1, w DH otoczony połówkami skoku centrum
+    // q[i] += h * sum(m u) / m0, a środek masy płynie jednostajnie
+    template<typename Loop>
+    void drift(double h, Loop &&loop) {
+        size_t n = size();
+        if (!fixedCentre && !jacobi()) jump(0.5 * h);
+        loop(n - 1, [&](size_t begin, size_t end) {
+            Kepler::drift(qx.data() + 1, qy.data() + 1, qz.data() + 1, ux.data() + 1, uy.data() + 1, uz.data() + 1,
+                          mu.data() + 1, begin, end, h, grouped.data() + 1);
+        });
+        if (!groups.empty()) {
+            std::vector<std::vector<Contact> > found(groups.size());
+            std::vector<size_t> taken(groups.size());
+            loop(groups.size(), [&](size_t begin, size_t end) {
+                for (size_t g = begin; g < end; ++g) taken[g] = driftGroup(groups[g], h, found[g]);
+            });
+            for (size_t g = 0; g < groups.size(); ++g) {
+                contacts.insert(contacts.end(), found[g].begin(), found[g].end());
+                substeps += taken[g];
+            }
+        }
+        if (!fixedCentre && !jacobi()) jump(0.5 * h);
+        if (!fixedCentre) set(0, q(0) + u(0) * h, u(0));
+    }
+
+    // 1 - K(d), K(y) = y^2 / (2y^2 - 2y + 1), y = (d - 0.1 rc) / 0.9 rc
+    double closeWeight(size_t i, size_t j, double d) const {
+        double rc = std::max(crit[i], crit[j]);
+        double y = (d - 0.1 * rc) / (0.9 * rc);
+        if (y <= 0) return 1;
+        if (y >= 1) return 0;
+        return 1 - y * y / (2 * y * y - 2 * y + 1);
+    }
+
+    // Przyspieszenie i od j o jednostkowej masie, zmiękczone jak PhysicsEngine::pairGravity
+    Vec3 pull(size_t i, size_t j, Vec3 d) const {
+        double soft = 0.01 * (radius[i] + radius[j]);
+        double d2 = d.lengthSq() + soft * soft;
+        return d * (G / (d2 * std::sqrt(d2)));
+    }
+
+    // Promień przejścia: hill promieni Hilla albo 0.4 drogi w kroku (jak w MERCURY), co najmniej
+    // dwa promienie ciała - zetknięcie zawsze wypada wewnątrz grupy
+    void setCritical(double dt, double hill) {
+        for (size_t i = 1; i < size(); ++i) {
+            double hillRadius = q(i).length() * std::cbrt(m[i] / (3 * m[0]));
+            crit[i] = std::max({hill * hillRadius, 0.4 * std::abs(dt) * u(i).length(), 2 * radius[i]});
+        }
+    }
+
+    // Czy para może w kroku dt zbliżyć się na promień przejścia: ruch względny prostoliniowy,
+    // zasięg z zapasem 1.5 na zakrzywienie torów
+    bool approaches(size_t i, size_t j, double dt) const {
+        Vec3 d = q(j) - q(i), w = u(j) - u(i);
+        double w2 = w.lengthSq();
+        double t = w2 > 0 ? std::clamp(-d.dot(w) / w2, 0.0, std::abs(dt)) : 0.0;
+        double reach = 1.5 * std::max(crit[i], crit[j]);
+        return (d + w * t).lengthSq() < reach * reach;
+    }
+
+    // Grupy bliskich spotkań to spójne składowe grafu par; zeruje zetknięcia z poprzedniego kroku
+    void setEncounters(const std::vector<std::pair<size_t, size_t> > &pairs) {
+        size_t n = size();
+        std::vector<size_t> parent(n);
+        std::iota(parent.begin(), parent.end(), size_t(0));
+        auto find = [&](size_t i) {
+            while (parent[i] != i) i = parent[i] = parent[parent[i]];
+            return i;
+        };
+        grouped.assign(n, 0);
+        for (auto [i, j]: pairs) {
+            parent[find(i)] = find(j);
+            grouped[i] = grouped[j] = 1;
+        }
+
+        groups.clear();
+        std::vector<size_t> slot(n, n);
+        for (size_t i = 1; i < n; ++i) {
+            if (!grouped[i]) continue;
+            size_t root = find(i);
+            if (slot[root] == n) {
+                slot[root] = groups.size();
+                groups.emplace_back();
+            }
+            groups[slot[root]].push_back(i);
+        }
+        contacts.clear();
+        substeps = 0;
+    }
+
+    // Odejmuje od acc część 1 - K oddziaływań par z grup (ta idzie w drifcie)
+    void splitEncounterForces() {
+        for (const auto &group: groups) {
+            for (size_t a = 0; a < group.size(); ++a) {
+                for (size_t b = a + 1; b < group.size(); ++b) {
+                    size_t i = group[a], j = group[b];
+                    Vec3 d = r[j] - r[i];
+                    double weight = closeWeight(i, j, d.length());
+                    if (weight == 0) continue;
+                    Vec3 p = pull(i, j, d) * weight;
+                    acc[i] -= p * m[j];
+                    acc[j] += p * m[i];
+                }
+            }
+        }
+    }
+
+    // Ruch keplerowski grupy z częścią 1 - K oddziaływań wewnątrz niej; zwraca liczbę podkroków.
+    // Zetknięcia par szukane na odcinkach między podkrokami.
+    size_t driftGroup(const std::vector<size_t> &group, double h, std::vector<Contact> &found) {
+        size_t k = group.size();
+        std::vector<double> y(6 * k), scale(6 * k);
+        for (size_t a = 0; a < k; ++a) {
+            size_t i = group[a];
+            double position = q(i).length(), speed = u(i).length();
+            for (int c = 0; c < 3; ++c) {
+                scale[6 * a + c] = position;
+                scale[6 * a + 3 + c] = speed > 0 ? speed : 1;
+            }
+            y[6 * a] = qx[i];
+            y[6 * a + 1] = qy[i];
+            y[6 * a + 2] = qz[i];
+            y[6 * a + 3] = ux[i];
+            y[6 * a + 4] = uy[i];
+            y[6 * a + 5] = uz[i];
+        }
+
+        auto at = [](const std::vector<double> &s, size_t a, int offset) {
+            return Vec3(s[6 * a + offset], s[6 * a + offset + 1], s[6 * a + offset + 2]);
+        };
+        auto derivative = [&](const std::vector<double> &s, std::vector<double> &d) {
+            std::vector<Vec3> accel(k);
+            for (size_t a = 0; a < k; ++a) {
+                Vec3 pos = at(s, a, 0);
+                double r2 = pos.lengthSq();
+                accel[a] = pos * (-mu[group[a]] / (r2 * std::sqrt(r2)));
+            }
+            for (size_t a = 0; a < k; ++a) {
+                for (size_t b = a + 1; b < k; ++b) {
+                    size_t i = group[a], j = group[b];
+                    Vec3 dist = at(s, b, 0) - at(s, a, 0);
+                    double weight = closeWeight(i, j, dist.length());
+                    if (weight == 0) continue;
+                    Vec3 p = pull(i, j, dist) * weight;
+                    accel[a] += p * m[j];
+                    accel[b] -= p * m[i];
+                }
+            }
+            for (size_t a = 0; a < k; ++a) {
+                for (int c = 0; c < 3; ++c) d[6 * a + c] = s[6 * a + 3 + c];
+                d[6 * a + 3] = accel[a].x;
+                d[6 * a + 4] = accel[a].y;
+                d[6 * a + 5] = accel[a].z;
+            }
+        };
+        auto accepted = [&](const std::vector<double> &before, const std::vector<double> &after) {
+            for (size_t a = 0; a < k; ++a) {
+                for (size_t b = a + 1; b < k; ++b) {
+                    size_t i = group[a], j = group[b];
+                    Vec3 p0 = at(before, b, 0) - at(before, a, 0), p1 = at(after, b, 0) - at(after, a, 0);
+                    Vec3 w = p1 - p0;
+                    double t = w.lengthSq() > 0 ? std::clamp(-p0.dot(w) / w.lengthSq(), 0.0, 1.0) : 0.0;
+                    double reach = radius[i] + radius[j];
+                    if ((p0 + w * t).lengthSq() >= reach * reach) continue;
+                    auto same = [&](const Contact &c) { return c.a == i && c.b == j; };
+                    if (std::any_of(contacts.begin(), contacts.end(), same) ||
+                        std::any_of(found.begin(), found.end(), same)) continue;
+                    Vec3 v0 = at(before, b, 3) - at(before, a, 3), v1 = at(after, b, 3) - at(after, a, 3);
+                    found.push_back({i, j, p0 + w * t, v0 + (v1 - v0) * t});
+                }
+            }
+        };
+
+        size_t steps = BulirschStoer::integrate(y, h, scale, tolerance, derivative, accepted);
+        for (size_t a = 0; a < k; ++a) {
+            size_t i = group[a];
+            qx[i] = y[6 * a];
+            qy[i] = y[6 * a + 1];
+            qz[i] = y[6 * a + 2];
+            ux[i] = y[6 * a + 3];
+            uy[i] = y[6 * a + 4];
+            uz[i] = y[6 * a + 5];
+        }
+        return steps;
+    }
+
+    void jump(double h) {
+        Vec3 momentum(0, 0, 0);
+        for (size_t i = 1; i < size(); ++i) momentum += u(i) * m[i];
+        Vec3 shift = momentum * (h / m[0]);
+        for (size_t i = 1; i < size(); ++i) set(i, q(i) + shift, u(i));
+    }
+
+    // Kick o h z przyspieszeń acc przy położeniach r. W układzie Jacobiego oddziaływanie to
+    // pełne przyspieszenie w zmiennych Jacobiego minus wyraz keplerowski -mu q / |q|^3.
+    void kick(double h) {
+        size_t n = size();
+        if (fixedCentre) {
+            for (size_t i = 1; i < n; ++i) set(i, q(i), u(i) + acc[i] * h);
+            return;
+        }
+
+        if (jacobi()) {
+            std::vector<Vec3> full = acc;
+            for (size_t i = 1; i < n; ++i) {
+                Vec3 d = r[i] - r[0];
+                double d2 = d.lengthSq();
+                Vec3 pull = d * (G / (d2 * std::sqrt(d2)));
+                full[i] -= pull * m[0];
+                full[0] += pull * m[i];
+            }
+            std::vector<Vec3> relative = toJacobi(full);
+            for (size_t i = 1; i < n; ++i) {
+                Vec3 qi = q(i);
+                double q2 = qi.lengthSq();
+                set(i, qi, u(i) + (relative[i] + qi * (mu[i] / (q2 * std::sqrt(q2)))) * h);
+            }
+            set(0, q(0), u(0) + relative[0] * h);
+            return;
+        }
+
+        // DH: v[i] += acc[i] h dla wszystkich ciał; prędkości barycentryczne tracą zmianę środka masy
+        Vec3 total = acc[0] * m[0];
+        for (size_t i = 1; i < n; ++i) total += acc[i] * m[i];
+        Vec3 shift = total * (h / eta[n - 1]);
+        for (size_t i = 1; i < n; ++i) set(i, q(i), u(i) + acc[i] * h - shift);
+        set(0, q(0), u(0) + shift);
+    }
+};
+
+// evaluate() wypełnia s.acc dla położeń s.r (i prędkości s.v)
+template<typename Evaluate, typename Loop>
+inline void step(System &s, double dt, Evaluate &&evaluate, Loop &&loop) {
+    s.drift(0.5 * dt, loop);
+    s.toInertial();
+    evaluate();
+    s.kick(dt);
+    s.drift(0.5 * dt, loop);
+}
+
+// Korektor symplektyczny 3. rzędu (Wisdom, Holman, Touma 1996; współczynniki jak w WHFast, Rein
+// i Tamayo 2015). Krok działa na zmiennych "mapy": C^-1 przed pierwszym krokiem, C przy odczycie
+// stanu, co usuwa wyrazy błędu rzędu (m / M) dt^2 - zostaje (m / M) dt^4 i (m / M)^2 dt^2.
+// Tylko dla podziału Jacobiego i nieruchomego centrum - w DH skok centrum psuje strukturę błędu.
+namespace Corrector {
+inline constexpr double a1 = 0.41833001326703777398908601289259374469640768464934;
+inline constexpr double b31 = -0.024900596027799867499350357910273437184309981229127;
+}
+
+// Z(a, b) = K(a dt) I(-b dt) K(-2a dt) I(b dt) K(a dt)
+template<typename Evaluate, typename Loop>
+inline void correctorStage(System &s, double dt, double a, double b, Evaluate &&evaluate, Loop &&loop) {
+    s.drift(a * dt, loop);
+    s.toInertial();
+    evaluate();
+    s.kick(-b * dt);
+    s.drift(-2 * a * dt, loop);
+    s.toInertial();
+    evaluate();
+    s.kick(b * dt);
+    s.drift(a * dt, loop);
+}
+
+// sign = 1 - z rzeczywistych zmiennych do mapy (C^-1), -1 - z mapy do rzeczywistych (C)
+template<typename Evaluate, typename Loop>
+inline void correct(System &s, double dt, double sign, Evaluate &&evaluate, Loop &&loop) {
+    correctorStage(s, dt, Corrector::a1, -sign * Corrector::b31, evaluate, loop);
+    correctorStage(s, dt, -Corrector::a1, sign * Corrector::b31, evaluate, loop);
+}
+}